@@ -0,0 +1,27 @@
+struct emuState;
+enum emuPlatform : unsigned char;
+
+/*Ahead-of-time compiled ROMs. chip8-aot (aotcompile.cpp) reads a ROM, works out which of its instructions can be reached, and writes
+ *out a C++ file that runs them as straight native code: every instruction becomes a few lines of C++ working directly on an emuState,
+ *and jumps, calls and skips become gotos. Build that file into any of the programs here and it registers itself; emu::setAot(true)
+ *then runs the ROM through it whenever the ROM that's loaded matches.
+ *
+ *It's the same deal as the JIT (jit.h), just decided before the program runs instead of while it does: a compiled run() executes
+ *instructions until the next stretch of them wouldn't fit in what's left of `budget`, or until it gets to something it didn't compile,
+ *and says how many it did. It never does more than `budget`. 0 means the interpreter has to do the next one. Drawing, random numbers,
+ *anything that writes memory, setting the sound timer (which raises an event, see events.h) and the loops the interpreter knows how to
+ *skip (see emu::getIdle()) are always left to the interpreter.
+ *
+ *If the program writes over any of the bytes that were compiled, the compiled code isn't the program any more, so the emu stops using
+ *it. Loading the ROM again (or restoring a save state where those bytes are back as they were) picks it up again.*/
+
+struct aotProgram {
+	const char *name;								//The ROM it was compiled from
+	emuPlatform platform;							//...and for which platform's quirks
+	const unsigned char *image;						//Memory as the compiler saw it, 4096 bytes...
+	const unsigned char *isCode;					//...and which of them it compiled (1 if so). Those have to match for run() to be used.
+	unsigned long (*run)(emuState &state, long budget);
+};
+
+bool registerAot(const aotProgram &program);		//Generated files call this at startup. Always returns true.
+const aotProgram *findAot(const unsigned char *mem, emuPlatform platform);	//The compiled program for this memory, or NULL
@@ -0,0 +1,498 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "chip8.h"
+#include "quirks.h"
+
+/*chip8-aot: compiles a ROM to C++ ahead of time. See aot.h for how the result gets used.
+ *
+ *	chip8-aot [--platform chip8|schip|xochip] ROMPATH OUTPUT.cpp
+ *
+ *First it works out which instructions the ROM can ever reach. Starting at 0x200 it follows every way out of each instruction: on to
+ *the next one, both sides of a skip, jumps, calls and the instruction after a call (where the matching return comes back to). That's
+ *the control-flow graph, and everything on it gets compiled. Things it can't follow get reported instead of guessed at:
+ *	- BNNN jumps somewhere that depends on a register. Wherever it lands that isn't compiled anyway runs in the interpreter.
+ *	- FX33 and FX55 write memory. Where I was set by an ANNN just before, we can check whether the write lands on compiled code, and
+ *	  say so if it does; otherwise we say we couldn't tell. Either way, if it happens while the ROM runs the emu notices and drops the
+ *	  compiled code.
+ *
+ *Then it writes every compiled instruction out as C++ on an emuState, one label per address, with jumps, calls and skips as gotos.
+ *Everything that isn't compiled (see aot.h) is a label that hands the pc back to the interpreter. The ROM image and which bytes were
+ *compiled go in too, so the emu only ever uses the code on memory that matches.*/
+
+//What an instruction does to the flow of control, from the interpreter's point of view
+enum flow {
+	flowNext,			//Goes on to the next instruction
+	flowSkip,			//The next one or the one after
+	flowJump,			//To NNN
+	flowCall,			//To NNN, and back to the next one later
+	flowReturn,			//Wherever the stack says
+	flowComputed,		//BNNN
+	flowStop			//Doesn't move the pc at all: unknown opcodes, 0NNN, 00FD, jumping to itself
+};
+
+struct instruction {
+	bool reachable;
+	bool compiled;
+	flow next;
+	unsigned short opcode;
+};
+
+static unsigned char memory[4096];
+static instruction code[4096];
+
+//Mirrors emu::decodeFor(), so what we follow and compile is exactly what the interpreter would run
+static flow flowOf(unsigned short opcode, const quirkFlags &quirks, bool &compiled)
+{
+	unsigned char low = opcode & 0x00FF;
+	compiled = false;
+	switch(opcode & 0xF000)
+	{
+		case(0x0000):
+			if(opcode == 0x00E0) return flowNext;
+			if(opcode == 0x00EE) { compiled = true; return flowReturn; }
+			if(quirks.superChip && (opcode == 0x00FB || opcode == 0x00FC || opcode == 0x00FE || opcode == 0x00FF)) return flowNext;
+			if(quirks.superChip && (opcode & 0xFFF0) == 0x00C0) return flowNext;
+			if(quirks.xoChip && (opcode & 0xFFF0) == 0x00D0) return flowNext;
+			return flowStop;
+		case(0x1000): compiled = true; return flowJump;
+		case(0x2000): compiled = true; return flowCall;
+		case(0x3000): case(0x4000): case(0x5000): case(0x9000):
+			compiled = true;
+			return flowSkip;
+		case(0x6000): case(0x7000): case(0xA000):
+			compiled = true;
+			return flowNext;
+		case(0x8000):
+			if((opcode & 0x000F) <= 0x0007 || (opcode & 0x000F) == 0x000E) {
+				compiled = true;
+				return flowNext;
+			}
+			return flowStop;
+		case(0xB000): compiled = true; return flowComputed;
+		case(0xC000): case(0xD000): return flowNext;
+		case(0xE000):
+			if(low == 0x9E || low == 0xA1) {
+				compiled = true;
+				return flowSkip;
+			}
+			return flowStop;
+		case(0xF000):
+			switch(low)
+			{
+				case(0x15): case(0x1E): case(0x29): case(0x65):
+					compiled = true;
+					return flowNext;
+				case(0x30):
+					compiled = quirks.superChip;
+					return quirks.superChip ? flowNext : flowStop;
+				case(0x01):
+					return quirks.xoChip ? flowNext : flowStop;
+				case(0x07): case(0x0A): case(0x18): case(0x33): case(0x55):
+					return flowNext;		//FX07 and FX0A stay in the interpreter so it can spot idle loops, FX18 so it can
+											//switch the buzzer on
+			}
+			return flowStop;
+	}
+	return flowStop;
+}
+
+static unsigned short fetch(unsigned short address)
+{
+	return memory[address] << 8 | memory[(address + 1) & 0x0FFF];
+}
+
+//Walks the control-flow graph from 0x200, and notes where the computed jumps are
+static void analyse(const quirkFlags &quirks, std::vector<unsigned short> &computed)
+{
+	std::vector<unsigned short> work(1, 0x200);
+	while(!work.empty())
+	{
+		unsigned short address = work.back();
+		work.pop_back();
+		if(address >= 0x0FFF || code[address].reachable) {
+			continue;						//Off the end of memory is the interpreter's problem
+		}
+
+		instruction &here = code[address];
+		here.reachable = true;
+		here.opcode = fetch(address);
+		flow f = flowOf(here.opcode, quirks, here.compiled);
+		unsigned short nnn = here.opcode & 0x0FFF;
+
+		if(f == flowJump && nnn == address) {
+			here.compiled = false;			//Jumping to itself: the interpreter knows to treat that as halted
+			f = flowStop;
+		}
+		here.next = f;
+
+		switch(f)
+		{
+			case(flowNext):     work.push_back(address + 2); break;
+			case(flowSkip):     work.push_back(address + 2); work.push_back(address + 4); break;
+			case(flowJump):     work.push_back(nnn); break;
+			case(flowCall):     work.push_back(nnn); work.push_back(address + 2); break;
+			case(flowComputed): computed.push_back(address); break;
+			default:            break;
+		}
+	}
+}
+
+//If I is certainly NNN here because of an ANNN that always runs just before, says so. Only looks back along straight-line code.
+static bool knownIndex(unsigned short address, unsigned short &index)
+{
+	for(int steps = 0; steps < 16 && address >= 0x202; steps++)
+	{
+		//The instruction before has to be the only way in, so nothing else can be jumping here
+		unsigned short before = address - 2;
+		for(int other = 0; other < 0x0FFF; other++)
+		{
+			if(!code[other].reachable || other == before) {
+				continue;
+			}
+			unsigned short op = code[other].opcode;
+			unsigned short kind = op & 0xF000;
+			bool reaches = ((kind == 0x1000 || kind == 0x2000) && (op & 0x0FFF) == address)
+				|| (other + 4 == address && (kind == 0x3000 || kind == 0x4000 || kind == 0x5000 || kind == 0x9000 || kind == 0xE000))
+				|| (other + 2 == address && kind == 0x2000);
+			if(reaches) {
+				return false;
+			}
+		}
+		if(!code[before].reachable) {
+			return false;
+		}
+
+		unsigned short op = code[before].opcode;
+		if((op & 0xF000) == 0xA000) {
+			index = op & 0x0FFF;
+			return true;
+		}
+		if(code[before].next != flowNext || (op & 0xF000) == 0xF000) {
+			return false;					//Doesn't just carry on to here, or might change I (FX1E, FX29, FX30, FX55, FX65)
+		}
+		address = before;
+	}
+	return false;
+}
+
+static void line(FILE *out, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vfprintf(out, format, args);
+	va_end(args);
+	fputc('\n', out);
+}
+
+//How many instructions in a row, starting at `address`, a run can do before it comes to a jump, a call, a return or a skip (counting
+//that one) or to something that isn't compiled (not counting it). 0 if `address` itself isn't compiled.
+static int runLength[4096];
+
+static void measureRuns()
+{
+	for(int address = 0x0FFE; address >= 0; address--)
+	{
+		if(!code[address].reachable || !code[address].compiled) {
+			runLength[address] = 0;
+		} else if(code[address].next == flowNext && address + 2 < 0x0FFF) {
+			runLength[address] = 1 + runLength[address + 2];
+		} else {
+			runLength[address] = 1;
+		}
+	}
+}
+
+//The budget check, the same one the JIT makes on the way into a block: if what's left won't cover the whole run starting at `target`,
+//go back to the interpreter with the pc pointing there. It does the last few one at a time, so a run never goes past its budget.
+//Jumps, calls, skips and the dispatch after a return or a BNNN all check; falling from one instruction into the next doesn't need to.
+static void transfer(FILE *out, unsigned short target, const char *indent)
+{
+	if(target < 0x0FFF && runLength[target] > 0) {
+		line(out, "%sif((long)ran > budget - %d) { s.pc = 0x%03X; return ran; } goto L%03X;", indent, runLength[target], target, target);
+	} else {
+		line(out, "%ss.pc = 0x%03X; return ran;", indent, target);
+	}
+}
+
+//On to the next instruction. The check at the start of the run already counted it.
+static void fallThrough(FILE *out, unsigned short target)
+{
+	if(target < 0x0FFF) {
+		line(out, "\tgoto L%03X;", target);
+	} else {
+		line(out, "\ts.pc = 0x%03X; return ran;", target);
+	}
+}
+
+static void emitInstruction(FILE *out, unsigned short address, const quirkFlags &quirks)
+{
+	unsigned short opcode = code[address].opcode;
+	unsigned int x = (opcode & 0x0F00) >> 8;
+	unsigned int y = (opcode & 0x00F0) >> 4;
+	unsigned int nn = opcode & 0x00FF;
+	unsigned int nnn = opcode & 0x0FFF;
+	unsigned int source = quirks.shiftVy ? y : x;
+
+	line(out, "L%03X:\t//%04X", address, opcode);
+	if(!code[address].compiled) {
+		line(out, "\ts.pc = 0x%03X; return ran;", address);
+		return;
+	}
+
+	switch(opcode & 0xF000)
+	{
+		case(0x0000):		//00EE. A stack that's empty (or worse) is left to the interpreter, to go wrong however it goes wrong.
+			line(out, "\tif(s.sp == 0 || s.sp > 16) { s.pc = 0x%03X; return ran; }", address);
+			line(out, "\tran++; s.pc = s.stack[--s.sp] + 2; goto dispatch;");
+			return;
+		case(0x1000):
+			line(out, "\tran++;");
+			transfer(out, nnn, "\t");
+			return;
+		case(0x2000):
+			line(out, "\tif(s.sp >= 16) { s.pc = 0x%03X; return ran; }", address);
+			line(out, "\tran++; s.stack[s.sp++] = 0x%03X;", address);
+			transfer(out, nnn, "\t");
+			return;
+		case(0x3000): case(0x4000): case(0x5000): case(0x9000): case(0xE000):
+		{
+			char condition[64];
+			switch(opcode & 0xF000)
+			{
+				case(0x3000): snprintf(condition, sizeof(condition), "s.registers[0x%X] == 0x%02X", x, nn); break;
+				case(0x4000): snprintf(condition, sizeof(condition), "s.registers[0x%X] != 0x%02X", x, nn); break;
+				case(0x5000): snprintf(condition, sizeof(condition), "s.registers[0x%X] == s.registers[0x%X]", x, y); break;
+				case(0x9000): snprintf(condition, sizeof(condition), "s.registers[0x%X] != s.registers[0x%X]", x, y); break;
+				default:
+					snprintf(condition, sizeof(condition), "s.input[s.registers[0x%X] & 0xF] %s 0", x, nn == 0x9E ? "!=" : "==");
+			}
+			line(out, "\tran++;");
+			line(out, "\tif(%s) {", condition);
+			transfer(out, address + 4, "\t\t");
+			line(out, "\t}");
+			transfer(out, address + 2, "\t");
+			return;
+		}
+		case(0x6000): line(out, "\ts.registers[0x%X] = 0x%02X; ran++;", x, nn); return;
+		case(0x7000): line(out, "\ts.registers[0x%X] += 0x%02X; ran++;", x, nn); return;
+		case(0x8000):
+			switch(opcode & 0x000F)
+			{
+				case(0x0): line(out, "\ts.registers[0x%X] = s.registers[0x%X]; ran++;", x, y); break;
+				case(0x1): case(0x2): case(0x3):
+					line(out, "\ts.registers[0x%X] %c= s.registers[0x%X]; ran++;", x, "|&^"[(opcode & 0x000F) - 1], y);
+					if(quirks.vfReset) {
+						line(out, "\ts.registers[0xF] = 0;");
+					}
+					break;
+				case(0x4):
+					line(out, "\t{ unsigned char carry = s.registers[0x%X] > 0xFF - s.registers[0x%X] ? 1 : 0;", y, x);
+					line(out, "\t  s.registers[0x%X] += s.registers[0x%X]; s.registers[0xF] = carry; ran++; }", x, y);
+					break;
+				case(0x5):
+					line(out, "\t{ unsigned char noBorrow = s.registers[0x%X] > s.registers[0x%X] ? 0 : 1;", y, x);
+					line(out, "\t  s.registers[0x%X] -= s.registers[0x%X]; s.registers[0xF] = noBorrow; ran++; }", x, y);
+					break;
+				case(0x6):
+					line(out, "\t{ unsigned char source = s.registers[0x%X];", source);
+					line(out, "\t  s.registers[0x%X] = source >> 1; s.registers[0xF] = source & 0x1; ran++; }", x);
+					break;
+				case(0x7):
+					line(out, "\t{ unsigned char noBorrow = s.registers[0x%X] > s.registers[0x%X] ? 0 : 1;", x, y);
+					line(out, "\t  s.registers[0x%X] = s.registers[0x%X] - s.registers[0x%X]; s.registers[0xF] = noBorrow; ran++; }", x, y, x);
+					break;
+				default:
+					line(out, "\t{ unsigned char source = s.registers[0x%X];", source);
+					line(out, "\t  s.registers[0x%X] = source << 1; s.registers[0xF] = source >> 7; ran++; }", x);
+			}
+			return;
+		case(0xA000): line(out, "\ts.index = 0x%03X; ran++;", nnn); return;
+		case(0xB000):
+			line(out, "\tran++; s.pc = 0x%03X + s.registers[0x%X]; goto dispatch;", nnn, quirks.jumpVx ? x : 0);
+			return;
+		case(0xF000):
+			switch(nn)
+			{
+				case(0x15): line(out, "\ts.delayTimer = s.registers[0x%X]; ran++;", x); break;
+				case(0x1E): line(out, "\ts.index += s.registers[0x%X]; ran++;", x); break;
+				case(0x29): line(out, "\ts.index = s.registers[0x%X] * 0x5; ran++;", x); break;
+				case(0x30): line(out, "\ts.index = 0x50 + (s.registers[0x%X] & 0xF) * 10; ran++;", x); break;
+				default:			//FX65
+					for(unsigned int i = 0; i <= x; i++) {
+						line(out, "\ts.registers[0x%X] = s.mem[(s.index + %u) & 0x0FFF];", i, i);
+					}
+					if(quirks.loadStoreIncrement) {
+						line(out, "\ts.index += %u;", x + 1);
+					}
+					line(out, "\tran++;");
+			}
+			return;
+	}
+}
+
+static void emitBytes(FILE *out, const char *name, const unsigned char *bytes)
+{
+	line(out, "static const unsigned char %s[4096] = {", name);
+	for(int i = 0; i < 4096; i += 32)
+	{
+		fputc('\t', out);
+		for(int j = i; j < i + 32; j++) {
+			fprintf(out, "%u,", bytes[j]);
+		}
+		fputc('\n', out);
+	}
+	line(out, "};");
+}
+
+int main(int argc, char *argv[])
+{
+	emuPlatform platform = platformDefault;
+	const char *romPath = NULL;
+	const char *outPath = NULL;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--platform") == 0 && i + 1 < argc) {
+			if(!platformNamed(argv[++i], platform)) {
+				printf("Unknown platform %s (try chip8, schip or xochip)\n", argv[i]);
+				return 1;
+			}
+		} else if(romPath == NULL) {
+			romPath = argv[i];
+		} else {
+			outPath = argv[i];
+		}
+	}
+	if(romPath == NULL || outPath == NULL)
+	{
+		printf("Usage: chip8-aot [--platform NAME] ROMPATH OUTPUT.cpp\n");
+		return 1;
+	}
+
+	FILE *rom = fopen(romPath, "rb");
+	if(rom == NULL)
+	{
+		fprintf(stderr, "Couldn't open %s\n", romPath);
+		return 1;
+	}
+	size_t romSize = fread(memory + 0x200, 1, sizeof(memory) - 0x200, rom);
+	bool tooBig = fgetc(rom) != EOF;
+	fclose(rom);
+	if(tooBig)
+	{
+		fputs("ROM too large for memory!\n", stderr);
+		return 1;
+	}
+
+	quirkFlags quirks = quirksFor(platform);
+	std::vector<unsigned short> computed;
+	analyse(quirks, computed);
+	measureRuns();
+
+	unsigned char isCode[4096];
+	memset(isCode, 0, sizeof(isCode));
+	int reachable = 0, compiled = 0;
+	for(int address = 0; address < 0x0FFF; address++)
+	{
+		if(!code[address].reachable) {
+			continue;
+		}
+		reachable++;
+		if(code[address].compiled) {
+			compiled++;
+			isCode[address] = isCode[address + 1] = 1;
+		}
+	}
+
+	//The report: what we couldn't follow, and anything that looks like it might rewrite compiled code
+	printf("%s (%s): %u bytes, %d reachable instructions, %d compiled, %d left to the interpreter\n",
+		romPath, platformName(platform), (unsigned int)romSize, reachable, compiled, reachable - compiled);
+	for(size_t i = 0; i < computed.size(); i++) {
+		printf("  0x%03X %04X computed jump, targets unknown\n", computed[i], code[computed[i]].opcode);
+	}
+	for(int address = 0; address < 0x0FFF; address++)
+	{
+		unsigned short op = code[address].opcode;
+		if(!code[address].reachable || (op & 0xF000) != 0xF000 || ((op & 0xFF) != 0x33 && (op & 0xFF) != 0x55)) {
+			continue;
+		}
+		unsigned short index;
+		unsigned int length = (op & 0xFF) == 0x33 ? 3 : ((op & 0x0F00) >> 8) + 1;
+		if(!knownIndex(address, index)) {
+			printf("  0x%03X %04X writes memory at an I we can't work out\n", address, op);
+			continue;
+		}
+		for(unsigned int i = 0; i < length; i++)
+		{
+			if(isCode[(index + i) & 0x0FFF]) {
+				printf("  0x%03X %04X writes over compiled code at 0x%03X (self-modifying)\n", address, op, (index + i) & 0x0FFF);
+				break;
+			}
+		}
+	}
+
+	FILE *out = fopen(outPath, "w");
+	if(out == NULL)
+	{
+		fprintf(stderr, "Couldn't write %s\n", outPath);
+		return 1;
+	}
+
+	const char *slash = strrchr(romPath, '/');
+	std::string name = slash != NULL ? slash + 1 : romPath;
+	static const char *const platformEnums[] = { "platformDefault", "platformChip8", "platformSchip", "platformXochip" };
+
+	line(out, "//%s compiled ahead of time by chip8-aot for the %s platform. Don't edit it, run chip8-aot again.", name.c_str(),
+		platformName(platform));
+	line(out, "//%d of %d reachable instructions compiled. See aot.h.", compiled, reachable);
+	line(out, "#include \"chip8.h\"");
+	line(out, "#include \"aot.h\"");
+	line(out, "");
+	line(out, "#ifdef __GNUC__");
+	line(out, "#pragma GCC diagnostic ignored \"-Wunused-label\"\t//Every address gets a label, whether anything jumps there or not");
+	line(out, "#endif");
+	line(out, "");
+	emitBytes(out, "image", memory);
+	line(out, "");
+	emitBytes(out, "isCode", isCode);
+	line(out, "");
+	line(out, "static unsigned long run(emuState &s, long budget)");
+	line(out, "{");
+	line(out, "\tunsigned long ran = 0;");
+	line(out, "dispatch:");
+	line(out, "\tswitch(s.pc)");
+	line(out, "\t{");
+	for(int address = 0; address < 0x0FFF; address++) {
+		if(code[address].compiled) {
+			line(out, "\t\tcase(0x%03X): if((long)ran > budget - %d) { return ran; } goto L%03X;", address, runLength[address], address);
+		}
+	}
+	line(out, "\t\tdefault: return ran;");
+	line(out, "\t}");
+	line(out, "");
+
+	int previous = -1;
+	for(int address = 0; address < 0x0FFF; address++)
+	{
+		if(!code[address].reachable) {
+			continue;
+		}
+		if(previous >= 0 && code[previous].compiled && code[previous].next == flowNext && previous + 2 != address) {
+			fallThrough(out, previous + 2);				//Falls through to somewhere that isn't next in the file
+		}
+		emitInstruction(out, address, quirks);
+		previous = address;
+	}
+	if(previous >= 0 && code[previous].compiled && code[previous].next == flowNext) {
+		fallThrough(out, previous + 2);
+	}
+	line(out, "}");
+	line(out, "");
+	line(out, "static const aotProgram program = { \"%s\", %s, image, isCode, run };", name.c_str(), platformEnums[platform]);
+	line(out, "static const bool registered = registerAot(program);");
+	fclose(out);
+	return 0;
+}
@@ -0,0 +1,617 @@
+#include "chip8.h"
+#include "batch.h"
+#include "events.h"
+#include "quirks.h"
+#include <stdio.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BATCH_SSE2
+#endif
+
+emuBatch::emuBatch(unsigned int lanes) {
+	count = lanes;
+	stride = (lanes + 31) & ~31u;		//Padded so the vector loops never have a leftover bit at the end
+	steps = 0;
+	stamp = 0;
+	this->lanes = new emu[lanes];
+	platform = platformDefault;
+
+	for(int r = 0; r < 16; r++) {
+		registers[r].assign(stride, 0);
+	}
+	pc.assign(stride, 0);
+	index.assign(stride, 0);
+	sp.assign(stride, 0);
+	delayTimer.assign(stride, 0);
+	soundTimer.assign(stride, 0);
+	mask8.assign(stride, 0);
+	mask16.assign(stride, 0);
+	everyLane8.assign(stride, 0);
+	everyLane16.assign(stride, 0);
+	for(unsigned int i = 0; i < lanes; i++) {
+		everyLane8[i] = 0xFF;
+		everyLane16[i] = 0xFFFF;
+	}
+
+	groupStamp.assign(4096, 0);
+	groupStart.assign(4096, 0);
+	groupSize.assign(4096, 0);
+	sorted.assign(lanes, 0);
+	written.assign(4096, false);
+}
+
+emuBatch::~emuBatch() {
+	delete[] lanes;
+}
+
+//Reads the file once and hands the same bytes to every lane, instead of every lane opening it for itself
+bool emuBatch::loadRom(const char * fileName) {
+	FILE * pFile = fopen(fileName, "rb");
+	if(pFile == NULL) {
+		fputs("Error loading rom.\n", stderr);
+		return false;
+	}
+	unsigned char rom[4096];
+	size_t romSize = fread(rom, 1, sizeof(rom), pFile);
+	fclose(pFile);
+	return loadRom(rom, romSize);			//Anything too big for memory will still be too big at 4096 bytes
+}
+
+void emuBatch::setPlatform(emuPlatform p) {
+	platform = p;
+	for(unsigned int i = 0; i < count; i++) {
+		lanes[i].setPlatform(p);
+	}
+}
+
+bool emuBatch::loadRom(const unsigned char * rom, size_t romSize) {
+	for(unsigned int i = 0; i < count; i++) {
+		if(!lanes[i].loadRom(rom, romSize)) {
+			return false;
+		}
+		loadLane(i);
+	}
+	steps = 0;
+	written.assign(4096, false);
+	return true;
+}
+
+emu &emuBatch::lane(unsigned int i) {
+	storeLane(i);
+	return lanes[i];
+}
+
+void emuBatch::run(unsigned long n) {
+	for(unsigned long i = 0; i < n; i++) {
+		step();
+	}
+}
+
+void emuBatch::storeLane(unsigned int i) {
+	emu &chip = lanes[i];
+	for(int r = 0; r < 16; r++) {
+		chip.registers[r] = registers[r][i];
+	}
+	chip.pc = pc[i];
+	chip.index = index[i];
+	chip.sp = sp[i];
+	chip.delayTimer = delayTimer[i];
+	chip.soundTimer = soundTimer[i];
+	chip.cycles = steps;
+}
+
+void emuBatch::loadLane(unsigned int i) {
+	emu &chip = lanes[i];
+	for(int r = 0; r < 16; r++) {
+		registers[r][i] = chip.registers[r];
+	}
+	pc[i] = chip.pc;
+	index[i] = chip.index;
+	sp[i] = chip.sp;
+	delayTimer[i] = chip.delayTimer;
+	soundTimer[i] = chip.soundTimer;
+}
+
+//Tells lane i's event queue (see events.h) its sound timer just ran out. Its emu's cycle count is only brought up to date when it
+//steps on its own, so do that first.
+void emuBatch::soundOff(unsigned int i) {
+	lanes[i].cycles = steps;
+	lanes[i].post(eventSoundOff, 0);
+}
+
+//One lane, the ordinary way: hand its registers back to its emu, let emuCycle() do the work, and take them back again.
+void emuBatch::scalarStep(unsigned int i) {
+	emu &chip = lanes[i];
+	storeLane(i);
+
+	//FX33 and FX55 are the only opcodes that write memory. Remember where, so step() knows lanes may not share that code any more.
+	unsigned short address = chip.pc & 0x0FFF;
+	unsigned short opcode = chip.mem[address] << 8 | chip.mem[(address + 1) & 0x0FFF];
+	if((opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055) {
+		unsigned int length = ((opcode & 0x00FF) == 0x33) ? 3 : ((opcode & 0x0F00) >> 8) + 1;
+		for(unsigned int b = 0; b < length; b++) {
+			written[(chip.index + b) & 0x0FFF] = true;
+		}
+	}
+
+	chip.emuCycle();
+	loadLane(i);
+}
+
+bool emuBatch::vectorizable(unsigned short opcode) {
+	switch(opcode & 0xF000)
+	{
+		case(0x1000): case(0x3000): case(0x4000): case(0x6000): case(0x7000): case(0xA000):
+			return true;
+		case(0x5000): case(0x9000):
+			return (opcode & 0x000F) == 0;
+		case(0x8000):
+			switch(opcode & 0x000F)
+			{
+				case(0x0000): case(0x0001): case(0x0002): case(0x0003): case(0x0004):
+				case(0x0005): case(0x0006): case(0x0007): case(0x000E):
+					return true;
+			}
+			return false;
+		case(0xF000):
+			switch(opcode & 0x00FF)
+			{
+				case(0x0007): case(0x0015): case(0x001E): case(0x0029):
+					return true;				//Not FX18. Its lane's emu has to see it to switch the buzzer on.
+			}
+			return false;
+	}
+	return false;
+}
+
+void emuBatch::step() {
+	//The best case, and the usual one for lanes that haven't reacted to their inputs yet: every lane is at the same address.
+	unsigned short first = pc[0];
+	unsigned short apart = 0;
+	for(unsigned int i = 0; i < count; i++) {
+		apart |= pc[i] ^ first;
+	}
+	if(apart == 0) {
+		unsigned short address = first & 0x0FFF;
+		unsigned short opcode = lanes[0].mem[address] << 8 | lanes[0].mem[(address + 1) & 0x0FFF];
+		if(!vectorizable(opcode)) {
+			for(unsigned int i = 0; i < count; i++) {
+				scalarStep(i);
+			}
+			steps++;
+			return;
+		}
+		if(!written[address] && !written[(address + 1) & 0x0FFF]) {
+			vectorStep(opcode, &everyLane8[0], &everyLane16[0]);
+			steps++;
+			return;
+		}
+		//Somebody might have rewritten this code, so fall through and let the general case check each lane.
+	}
+
+	//Otherwise sort the lanes by program counter. Lanes at the same address make up a group, and a group all runs the same opcode.
+	if(++stamp == 0) {
+		groupStamp.assign(4096, 0);			//Wrapped around. Wipe the stamps so old ones can't look current.
+		stamp = 1;
+	}
+	groups.clear();
+	for(unsigned int i = 0; i < count; i++) {
+		unsigned short address = pc[i] & 0x0FFF;
+		if(groupStamp[address] != stamp) {
+			groupStamp[address] = stamp;
+			groupSize[address] = 0;
+			groups.push_back(address);
+		}
+		groupSize[address]++;
+	}
+	unsigned int offset = 0;
+	for(size_t g = 0; g < groups.size(); g++) {
+		groupStart[groups[g]] = offset;
+		offset += groupSize[groups[g]];
+		groupSize[groups[g]] = 0;
+	}
+	for(unsigned int i = 0; i < count; i++) {
+		unsigned short address = pc[i] & 0x0FFF;
+		sorted[groupStart[address] + groupSize[address]++] = i;
+	}
+
+	//Now run each group. The vector loops always walk every lane, so a group has to be a decent share of the batch before that's
+	//cheaper than just stepping its lanes one at a time.
+	for(size_t g = 0; g < groups.size(); g++) {
+		unsigned short address = groups[g];
+		const unsigned int *members = &sorted[groupStart[address]];
+		unsigned int size = groupSize[address];
+
+		const emu &leader = lanes[members[0]];
+		unsigned short opcode = leader.mem[address] << 8 | leader.mem[(address + 1) & 0x0FFF];
+
+		if(size < 2 || size * 32 < count || !vectorizable(opcode)) {
+			for(unsigned int m = 0; m < size; m++) {
+				scalarStep(members[m]);
+			}
+			continue;
+		}
+
+		//If some lane has written over this address, its copy of the code might not match the leader's any more. Those lanes get
+		//stepped on their own.
+		bool shared = !written[address] && !written[(address + 1) & 0x0FFF];
+		for(unsigned int m = 0; m < size; m++) {
+			unsigned int i = members[m];
+			if(!shared && (lanes[i].mem[address] << 8 | lanes[i].mem[(address + 1) & 0x0FFF]) != opcode) {
+				continue;
+			}
+			mask8[i] = 0xFF;
+			mask16[i] = 0xFFFF;
+		}
+
+		vectorStep(opcode, &mask8[0], &mask16[0]);
+
+		for(unsigned int m = 0; m < size; m++) {
+			unsigned int i = members[m];
+			if(mask8[i] == 0) {
+				scalarStep(i);
+			}
+			mask8[i] = 0;
+			mask16[i] = 0;
+		}
+	}
+
+	steps++;
+}
+
+/*Runs one opcode for every lane whose mask is set. Every loop here works on every lane, 16 at a time, and lanes that aren't part of the
+ *group are masked so they come out unchanged. The results match the handlers in chip8.cpp exactly, including writing VF last.
+ *
+ *Registers and timers are bytes, so one SSE2 register holds 16 lanes of them. The program counter and index are 16-bit, so those take
+ *two registers per 16 lanes, and a byte-wide condition gets widened with unpack before it's applied to them.*/
+#ifdef BATCH_SSE2
+
+static inline __m128i load(const void *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline void store(void *p, __m128i v) { _mm_storeu_si128((__m128i *)p, v); }
+
+//m ? a : b, lane by lane
+static inline __m128i select(__m128i m, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+//Adds 2 to the masked program counters, or 4 where skip is set. skip is 16 byte-wide conditions, PC and m16 are 16 lanes of words.
+static inline void advancePc(unsigned short *PC, const unsigned short *m16, __m128i skip) {
+	const __m128i two = _mm_set1_epi16(2);
+	__m128i lo = _mm_unpacklo_epi8(skip, skip);
+	__m128i hi = _mm_unpackhi_epi8(skip, skip);
+	store(PC, _mm_add_epi16(load(PC), _mm_and_si128(load(m16), _mm_add_epi16(two, _mm_and_si128(lo, two)))));
+	store(PC + 8, _mm_add_epi16(load(PC + 8), _mm_and_si128(load(m16 + 8), _mm_add_epi16(two, _mm_and_si128(hi, two)))));
+}
+
+void emuBatch::vectorStep(unsigned short opcode, const unsigned char *m, const unsigned short *m16) {
+	unsigned char *VX = &registers[(opcode & 0x0F00) >> 8][0];
+	unsigned char *VY = &registers[(opcode & 0x00F0) >> 4][0];
+	unsigned char *VF = &registers[0xF][0];
+	unsigned short *PC = &pc[0];
+	unsigned short *I = &index[0];
+	unsigned char *DT = &delayTimer[0];
+	const unsigned int n = stride;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_cmpeq_epi8(zero, zero);
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i nn = _mm_set1_epi8((char)(opcode & 0x00FF));
+	const __m128i nnn = _mm_set1_epi16((short)(opcode & 0x0FFF));
+	const quirkFlags quirks = quirksFor(platform);		//Once per step for all the lanes, not once per lane
+
+	bool advance = true;		//Everything except jumps and skips just moves on to the next opcode
+
+	for(unsigned int i = 0; i < n; i += 16)
+	{
+		__m128i mask = load(m + i);
+		__m128i x = load(VX + i);
+		__m128i y = load(VY + i);
+		__m128i result, flag, source;
+
+		switch(opcode & 0xF000)
+		{
+			case(0x1000):
+				store(PC + i, select(load(m16 + i), nnn, load(PC + i)));
+				store(PC + i + 8, select(load(m16 + i + 8), nnn, load(PC + i + 8)));
+				advance = false;
+				break;
+
+			case(0x3000):
+				advancePc(PC + i, m16 + i, _mm_cmpeq_epi8(x, nn));
+				advance = false;
+				break;
+
+			case(0x4000):
+				advancePc(PC + i, m16 + i, _mm_xor_si128(_mm_cmpeq_epi8(x, nn), ones));
+				advance = false;
+				break;
+
+			case(0x5000):
+				advancePc(PC + i, m16 + i, _mm_cmpeq_epi8(x, y));
+				advance = false;
+				break;
+
+			case(0x9000):
+				advancePc(PC + i, m16 + i, _mm_xor_si128(_mm_cmpeq_epi8(x, y), ones));
+				advance = false;
+				break;
+
+			case(0x6000):
+				store(VX + i, select(mask, nn, x));
+				break;
+
+			case(0x7000):
+				store(VX + i, _mm_add_epi8(x, _mm_and_si128(mask, nn)));
+				break;
+
+			case(0x8000):
+				switch(opcode & 0x000F)
+				{
+					case(0x0000):
+						store(VX + i, select(mask, y, x));
+						break;
+					case(0x0001):
+						store(VX + i, select(mask, _mm_or_si128(x, y), x));
+						if(quirks.vfReset) store(VF + i, select(mask, zero, load(VF + i)));
+						break;
+					case(0x0002):
+						store(VX + i, select(mask, _mm_and_si128(x, y), x));
+						if(quirks.vfReset) store(VF + i, select(mask, zero, load(VF + i)));
+						break;
+					case(0x0003):
+						store(VX + i, select(mask, _mm_xor_si128(x, y), x));
+						if(quirks.vfReset) store(VF + i, select(mask, zero, load(VF + i)));
+						break;
+					case(0x0004):
+						//There was a carry wherever the saturating add and the wrapping add disagree
+						result = _mm_add_epi8(x, y);
+						flag = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_adds_epu8(x, y), result), one);
+						store(VX + i, select(mask, result, x));
+						store(VF + i, select(mask, flag, load(VF + i)));
+						break;
+					case(0x0005):
+						//No borrow wherever VX >= VY, i.e. max(VX, VY) is VX
+						result = _mm_sub_epi8(x, y);
+						flag = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, y), x), one);
+						store(VX + i, select(mask, result, x));
+						store(VF + i, select(mask, flag, load(VF + i)));
+						break;
+					case(0x0006):
+						//SSE2 has no byte shifts, so shift words and throw away the bit that crossed over from the next byte
+						source = quirks.shiftVy ? y : x;
+						result = _mm_and_si128(_mm_srli_epi16(source, 1), _mm_set1_epi8(0x7F));
+						flag = _mm_and_si128(source, one);
+						store(VX + i, select(mask, result, x));
+						store(VF + i, select(mask, flag, load(VF + i)));
+						break;
+					case(0x0007):
+						result = _mm_sub_epi8(y, x);
+						flag = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, y), y), one);
+						store(VX + i, select(mask, result, x));
+						store(VF + i, select(mask, flag, load(VF + i)));
+						break;
+					case(0x000E):
+						source = quirks.shiftVy ? y : x;
+						result = _mm_add_epi8(source, source);
+						flag = _mm_and_si128(_mm_cmplt_epi8(source, zero), one);	//The top bit is the sign bit
+						store(VX + i, select(mask, result, x));
+						store(VF + i, select(mask, flag, load(VF + i)));
+						break;
+				}
+				break;
+
+			case(0xA000):
+				store(I + i, select(load(m16 + i), nnn, load(I + i)));
+				store(I + i + 8, select(load(m16 + i + 8), nnn, load(I + i + 8)));
+				break;
+
+			case(0xF000):
+				switch(opcode & 0x00FF)
+				{
+					case(0x0007):
+						store(VX + i, select(mask, load(DT + i), x));
+						break;
+					case(0x0015):
+						store(DT + i, select(mask, x, load(DT + i)));
+						break;
+					case(0x001E):
+						store(I + i, _mm_add_epi16(load(I + i), _mm_and_si128(load(m16 + i), _mm_unpacklo_epi8(x, zero))));
+						store(I + i + 8, _mm_add_epi16(load(I + i + 8), _mm_and_si128(load(m16 + i + 8), _mm_unpackhi_epi8(x, zero))));
+						break;
+					case(0x0029):
+					{
+						__m128i lo = _mm_unpacklo_epi8(x, zero);
+						__m128i hi = _mm_unpackhi_epi8(x, zero);
+						store(I + i, select(load(m16 + i), _mm_add_epi16(_mm_slli_epi16(lo, 2), lo), load(I + i)));
+						store(I + i + 8, select(load(m16 + i + 8), _mm_add_epi16(_mm_slli_epi16(hi, 2), hi), load(I + i + 8)));
+						break;
+					}
+				}
+				break;
+		}
+
+		if(advance) {
+			const __m128i two = _mm_set1_epi16(2);
+			store(PC + i, _mm_add_epi16(load(PC + i), _mm_and_si128(load(m16 + i), two)));
+			store(PC + i + 8, _mm_add_epi16(load(PC + i + 8), _mm_and_si128(load(m16 + i + 8), two)));
+		}
+	}
+}
+
+//Every lane's timers tick together, so this is just a saturating subtract over both arrays. Lanes whose sound timer is about to run
+//out switch their buzzer off, the same as emu::tickTimers().
+void emuBatch::tickTimers() {
+	const __m128i one = _mm_set1_epi8(1);
+
+	for(unsigned int i = 0; i < stride; i += 16)
+	{
+		store(&delayTimer[i], _mm_subs_epu8(load(&delayTimer[i]), one));
+
+		__m128i sound = load(&soundTimer[i]);
+		int honks = _mm_movemask_epi8(_mm_cmpeq_epi8(sound, one));
+		store(&soundTimer[i], _mm_subs_epu8(sound, one));
+		if(honks != 0) {
+			for(int b = 0; b < 16; b++) {
+				if((honks & (1 << b)) && i + b < count) {
+					soundOff(i + b);
+				}
+			}
+		}
+	}
+}
+
+#else
+
+//The same thing one lane at a time, for machines without SSE2. Still branch-free, so the compiler may vectorize it for us anyway.
+void emuBatch::vectorStep(unsigned short opcode, const unsigned char *m, const unsigned short *m16) {
+	unsigned char *VX = &registers[(opcode & 0x0F00) >> 8][0];
+	unsigned char *VY = &registers[(opcode & 0x00F0) >> 4][0];
+	unsigned char *VF = &registers[0xF][0];
+	unsigned char nn = opcode & 0x00FF;
+	unsigned short nnn = opcode & 0x0FFF;
+	const quirkFlags quirks = quirksFor(platform);
+	unsigned char *source = quirks.shiftVy ? VY : VX;
+
+	unsigned short *PC = &pc[0];
+	unsigned short *I = &index[0];
+	unsigned char *DT = &delayTimer[0];
+	const unsigned int n = stride;
+
+	bool advance = true;		//Everything except jumps and skips just moves on to the next opcode
+
+	switch(opcode & 0xF000)
+	{
+		case(0x1000):
+			for(unsigned int i = 0; i < n; i++) PC[i] = (nnn & m16[i]) | (PC[i] & ~m16[i]);
+			advance = false;
+			break;
+
+		case(0x3000):
+			for(unsigned int i = 0; i < n; i++) PC[i] += (VX[i] == nn ? 4 : 2) & m16[i];
+			advance = false;
+			break;
+
+		case(0x4000):
+			for(unsigned int i = 0; i < n; i++) PC[i] += (VX[i] != nn ? 4 : 2) & m16[i];
+			advance = false;
+			break;
+
+		case(0x5000):
+			for(unsigned int i = 0; i < n; i++) PC[i] += (VX[i] == VY[i] ? 4 : 2) & m16[i];
+			advance = false;
+			break;
+
+		case(0x9000):
+			for(unsigned int i = 0; i < n; i++) PC[i] += (VX[i] != VY[i] ? 4 : 2) & m16[i];
+			advance = false;
+			break;
+
+		case(0x6000):
+			for(unsigned int i = 0; i < n; i++) VX[i] = (nn & m[i]) | (VX[i] & ~m[i]);
+			break;
+
+		case(0x7000):
+			for(unsigned int i = 0; i < n; i++) VX[i] += nn & m[i];
+			break;
+
+		case(0x8000):
+			switch(opcode & 0x000F)
+			{
+				case(0x0000):
+					for(unsigned int i = 0; i < n; i++) VX[i] = (VY[i] & m[i]) | (VX[i] & ~m[i]);
+					break;
+				case(0x0001):
+					for(unsigned int i = 0; i < n; i++) VX[i] |= VY[i] & m[i];
+					if(quirks.vfReset) for(unsigned int i = 0; i < n; i++) VF[i] &= ~m[i];
+					break;
+				case(0x0002):
+					for(unsigned int i = 0; i < n; i++) VX[i] &= VY[i] | ~m[i];
+					if(quirks.vfReset) for(unsigned int i = 0; i < n; i++) VF[i] &= ~m[i];
+					break;
+				case(0x0003):
+					for(unsigned int i = 0; i < n; i++) VX[i] ^= VY[i] & m[i];
+					if(quirks.vfReset) for(unsigned int i = 0; i < n; i++) VF[i] &= ~m[i];
+					break;
+				case(0x0004):
+					for(unsigned int i = 0; i < n; i++) {
+						unsigned char a = VX[i], b = VY[i] & m[i];
+						unsigned char sum = a + b;
+						unsigned char carry = sum < a ? 1 : 0;
+						VX[i] = sum;
+						VF[i] = (carry & m[i]) | (VF[i] & ~m[i]);
+					}
+					break;
+				case(0x0005):
+					for(unsigned int i = 0; i < n; i++) {
+						unsigned char a = VX[i], b = VY[i];
+						unsigned char noBorrow = b > a ? 0 : 1;
+						VX[i] = ((unsigned char)(a - b) & m[i]) | (a & ~m[i]);
+						VF[i] = (noBorrow & m[i]) | (VF[i] & ~m[i]);
+					}
+					break;
+				case(0x0006):
+					for(unsigned int i = 0; i < n; i++) {
+						unsigned char a = source[i];
+						VX[i] = ((a >> 1) & m[i]) | (VX[i] & ~m[i]);
+						VF[i] = ((a & 1) & m[i]) | (VF[i] & ~m[i]);
+					}
+					break;
+				case(0x0007):
+					for(unsigned int i = 0; i < n; i++) {
+						unsigned char a = VX[i], b = VY[i];
+						unsigned char noBorrow = a > b ? 0 : 1;
+						VX[i] = ((unsigned char)(b - a) & m[i]) | (a & ~m[i]);
+						VF[i] = (noBorrow & m[i]) | (VF[i] & ~m[i]);
+					}
+					break;
+				case(0x000E):
+					for(unsigned int i = 0; i < n; i++) {
+						unsigned char a = source[i];
+						VX[i] = ((unsigned char)(a << 1) & m[i]) | (VX[i] & ~m[i]);
+						VF[i] = ((a >> 7) & m[i]) | (VF[i] & ~m[i]);
+					}
+					break;
+			}
+			break;
+
+		case(0xA000):
+			for(unsigned int i = 0; i < n; i++) I[i] = (nnn & m16[i]) | (I[i] & ~m16[i]);
+			break;
+
+		case(0xF000):
+			switch(opcode & 0x00FF)
+			{
+				case(0x0007):
+					for(unsigned int i = 0; i < n; i++) VX[i] = (DT[i] & m[i]) | (VX[i] & ~m[i]);
+					break;
+				case(0x0015):
+					for(unsigned int i = 0; i < n; i++) DT[i] = (VX[i] & m[i]) | (DT[i] & ~m[i]);
+					break;
+				case(0x001E):
+					for(unsigned int i = 0; i < n; i++) I[i] += VX[i] & m16[i];
+					break;
+				case(0x0029):
+					for(unsigned int i = 0; i < n; i++) I[i] = ((VX[i] * 5) & m16[i]) | (I[i] & ~m16[i]);
+					break;
+			}
+			break;
+	}
+
+	if(advance) {
+		for(unsigned int i = 0; i < n; i++) PC[i] += 2 & m16[i];
+	}
+}
+
+void emuBatch::tickTimers() {
+	for(unsigned int i = 0; i < count; i++) {
+		if(delayTimer[i] > 0) {
+			delayTimer[i]--;
+		}
+		if(soundTimer[i] > 0 && --soundTimer[i] == 0) {
+			soundOff(i);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include <stddef.h>
+#include <vector>
+
+/*Runs a whole batch of emulators on the same ROM in lockstep. Every call to step() moves every emulator ("lane") forward by exactly
+ *one instruction, just as if you'd called emuCycle() on each of them.
+ *
+ *The trick is in how the state is stored. A single emu keeps its registers together, which is what you want for one machine. Here the
+ *registers are turned inside out: V3 of every lane sits in one array, the program counter of every lane sits in another, and so on.
+ *When a bunch of lanes are all at the same address they're all about to run the same opcode, so we can run it for every one of them
+ *with one loop over those arrays, using SSE2 instructions that handle 16 lanes at a time.
+ *
+ *Lanes that wander off on their own, and opcodes that touch memory, the screen, the stack or the keyboard, are handed to each lane's
+ *own emu one at a time instead. Memory, the screen, the stack and the keys always live in the lane's emu.*/
+
+class emu;
+enum emuPlatform : unsigned char;
+
+class emuBatch {
+	public:
+		emuBatch(unsigned int lanes);
+		~emuBatch();
+
+		void setPlatform(emuPlatform p);		//Every lane follows the same platform's quirks. Call it before loadRom().
+		bool loadRom(const char * fileName);	//Loads the same ROM into every lane
+		bool loadRom(const unsigned char * rom, size_t romSize);
+		void step();							//Every lane executes one instruction
+		void run(unsigned long steps);
+		void tickTimers();						//Every lane's emu::tickTimers(), all at once
+
+		unsigned int size() const { return count; }
+		unsigned long long getSteps() const { return steps; }
+
+		emu &lane(unsigned int i);				//Brings lane i's emu up to date and hands it over, so you can look at its screen, set
+												//its keys, and so on. Don't call emuCycle() or loadRom() on it yourself.
+
+	private:
+		unsigned int count;						//How many lanes there are
+		unsigned int stride;					//...rounded up so the vector loops never need a leftover case
+		unsigned long long steps;
+		emu *lanes;
+		emuPlatform platform;
+
+		//The structure-of-arrays half of every lane. registers[3][i] is V3 of lane i, and so on.
+		std::vector<unsigned char> registers[16];
+		std::vector<unsigned short> pc;
+		std::vector<unsigned short> index;
+		std::vector<unsigned short> sp;
+		std::vector<unsigned char> delayTimer;
+		std::vector<unsigned char> soundTimer;
+
+		//Which lanes take part in the opcode being run. 0xFF/0xFFFF for yes, 0 for no, so the loops can mask with them directly.
+		std::vector<unsigned char> mask8;
+		std::vector<unsigned short> mask16;
+		std::vector<unsigned char> everyLane8;	//The same, with every real lane switched on
+		std::vector<unsigned short> everyLane16;
+
+		//Scratch space for sorting lanes into groups by program counter
+		std::vector<unsigned int> groupStamp;
+		std::vector<unsigned int> groupStart;
+		std::vector<unsigned int> groupSize;
+		std::vector<unsigned short> groups;
+		std::vector<unsigned int> sorted;
+		unsigned int stamp;
+
+		//Addresses that some lane has written to since the ROM was loaded. Everywhere else every lane still has the same code.
+		std::vector<bool> written;
+
+		void storeLane(unsigned int i);			//SoA -> the lane's emu
+		void loadLane(unsigned int i);			//The lane's emu -> SoA
+		void scalarStep(unsigned int i);
+		void soundOff(unsigned int i);
+		void vectorStep(unsigned short opcode, const unsigned char *m, const unsigned short *m16);
+
+		static bool vectorizable(unsigned short opcode);
+
+		emuBatch(const emuBatch &);
+		emuBatch &operator=(const emuBatch &);
+};
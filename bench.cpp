@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "chip8.h"
+#include "scheduler.h"
+#include "fork.h"
+
+/*Benchmarks for the emulator core. Every number it measures goes into one JSON file, so two builds can be compared by a script and a
+ *slowdown shows up as a diff instead of a feeling.
+ *
+ *	chip8-bench [--seconds S] [--out FILE] [ROMPATH...]
+ *
+ *It measures:
+ *	- instructions per second for each family of opcodes, using tiny generated ROMs that do nothing but that family in a loop, with
+ *	  the interpreter and (where it runs) the JIT
+ *	- emulated frames per second, flat out with no sleeping, on the demo ROMs built in below plus any ROMs named on the command line
+ *	- how long loadRom() takes, from a file and from memory
+ *	- how long saving and restoring a state takes
+ *
+ *Each measurement runs for about S seconds (default 0.5), so the whole thing takes a few seconds.*/
+
+typedef std::chrono::steady_clock benchClock;
+
+static double secondsSince(benchClock::time_point start) {
+	return std::chrono::duration<double>(benchClock::now() - start).count();
+}
+
+struct program {
+	const char *name;
+	std::vector<unsigned short> opcodes;	//Starting at 0x200
+	emuPlatform platform;					//platformDefault unless it needs another platform's opcodes
+};
+
+/*The opcode families. Each one sets up a couple of registers and then loops forever doing just that kind of opcode, so the time goes
+ *where we're pointing it.*/
+
+static std::vector<program> opcodeFamilies() {
+	std::vector<program> families;
+
+	program alu = { "alu_8xyn", {
+		0x6001, 0x6103,												//V0 = 1, V1 = 3
+		0x8014, 0x8012, 0x8011, 0x8013, 0x8015, 0x8016, 0x8017, 0x801E, 0x8104,
+		0x1204 }, platformDefault };								//Back to the first 8XYN
+	families.push_back(alu);
+
+	program skips = { "skips_3x_4x_5x_9x", {
+		0x6000,														//V0 = 0
+		0x7001,														//V0 += 1
+		0x3000, 0x4001, 0x5010, 0x9010, 0x3105,						//Each one skips the next or doesn't, depending on V0
+		0x1202, 0x1202 }, platformDefault };						//Whichever one we land on goes back to V0 += 1
+	families.push_back(skips);
+
+	program draw = { "draw_dxyn", {
+		0xA000,														//I = the font's "0"
+		0x6000, 0x6100,												//V0 = V1 = 0
+		0xD015,														//Draw it
+		0x7003, 0x7102,												//Move along (it wraps at the edges)
+		0x1206 }, platformDefault };
+	families.push_back(draw);
+
+	program hires = { "hires_draw_scroll", {
+		0x00FF,														//128x64
+		0xA000,														//I = the font, read as one 16x16 sprite
+		0x6000, 0x6100,												//V0 = V1 = 0
+		0xD010,														//Draw it 16x16
+		0x00C1, 0x00FB,												//Scroll down a row and right four pixels
+		0x7003,														//Move along
+		0x1208 }, platformSchip };									//Back to the draw
+	families.push_back(hires);
+
+	program memory = { "memory_fx33_fx55_fx65", {
+		0xA300,														//I = 0x300, well away from the code
+		0x6A7B,														//VA = 123
+		0xFA33, 0xFF55, 0xFF65,										//BCD of VA, store V0-VF, load them back
+		0x7A01,
+		0x1204 }, platformDefault };
+	families.push_back(memory);
+
+	return families;
+}
+
+/*The built-in demo ROMs, for frames per second when no real ROMs are around. They're written for this benchmark, so there's no
+ *question of who owns them. They behave like a game would: wait for the delay timer, draw, move, repeat.*/
+
+static std::vector<program> demoRoms() {
+	std::vector<program> demos;
+
+	program bounce = { "demo_bounce", {
+		0x6000, 0x6100, 0x6201, 0x6301,								//Ball at (V0, V1), moving by (V2, V3)
+		0xA000,														//I = the font's "0", our ball
+		0xD015,														//Draw it (200A)
+		0x6401, 0xF415,												//Wait one tick: delay timer = 1...
+		0xF507, 0x3500, 0x1210,										//...and spin until it's back to 0
+		0xD015,														//Rub the ball out
+		0x8024, 0x8134,												//Move it
+		0x303C, 0x1222, 0x62FF,										//Bounce off the right...
+		0x3000, 0x1228, 0x6201,										//...and left
+		0x311B, 0x122E, 0x63FF,										//...and bottom
+		0x3100, 0x1234, 0x6301,										//...and top
+		0x120A }, platformDefault };
+	demos.push_back(bounce);
+
+	program busy = { "demo_busy", {
+		0x6000, 0x6100,
+		0xC0FF, 0xC11F,												//Somewhere random
+		0xF029,														//Some random digit
+		0xD015,
+		0x7201, 0x3200, 0x1204,										//256 of those a frame or so...
+		0x00E0,														//...then clear up and go again
+		0x1204 }, platformDefault };
+	demos.push_back(busy);
+
+	return demos;
+}
+
+//Writes a program out as a ROM file so loadRom can load it the normal way
+static bool writeRom(const char *path, const std::vector<unsigned short> &opcodes) {
+	FILE * pFile = fopen(path, "wb");
+	if(pFile == NULL) {
+		return false;
+	}
+	for(size_t i = 0; i < opcodes.size(); i++) {
+		fputc(opcodes[i] >> 8, pFile);
+		fputc(opcodes[i] & 0xFF, pFile);
+	}
+	fclose(pFile);
+	return true;
+}
+
+//Runs instructions flat out for about `seconds` and returns how many a second that came to
+static double instructionsPerSecond(emu &chip, double seconds) {
+	unsigned long long start = chip.getCycles();
+	benchClock::time_point began = benchClock::now();
+	double elapsed;
+	do {
+		chip.runUntilCycle(chip.getCycles() + 100000);
+		elapsed = secondsSince(began);
+	} while(elapsed < seconds);
+	return (chip.getCycles() - start) / elapsed;
+}
+
+//Runs whole frames (10 instructions plus a timer tick) flat out and returns how many a second that came to
+static double framesPerSecond(emu &chip, double seconds, double &instructionsPerSecond) {
+	frameScheduler scheduler(10);
+	unsigned long long start = chip.getCycles();
+	unsigned long long frames = 0;
+	benchClock::time_point began = benchClock::now();
+	double elapsed;
+	do {
+		for(int i = 0; i < 1000; i++) {
+			scheduler.runTick(chip);
+		}
+		frames += 1000;
+		elapsed = secondsSince(began);
+	} while(elapsed < seconds);
+	instructionsPerSecond = (chip.getCycles() - start) / elapsed;
+	return frames / elapsed;
+}
+
+//Prints a file name as a JSON string. Backslashes and quotes are the only things a path is likely to have that need escaping.
+static void jsonString(FILE *out, const char *text) {
+	fputc('"', out);
+	for(; *text != '\0'; text++) {
+		if(*text == '"' || *text == '\\') {
+			fputc('\\', out);
+		}
+		fputc(*text, out);
+	}
+	fputc('"', out);
+}
+
+int main(int argc, char *argv[])
+{
+	double seconds = 0.5;
+	const char *outPath = "bench.json";
+	std::vector<const char *> romPaths;
+
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+			seconds = atof(argv[++i]);
+		} else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+			outPath = argv[++i];
+		} else {
+			romPaths.push_back(argv[i]);
+		}
+	}
+
+	const char *scratchRom = "chip8-bench.ch8";		//The generated ROMs get written here one at a time
+	FILE *out = fopen(outPath, "w");
+	if(out == NULL) {
+		printf("Couldn't write %s\n", outPath);
+		return 1;
+	}
+
+	emu *chip = new emu;			//An emu is mostly its decode cache, a bit big for the stack
+	chip->setSeed(1);
+	bool jitWorks = chip->setJit(true);
+	chip->setJit(false);
+
+	fprintf(out, "{\n\t\"format\": 1,\n\t\"seconds_per_test\": %g,\n\t\"jit_available\": %s,\n", seconds, jitWorks ? "true" : "false");
+
+	//Opcode families
+	fprintf(out, "\t\"opcode_families\": [\n");
+	std::vector<program> families = opcodeFamilies();
+	for(size_t i = 0; i < families.size(); i++) {
+		writeRom(scratchRom, families[i].opcodes);
+
+		chip->setJit(false);
+		chip->setPlatform(families[i].platform);
+		chip->loadRom(scratchRom);
+		double interpreted = instructionsPerSecond(*chip, seconds);
+
+		double compiled = 0;
+		if(jitWorks) {
+			chip->setJit(true);
+			chip->loadRom(scratchRom);
+			compiled = instructionsPerSecond(*chip, seconds);
+			chip->setJit(false);
+		}
+
+		printf("%-24s %12.0f instructions/sec interpreted, %12.0f with the JIT\n", families[i].name, interpreted, compiled);
+		fprintf(out, "\t\t{ \"name\": \"%s\", \"interpreter_ips\": %.0f, \"jit_ips\": %.0f }%s\n",
+			families[i].name, interpreted, compiled, i + 1 < families.size() ? "," : "");
+	}
+	chip->setPlatform(platformDefault);
+	fprintf(out, "\t],\n");
+
+	//Frames per second, on the demos and then on whatever ROMs we were given
+	fprintf(out, "\t\"roms\": [\n");
+	std::vector<program> demos = demoRoms();
+	size_t romCount = demos.size() + romPaths.size();
+	const char *separator = "";
+	for(size_t i = 0; i < romCount; i++) {
+		const char *name;
+		const char *path;
+		if(i < demos.size()) {
+			writeRom(scratchRom, demos[i].opcodes);
+			name = demos[i].name;
+			path = scratchRom;
+		} else {
+			name = path = romPaths[i - demos.size()];
+		}
+
+		if(!chip->loadRom(path)) {
+			printf("Couldn't load %s, skipping it\n", path);
+			continue;
+		}
+		double ips;
+		double fps = framesPerSecond(*chip, seconds, ips);
+
+		printf("%-24s %12.0f frames/sec (%.0fx real time)\n", name, fps, fps / 60);
+		fprintf(out, "%s\t\t{ \"name\": ", separator);
+		jsonString(out, name);
+		fprintf(out, ", \"frames_per_sec\": %.0f, \"instructions_per_sec\": %.0f }", fps, ips);
+		separator = ",\n";
+	}
+	fprintf(out, "\n\t],\n");
+
+	//loadRom() latency
+	writeRom(scratchRom, demos[0].opcodes);
+	int loads = 0;
+	benchClock::time_point began = benchClock::now();
+	double elapsed;
+	do {
+		for(int i = 0; i < 100; i++) {
+			chip->loadRom(scratchRom);
+		}
+		loads += 100;
+		elapsed = secondsSince(began);
+	} while(elapsed < seconds);
+	double loadMicroseconds = elapsed / loads * 1e6;
+	printf("%-24s %12.2f us\n", "loadRom", loadMicroseconds);
+	remove(scratchRom);
+
+	//...and from memory, the way romCache hands ROMs out
+	std::vector<unsigned char> image;
+	for(size_t i = 0; i < demos[0].opcodes.size(); i++) {
+		image.push_back(demos[0].opcodes[i] >> 8);
+		image.push_back(demos[0].opcodes[i] & 0xFF);
+	}
+	loads = 0;
+	began = benchClock::now();
+	do {
+		for(int i = 0; i < 100; i++) {
+			chip->loadRom(&image[0], image.size());
+		}
+		loads += 100;
+		elapsed = secondsSince(began);
+	} while(elapsed < seconds);
+	double memoryLoadMicroseconds = elapsed / loads * 1e6;
+	printf("%-24s %12.2f us\n", "loadRom from memory", memoryLoadMicroseconds);
+
+	//Save state copies, on a machine that's been running a while so it isn't all zeros
+	double warmup;
+	framesPerSecond(*chip, seconds / 10, warmup);
+	emuState *state = new emuState;
+	int copies = 0;
+	began = benchClock::now();
+	do {
+		for(int i = 0; i < 10000; i++) {
+			chip->saveState(*state);
+		}
+		copies += 10000;
+		elapsed = secondsSince(began);
+	} while(elapsed < seconds);
+	double saveNanoseconds = elapsed / copies * 1e9;
+
+	copies = 0;
+	began = benchClock::now();
+	do {
+		for(int i = 0; i < 10000; i++) {
+			chip->restoreState(*state);
+		}
+		copies += 10000;
+		elapsed = secondsSince(began);
+	} while(elapsed < seconds);
+	double restoreNanoseconds = elapsed / copies * 1e9;
+	printf("%-24s %12.1f ns save, %.1f ns restore\n", "state copy", saveNanoseconds, restoreNanoseconds);
+
+	//The same through a forkArena, the way a tree search would: fork the position, play a move, go back. Only pages the move wrote
+	//to get copied, so the move here is one trip round the FX33/FX55 loop, which writes to one page. It's timed on its own first and
+	//taken off, so what's left is what fork() and load() cost on top of it.
+	for(size_t i = 0; i < families.size(); i++) {
+		if(strcmp(families[i].name, "memory_fx33_fx55_fx65") == 0) {
+			std::vector<unsigned char> writer;
+			for(size_t j = 0; j < families[i].opcodes.size(); j++) {
+				writer.push_back(families[i].opcodes[j] >> 8);
+				writer.push_back(families[i].opcodes[j] & 0xFF);
+			}
+			chip->loadRom(&writer[0], writer.size());
+		}
+	}
+	chip->runUntilCycle(1000);
+	const unsigned long long moveLength = 5;		//FA33, FF55, FF65, 7A01, 1204
+
+	int moves = 0;
+	began = benchClock::now();
+	do {
+		for(int i = 0; i < 10000; i++) {
+			chip->runUntilCycle(chip->getCycles() + moveLength);
+		}
+		moves += 10000;
+		elapsed = secondsSince(began);
+	} while(elapsed < seconds);
+	double moveNanoseconds = elapsed / moves * 1e9;
+
+	forkArena arena(*chip);
+	forkState *root = arena.fork();
+	int forks = 0;
+	began = benchClock::now();
+	do {
+		for(int i = 0; i < 10000; i++) {
+			chip->runUntilCycle(chip->getCycles() + moveLength);
+			arena.release(arena.fork());
+		}
+		forks += 10000;
+		elapsed = secondsSince(began);
+	} while(elapsed < seconds);
+	double forkNanoseconds = elapsed / forks * 1e9 - moveNanoseconds;
+
+	forks = 0;
+	began = benchClock::now();
+	do {
+		for(int i = 0; i < 10000; i++) {
+			chip->runUntilCycle(chip->getCycles() + moveLength);
+			arena.load(root);
+		}
+		forks += 10000;
+		elapsed = secondsSince(began);
+	} while(elapsed < seconds);
+	double forkLoadNanoseconds = elapsed / forks * 1e9 - moveNanoseconds;
+	arena.release(root);
+	printf("%-24s %12.1f ns fork, %.1f ns load, after a %.1f ns move\n", "fork arena", forkNanoseconds, forkLoadNanoseconds,
+		moveNanoseconds);
+
+	fprintf(out, "\t\"load_rom_us\": %.2f,\n\t\"load_rom_memory_us\": %.2f,\n\t\"save_state_ns\": %.1f,\n\t\"restore_state_ns\": %.1f,\n\t\"state_bytes\": %u,\n",
+		loadMicroseconds, memoryLoadMicroseconds, saveNanoseconds, restoreNanoseconds, (unsigned int)sizeof(emuState));
+	fprintf(out, "\t\"fork_ns\": %.1f,\n\t\"fork_load_ns\": %.1f,\n\t\"fork_move_ns\": %.1f\n}\n", forkNanoseconds, forkLoadNanoseconds,
+		moveNanoseconds);
+	fclose(out);
+
+	delete state;
+	delete chip;
+	printf("Wrote %s\n", outPath);
+	return 0;
+}
@@ -1,13 +1,23 @@
 #include "chip8.h"
+#include "aot.h"
+#include "events.h"
+#include "jit.h"
+#include "profile.h"
+#include "quirks.h"
+#include "trace.h"
 #include <stdio.h>
-#include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <vector>
 
-#define GFXARRAY 2048
+#define SCREEN_WIDTH 64
+#define SCREEN_HEIGHT 32
 #define STACK_SIZE 16
 #define REGISTERS 16
 #define MEM_SIZE 4096
 #define FONTSET_SIZE 80
+#define BIGFONT_START 0x50
+#define BIGFONT_SIZE 160
 #define ROMSTART_OFFSET 512
 /*This array defines the CHIP-8's fontset. Recall that the system draws entire sprites to pixels on the screen in a given location
  * and you may realize what this array is doing. Each character is 4 pixels across, and 5 pixels down. Look at the very first entry,
@@ -34,12 +44,118 @@ unsigned char fontset[80] =
     0xF0, 0x80, 0xF0, 0x80, 0x80  //F
 };
 
+//SUPER-CHIP's big font for FX30, the same sixteen digits 8 pixels across and 10 down. It sits in memory right after the small one.
+//This is the set Octo uses, since the original only had 0-9.
+unsigned char bigfont[160] =
+{
+	0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, //0
+	0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, //1
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, //2
+	0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, //3
+	0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, //4
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, //5
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, //6
+	0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, //7
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, //8
+	0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, //9
+	0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, //A
+	0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, //B
+	0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, //C
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, //D
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, //E
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  //F
+};
+
 emu::emu() {
-	//Empty constructor
+	jit = NULL;		//We start out interpreting. setJit() turns the JIT on.
+	aot = NULL;
+	aotWanted = false;
+	events = NULL;		//Nobody's listening until setEvents() says otherwise
+	platform = platformDefault;
+	runTarget = 0;
+	idle = notIdle;
+	dirtyPages = 0xFFFF;
+	stopEarly = false;
+	stopped = stopBudget;
+	PROFILE(profile = new emuProfile; profile->clear();)
+	TRACE(tracer = NULL;)
+
+	//Different every run, and different for every emu started in the same second too
+	setSeed((uint64_t)time(NULL) ^ ((uint64_t)(size_t)this << 16));
 }
 
 emu::~emu() {
-	//Empty destructor
+	delete jit;
+	PROFILE(delete profile;)
+}
+
+bool emu::setJit(bool enabled) {
+	if(!enabled) {
+		delete jit;
+		jit = NULL;
+		return true;
+	}
+
+	if(jit == NULL) {
+		jit = new jitCompiler(*this);
+		if(!jit->ready()) {
+			delete jit;
+			jit = NULL;
+			return false;
+		}
+	}
+	return true;
+}
+
+/*Every ahead-of-time compiled ROM that's been built into the program. A function-local static, so it's there in time for generated
+ *files registering themselves from their own static initializers, whatever order those run in.*/
+
+static std::vector<const aotProgram *> &aotPrograms() {
+	static std::vector<const aotProgram *> programs;
+	return programs;
+}
+
+bool registerAot(const aotProgram &program) {
+	aotPrograms().push_back(&program);
+	return true;
+}
+
+const aotProgram *findAot(const unsigned char *mem, emuPlatform platform) {
+	std::vector<const aotProgram *> &programs = aotPrograms();
+	for(size_t i = 0; i < programs.size(); i++)
+	{
+		const aotProgram &program = *programs[i];
+		if(program.platform != platform) {
+			continue;
+		}
+		bool matches = true;
+		for(int address = 0; address < MEM_SIZE && matches; address++) {
+			matches = !program.isCode[address] || mem[address] == program.image[address];
+		}
+		if(matches) {
+			return &program;
+		}
+	}
+	return NULL;
+}
+
+#ifdef CHIP8_TRACE
+void emu::setTrace(traceWriter *writer) {
+	tracer = writer;
+	memset(decoded, 0, sizeof(decoded));	//Decoded again without superinstructions, which would be several opcodes in one record
+	fusedLow = 0x0FFF;
+	fusedHigh = 0;
+}
+#endif
+
+bool emu::setAot(bool enabled) {
+	aotWanted = enabled;
+	attachAot();
+	return aot != NULL;
+}
+
+void emu::attachAot() {
+	aot = aotWanted ? findAot(mem, platform) : NULL;
 }
 
 /*Now we're getting to the meat of the emulator, where we implement the functions we defined in the header file. So, before we can do anything
@@ -49,13 +165,13 @@ emu::~emu() {
 //just define it in the loadRom function, but it helps if you think of this as a separate step.
 void emu::initialize_chip8() {
 	pc = 0x200; 	//We set the program counter to 0x200, because that's where the ROM address starts on the system
-	opcode = 0;	//Reset the opcode...
-	index = 0;	//...the index register...
+	index = 0;	//Reset the index register...
 	sp = 0;		//...and the stack pointer
 
-	for(int i = 0; i < GFXARRAY; i++) {
-		graphics[i] = 0;	//Clearing the graphics array. Just make it all 0...there are 2048 items in the array, so we loop that many times
-	}
+	memset(graphics, 0, sizeof(graphics));	//Clearing the graphics array. Both planes, every row, both halves.
+	hires = 0;								//Every ROM starts out in the normal 64x32 mode...
+	planes = 1;								//...drawing on the first plane
+	memset(reserved, 0, sizeof(reserved));
 
 	for(int i = 0; i < STACK_SIZE; i++) {
 		stack[i] = 0;		//Clear the stack. 16 items, 16 loops.
@@ -65,33 +181,89 @@ void emu::initialize_chip8() {
 		input[i] = registers[i] = 0;	//Clear the input and cpu registers too!
 	}
 
-	for(int i = 0; i < MEM_SIZE; i++) {
-		mem[i] = 0;			//Cleaning cleaning....
-	}
+	memset(mem, 0, sizeof(mem));			//Cleaning cleaning....
+	dirtyPages = 0xFFFF;
+	memset(decoded, 0, sizeof(decoded));	//Nothing has been decoded yet, either. These two get done with memset because starting
+											//lots of short-lived emulators spends most of its time right here.
+	fusedLow = 0x0FFF;
+	fusedHigh = 0;
 
 	for(int i = 0; i < FONTSET_SIZE; i++) {
 		mem[i] = fontset[i];	//We'll load the fontset as part of the initialization process. It needs to be here for the system to use!
 	}
+	memcpy(mem + BIGFONT_START, bigfont, BIGFONT_SIZE);
+
+	if(jit != NULL) {
+		jit->flush();		//Anything the JIT compiled belonged to the old memory contents
+	}
 
 	//Resetting system timers
 	delayTimer = 0;
 	soundTimer = 0;
+	cycles = 0;
+	idle = notIdle;
+	PROFILE(profile->clear();)
 
 	//And finally, clear the screen! Just the once is fine.
 	drawFlag = true;
 
-	srand(time(NULL));
+	setSeed(seed);		//Same ROM, same seed, same random numbers
 }
 
-bool emu::loadRom(const wchar_t * fileName) {
-	initialize_chip8(); 					//Picture this as turning the CHIP-8 on, if it helps.
-	printf("Starting %s...\n", fileName); 	// Just a little debug line, pretty self-explanatory
+/*CXNN's random numbers. xorshift64* is tiny, quick, and plenty random enough for games, and since its state lives in emuState it gets
+ *saved, restored and replayed along with everything else.*/
+
+void emu::setSeed(uint64_t seed) {
+	this->seed = seed;
+
+	//Run the seed through splitmix64 first, so nearby seeds (like the clock a second apart) don't give similar sequences, and so the
+	//state can never be zero (xorshift gets stuck there)
+	uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	randomState = z != 0 ? z : 1;
+}
+
+unsigned char emu::randomByte() {
+	randomState ^= randomState >> 12;
+	randomState ^= randomState << 25;
+	randomState ^= randomState >> 27;
+	return (unsigned char)((randomState * 0x2545F4914F6CDD1DULL) >> 56);	//The top bits are the best ones
+}
 
+#ifdef _WIN32
+bool emu::loadRom(const wchar_t * fileName) {
 	FILE * pFile = _wfopen(fileName, L"rb"); 	//Look up fopen if you need more help here, but briefly, fopen returns a stream that can be
 											//referred to with pFile. It takes two parameters, the path of the file in question and
 											//the mode. "rb" here means "read and binary mode". That's what we need!
+	return readRom(pFile);
+}
+#endif
+
+//Same thing for everybody who isn't on Windows, where file names are plain chars.
+bool emu::loadRom(const char * fileName) {
+	FILE * pFile = fopen(fileName, "rb");
+	return readRom(pFile);
+}
+
+//And for a ROM that's already in memory somewhere (see romcache.h). It goes straight from there into mem, no files and no copies in
+//between, which makes this the quickest way to start a lot of emulators on the same ROM.
+bool emu::loadRom(const unsigned char * rom, size_t romSize) {
+	if(romSize > MEM_SIZE - ROMSTART_OFFSET) {			//ROM goes into system memory from location 0x200 (512), so that's all the room there is
+		fputs("ROM too large for memory!\n", stderr);
+		return false;
+	}
+
+	initialize_chip8(); 								//Picture this as turning the CHIP-8 on, if it helps.
+	memcpy(mem + ROMSTART_OFFSET, rom, romSize);
+	attachAot();
+	return true;
+}
+
+bool emu::readRom(FILE * pFile) {
 	if(pFile == NULL) {
-		fputs("Error loading rom. ", stderr); 	//Mostly self-explanatory. Just remember that fputs prints to a file stream, and stderr
+		fputs("Error loading rom.\n", stderr); 		//Mostly self-explanatory. Just remember that fputs prints to a file stream, and stderr
 													//is a file stream that's part of the stdlib.
 		return false;								//If something screws up loading the rom, we're gonna want to abort the whole thing.
 	}
@@ -103,58 +275,265 @@ bool emu::loadRom(const wchar_t * fileName) {
 	long romSize = ftell(pFile);//Since we're at the end of the file, ftell will tell us how many bytes there are from the end of the file
 								//to the beginning. We'll dump that info in a long called romSize and use it later.
 	rewind(pFile);				//Now go back to the beginning of pFile. You rewind VHS tapes when you finish the movie right? :)
-	printf("Rom size: %d\n", (int)romSize); //Self explanatory. Note the type cast for romSize. We want it as a long, but we don't need to
-											//print it as one, right?
 
-	char * buffer = (char*)malloc(sizeof(char) * romSize);	//malloc returns a void* pointer to the beginning of a block of memory. We'll
-															//be needing to dereference this block of memory later (in order to fill the
-															//emulated system memory with the same data) so what we want as a char* pointer.
-															//Next, we want the size of the block of memory to be the size of a char
-															//multiplied by how many bytes are in the the rom. Or in otherwords...the romsize.
-															//So malloc's parameter becomes "sizeof(char) * romSize". Easy!
-	if(buffer == NULL) {
-		fputs("Memory error!", stderr);						//Quick sanity check. If malloc failed to make a buffer for us...
-		return false;										//We want to abort the rest of what we're doing.
+	if(romSize < 0 || romSize > MEM_SIZE - ROMSTART_OFFSET) {
+		fputs("ROM too large for memory!\n", stderr);	//Checked before we touch anything, so a bad ROM leaves the machine as it was
+		fclose(pFile);
+		return false;
 	}
 
-	/*So we've loaded the file, we've recorded it's size, and we've allocated memory for it. Next up is to copy it to the emulated system's
-	 * memory*/
+	/*The ROM fits, so turn the machine on and read the file straight into the emulated system's memory, starting at 0x200. No need for
+	 *a buffer in between.*/
+
+	initialize_chip8();
+	size_t result = fread(mem + ROMSTART_OFFSET, 1, romSize, pFile);	//fread takes, in this order, a pointer to a block of memory to
+																		//write to, the size in bytes for each read, the number of reads
+																		//to perform, and the file stream to read from. fread returns
+																		//the number of successfully read elements.
 
-	size_t result = fread(buffer, 1, romSize, pFile);		//fread takes, in this order, a pointer to a block of memory to write to, the size
-															//in bytes for each read, the number of reads to perform, and the file stream to
-															//read from. fread returns the number of successfully read elements.
+	//Okay, we're done with the file now. Close it whether that worked or not.
+	fclose(pFile);
 
-	if(result != romSize) { 								//In our code, result and romSize should be the same size. If they're not, something's wrong.
-		fputs("Reading error", stderr);
+	if(result != (size_t)romSize) { 						//In our code, result and romSize should be the same size. If they're not, something's wrong.
+		fputs("Reading error\n", stderr);
 		return false;										//So abort!
 	}
+	attachAot();
+	return true;
+}
+
+//Moment of truth. The system is initialized. The file is loaded and in the emulated system's memory. Now we fetch, decode, and execute.
+//Exciting!
+
+//One instruction through the decode cache, no JIT. emuCycle() and runUntilCycle() both come through here.
+inline void emu::interpret()
+{
+	//Remember the first step? Fetching the opcode! Except most of the time we've already fetched and decoded whatever lives at this
+	//address before, so all we need is the entry in our decode cache. Only the very first visit to an address pays for decoding it.
+
+	const decodedOp &op = decoded[pc & 0x0FFF];
+	if(op.handler == NULL)
+	{
+		decode(pc & 0x0FFF);
+	}
+
+	PROFILE(profile->byPc[pc & 0x0FFF]++; profile->byClass[op.kind]++;)
+	TRACE(unsigned short at = pc; unsigned char before[REGISTERS]; memcpy(before, registers, REGISTERS);)
 
-	if((MEM_SIZE-ROMSTART_OFFSET) > romSize) {								//ROM goes into system memory from location 0x200 (512). We don't want to do
-		for(int i = 0; i < romSize; i++) {
-			mem[i+ROMSTART_OFFSET] = buffer[i];
+	op.handler(*this, op);	//Execute!
+
+	TRACE(if(tracer != NULL) trace(at, op.opcode, before);)
+	cycles++;
+}
+
+//Ahead-of-time compiled code if there is some for here, otherwise the JIT
+inline unsigned long emu::runNative(long budget)
+{
+	TRACE(if(tracer != NULL) return 0;)		//Every instruction has to come through interpret() to be traced
+	if(aot != NULL)
+	{
+		unsigned long executed = aot->run(*this, budget);
+		if(executed > 0) {
+			return executed;
 		}
 	}
-	else {
-		printf("ROM too large for memory!");
+	return jit != NULL ? jit->run(budget) : 0;
+}
+
+void emu::emuCycle()
+{
+	runTarget = cycles + 1;				//Just the one, so the idle loop checks have nothing to skip
+	idle = notIdle;
+
+	//With the JIT on (or a compiled ROM), compiled code gets the first go, with a budget of one. Only a block that's a single
+	//instruction fits in that, so most of the time it's the interpreter below that runs this one opcode.
+	if(jit != NULL || aot != NULL)
+	{
+		unsigned long executed = runNative(1);
+		if(executed > 0)
+		{
+			cycles += executed;
+			PROFILE(profile->jitInstructions += executed;)
+			return;
+		}
 	}
 
-	//Okay, we're done with the file now. It should be in program memory and emulated system memory at this point. Let's clean up
-	//and close the file and free the buffer. And return true at the end, since everything should've been successful
-	fclose(pFile);
-	free(buffer);
+	interpret();
+}
 
-	return true;
+//The same as calling emuCycle() until we get there, minus the overhead of calling it every time
+void emu::runUntilCycle(unsigned long long target)
+{
+	runTarget = target;
+	idle = notIdle;
+
+	if(jit != NULL || aot != NULL)
+	{
+		//Hand the JIT everything that's left in one go, so it can chain from block to block without coming back out here
+		while(cycles < target)
+		{
+			unsigned long long left = target - cycles;
+			unsigned long executed = runNative(left < 0x40000000ULL ? (long)left : 0x40000000L);
+			if(executed > 0)
+			{
+				cycles += executed;
+				PROFILE(profile->jitInstructions += executed;)
+			}
+			else
+			{
+				interpret();
+			}
+		}
+		return;
+	}
 
+	//Four at a time while there's room, so the loop check only happens a quarter as often. An idle loop skipping ahead partway through
+	//a group of four still has the rest of the group to run, so while we're doing fours it mustn't skip any closer than three short.
+	runTarget = target - 3;
+	while(cycles + 4 <= target)
+	{
+		interpret();
+		interpret();
+		interpret();
+		interpret();
+	}
+	runTarget = target;
+	while(cycles < target)
+	{
+		interpret();
+	}
 }
 
-//Moment of truth. The system is initialized. The file is loaded and in the emulated system's memory. Now we fetch, decode, and execute.
-//Exciting!
+//One call for what would otherwise be hundreds of emuCycle()s. The loop runs until runTarget, and anything that should end the run
+//early just pulls runTarget in to right after the instruction that's running now.
+emu::stopReason emu::run(unsigned long long budget)
+{
+	runTarget = cycles + budget;
+	idle = notIdle;
+	stopEarly = true;
+	stopped = stopBudget;
 
-void emu::emuCycle()
+	while(cycles < runTarget)
+	{
+		unsigned long executed = 0;
+		if(jit != NULL || aot != NULL)
+		{
+			unsigned long long left = runTarget - cycles;
+			executed = runNative(left < 0x40000000ULL ? (long)left : 0x40000000L);	//Compiled code never draws or posts anything
+		}
+		if(executed > 0)
+		{
+			cycles += executed;
+			PROFILE(profile->jitInstructions += executed;)
+		}
+		else
+		{
+			interpret();
+		}
+	}
+	stopEarly = false;
+
+	if(stopped == stopBudget && idle == idleKey) {
+		return stopKeyWait;
+	}
+	if(stopped == stopBudget && idle == idleHalted) {
+		return stopHalted;
+	}
+	return stopped;
+}
+
+//Ends run() once the instruction that's running now is done. Outside of run() it does nothing: emuCycle() stops there anyway, and
+//runUntilCycle() carries on regardless.
+inline void emu::stopAfterThis(stopReason why)
+{
+	if(stopEarly && stopped == stopBudget)
+	{
+		stopped = why;
+		runTarget = cycles + 1;			//interpret() counts the one that's running now
+	}
+}
+
+inline void emu::drew()
+{
+	drawFlag = true;
+	stopAfterThis(stopDraw);
+}
+
+//For opcodes that will run again and again, changing nothing, until the run is over: count them all as done, right up to runTarget
+void emu::skipIdle(idleState why)
+{
+	idle = why;
+	TRACE(if(tracer != NULL) return;)	//A trace wants every trip round, just like a reference emulator would run them
+	PROFILE(return;)					//So does a profile, or byPc and keyWaits would miss everything skipped
+	if(runTarget > cycles + 1)
+	{
+		cycles = runTarget - 1;			//interpret() counts the one that's running now
+	}
+}
+
+//The timers run at 60hz no matter how fast the CPU goes, so they aren't touched by emuCycle() at all. Whoever is driving the emulator
+//calls this 60 times a second (see scheduler.h), however many instructions it decided to run in between.
+void emu::tickTimers()
+{
+	//UPDATE TIMERS
+	if(delayTimer > 0)
+	{
+		--delayTimer;
+		PROFILE(if(delayTimer == 0) profile->delayExpired++;)
+	}
+
+	if(soundTimer > 0)
+	{
+		if(--soundTimer == 0)
+		{
+			PROFILE(profile->soundExpired++;)
+			post(eventSoundOff, 0);
+		}
+	}
+}
+
+//Diagnostics and sound used to be printf()s right here on the emulator thread. Now they're an event in a ring that some other thread
+//empties (see events.h), so a ROM stuck on a bad opcode costs a few stores per instruction instead of a line of terminal output.
+void emu::post(emuEventKind kind, unsigned short opcode)
+{
+	if(events != NULL)
+	{
+		emuEvent event = { cycles, pc, opcode, kind };
+		events->push(event);
+	}
+	stopAfterThis(kind == eventSoundOn || kind == eventSoundOff ? stopSound : stopError);
+}
+
+void emu::setPlatform(emuPlatform p)
 {
-	//Remember the first step? Fetching the opcode!
+	platform = p;
+
+	//Everything decoded or compiled so far went to the old platform's handlers
+	memset(decoded, 0, sizeof(decoded));
+	fusedLow = 0x0FFF;
+	fusedHigh = 0;
+	if(jit != NULL) {
+		jit->flush();
+	}
+	attachAot();						//Compiled code is for one platform only
+}
+
+//The platform only changes which handlers get picked, so it's decided here, once per address, and never again while it runs
+void emu::decode(unsigned short address)
+{
+	switch(platform)
+	{
+		case(platformChip8):  decodeFor<quirksChip8>(address); break;
+		case(platformSchip):  decodeFor<quirksSchip>(address); break;
+		case(platformXochip): decodeFor<quirksXochip>(address); break;
+		default:              decodeFor<quirksDefault>(address);
+	}
+}
 
-	opcode = mem[pc] << 8 | mem[pc+1]; 	//What happened here? Recall that an opcode is two bytes long, but each element of our memory array
+template<class quirks> void emu::decodeFor(unsigned short address)
+{
+	unsigned short opcode = mem[address] << 8 | mem[(address + 1) & 0x0FFF];
+										//What happened here? Recall that an opcode is two bytes long, but each element of our memory array
 										//is only one byte long. We need both bytes to know what the opcode is. So we get the first byte at
 										//location indicated by our program counter (pc), and we shift the bits 8 bits to the left. Meaning,
 										//if what we got was 0x00FF (0000 0000 1111 1111), we now have 0xFF00 (1111 1111 0000 0000). Then, we
@@ -171,365 +550,991 @@ void emu::emuCycle()
 	 * you'll notice that 3 instructions will fit that criteria. Not a problem, we'll just do another switch test that will identify any one
 	 * of these 3 instructions. Another example? ANNN sets the index register to the address NNN. 0xANNN AND 0xF000 will give you 0xA000, so
 	 * now you know which instruction it is! Since this is an interpreter, this is basically going to be our pattern. Test for a certain case
-	 * and, if it's satisfied, execute that opcode. Fetch, decode, execute!*/
+	 * and, if it's satisfied, remember which handler executes that opcode. The operands get pulled out here too, once, so the handlers
+	 * never have to mask and shift anything themselves.*/
+
+	decodedOp &op = decoded[address];
+	op.opcode = opcode;
+	op.nnn = opcode & 0x0FFF;
+	op.x = (opcode & 0x0F00) >> 8;
+	op.y = (opcode & 0x00F0) >> 4;
+	op.n = opcode & 0x000F;
+	op.nn = opcode & 0x00FF;
+	PROFILE(op.kind = profileClass(opcode);)
 
 	switch(opcode & 0xF000)
 	{
 		case(0x0000):													//Three commands satisfy this test, so we need more tests.
 			switch(opcode & 0x0FFF)
 			{
-				case(0x00E0):
-					//SCREEN CLEAR!
-					pc+= 2;
-					break;
-
-				case(0x00EE):
-					//RETURN FROM SUBROUTINE
-					pc = stack[--sp];
-					pc += 2;
-					break;
-
+				case(0x00E0): op.handler = op00E0; break;
+				case(0x00EE): op.handler = op00EE; break;
+				case(0x00FB): op.handler = quirks::superChip ? op00FB : op0NNN; break;
+				case(0x00FC): op.handler = quirks::superChip ? op00FC : op0NNN; break;
+				case(0x00FD): op.handler = quirks::superChip ? op00FD : op0NNN; break;
+				case(0x00FE): op.handler = quirks::superChip ? op00FE : op0NNN; break;
+				case(0x00FF): op.handler = quirks::superChip ? op00FF : op0NNN; break;
 				default:
-					printf("RUN MACHINE CODE AT ADDRESS 0x0NNN (DEPRECATED\n");
+					if(quirks::superChip && (opcode & 0x0FF0) == 0x00C0) {
+						op.handler = op00CN;
+					} else if(quirks::xoChip && (opcode & 0x0FF0) == 0x00D0) {
+						op.handler = op00DN;
+					} else {
+						op.handler = op0NNN;
+					}
 			}
-		break;
-
-		case(0x1000):
-			//JUMP TO SUBROUTINE AT ADDRESS 0x1NNN
-			pc = opcode & 0x0FFF;
 			break;
 
-		case(0x2000):
-			//CALL SUBROUTINE AT ADDRESS 0x2NNN
-			stack[sp++] = pc;
-			pc = opcode & 0x0FFF;
+		case(0x1000): op.handler = op1NNN; break;
+		case(0x2000): op.handler = op2NNN; break;
+		case(0x3000): op.handler = op3XNN; break;
+		case(0x4000): op.handler = op4XNN; break;
+		case(0x5000): op.handler = op5XY0; break;
+		case(0x6000): op.handler = op6XNN; break;
+		case(0x7000): op.handler = op7XNN; break;
+
+		case(0x8000):													//Several instructions satisfy this test, so we need another
+			switch(opcode & 0x000F)										//It's only the last hex digit that changes between them, so this
+			{															//test covers them.
+				case(0x0000): op.handler = op8XY0; break;
+				case(0x0001): op.handler = op8XY1<quirks>; break;
+				case(0x0002): op.handler = op8XY2<quirks>; break;
+				case(0x0003): op.handler = op8XY3<quirks>; break;
+				case(0x0004): op.handler = op8XY4; break;
+				case(0x0005): op.handler = op8XY5; break;
+				case(0x0006): op.handler = op8XY6<quirks>; break;
+				case(0x0007): op.handler = op8XY7; break;
+				case(0x000E): op.handler = op8XYE<quirks>; break;
+				default:      op.handler = opUnknown;
+			}
 			break;
 
-		case(0x3000):
-			//SKIP THE NEXT INSTRUCTION IF VX EQUALS NN (0x3XNN)
-			if(registers[(opcode & 0x0F00) >> 8] == (opcode & 0x00FF)) {
-				pc += 4;
-			} else {
-				pc += 2;
+		case(0x9000): op.handler = op9XY0; break;
+		case(0xA000): op.handler = opANNN; break;
+		case(0xB000): op.handler = opBNNN<quirks>; break;
+		case(0xC000): op.handler = opCXNN; break;
+		case(0xD000): op.handler = opDXYN<quirks>; break;
+
+		case(0xE000):
+			switch(opcode & 0x00FF)
+			{
+				case(0x009E): op.handler = opEX9E; break;
+				case(0x00A1): op.handler = opEXA1; break;
+				default:      op.handler = opBad;
 			}
 			break;
 
-		case(0x4000):
-			//SKIP THE NEXT INSTRUCTION IF VX DOES NOT EQUAL NN (0x4XNN)
-			if(registers[(opcode & 0x0F00) >> 8] != (opcode & 0x00FF)) {
-				pc += 4;
-			} else {
-				pc += 2;
+		case(0xF000):
+			switch(opcode & 0x00FF)
+			{
+				case(0x0007): op.handler = opFX07; break;
+				case(0x000A): op.handler = opFX0A; break;
+				case(0x0015): op.handler = opFX15; break;
+				case(0x0018): op.handler = opFX18; break;
+				case(0x001E): op.handler = opFX1E; break;
+				case(0x0029): op.handler = opFX29; break;
+				case(0x0030): op.handler = quirks::superChip ? opFX30 : opUnknown; break;
+				case(0x0001): op.handler = quirks::xoChip ? opFN01 : opUnknown; break;
+				case(0x0033): op.handler = opFX33; break;
+				case(0x0055): op.handler = opFX55<quirks>; break;
+				case(0x0065): op.handler = opFX65<quirks>; break;
+				default:      op.handler = opUnknown;
 			}
 			break;
+	}
 
-		case(0x5000):
-			//SKIP THE NEXT INSTRUCTION IF VX = VY (0x5XY0)
-			if(registers[(opcode & 0x0F00) >> 8] == registers[(opcode & 0x00F0) >> 4]){
-				pc += 4;
-			} else {
-				pc += 2;
+#ifndef CHIP8_PROFILE
+	fuse<quirks>(address);				//A profile counts every opcode on its own, so it only ever sees the plain handlers
+#endif
+}
+
+/*Superinstructions. A handful of short runs of opcodes turn up over and over in real ROMs: ANNN straight before the DXYN that draws
+ *the sprite it points at, two 6XNNs loading a pair of coordinates, and 7XNN/3XNN/1NNN counting a register up to some value. When the
+ *opcode we just decoded starts one of those, its entry gets a handler that does the whole run in one call, with the later opcodes'
+ *operands packed into the fields the first one doesn't need. That's one trip through interpret() where there would have been two or
+ *three.
+ *
+ *The result has to be exactly what running them one by one would give, right down to where a run stops. So a superinstruction only
+ *carries on past its first opcode while that still fits before runTarget, and it counts whatever extra it ran into cycles itself.
+ *emuCycle() sets runTarget one ahead, so single-stepping still goes one opcode at a time.
+ *
+ *The FX07/3X00/1NNN timer wait isn't here, because opFX07 already skips every trip round it up to runTarget in one go (except in a
+ *profiling build, which runs them all so they get counted, just as it leaves out superinstructions).
+ *
+ *A superinstruction reads up to six bytes, so forget() throws away anything decoded from the five bytes before a write too. Only
+ *near where some superinstruction starts, though, so writes to plain data cost no more than they did.*/
+template<class quirks> void emu::fuse(unsigned short address)
+{
+	if(address > 0x0FFA) {
+		return;							//The rest of it would wrap round past the end of memory
+	}
+	TRACE(if(tracer != NULL) return;)
+
+	decodedOp &op = decoded[address];
+	unsigned short second = mem[address + 2] << 8 | mem[address + 3];
+	unsigned short third = mem[address + 4] << 8 | mem[address + 5];
+	void (*plain)(emu &chip, const decodedOp &op) = op.handler;
+
+	switch(op.opcode & 0xF000)
+	{
+		case(0xA000):
+			if((second & 0xF000) == 0xD000)
+			{
+				op.x = (second & 0x0F00) >> 8;		//ANNN only needs nnn, so DXYN's operands go where they'd normally be
+				op.y = (second & 0x00F0) >> 4;
+				op.n = second & 0x000F;
+				op.handler = opANNN_DXYN<quirks>;
 			}
 			break;
 
 		case(0x6000):
-			//SET VX TO NN (0x6XNN)
-			registers[(opcode & 0x0F00) >> 8] = (opcode & 0x00FF);
-			pc += 2;
+			if((second & 0xF000) == 0x6000)
+			{
+				op.y = (second & 0x0F00) >> 8;		//The second register and the value it gets
+				op.n = second & 0x00FF;
+				op.handler = op6XNN_6YNN;
+			}
 			break;
 
 		case(0x7000):
-			//ADD NN TO VX WITHOUT SETTING CARRY FLAG (0x7XNN)
-			registers[(opcode & 0x0F00) >> 8] += (opcode & 0x00FF);
-			pc += 2;
+			//Only when the skip tests the register we just added to, and the jump goes somewhere other than itself (a jump to itself
+			//is a halt, which op1NNN deals with)
+			if((second & 0xFF00) == (0x3000 | op.x << 8) && (third & 0xF000) == 0x1000 && (third & 0x0FFF) != address + 4)
+			{
+				op.y = op.nn;						//How much gets added
+				op.nn = second & 0x00FF;			//What it's compared with
+				op.nnn = third & 0x0FFF;			//Where the jump goes
+				op.handler = op7XNN_3XNN_1NNN;
+			}
 			break;
+	}
 
-		case(0x8000):													//Several instructions satisfy this test, so we need another
-			switch(opcode & 0x000F)										//It's only the last hex digit that changes between them, so this
-			{
-				case(0x0000): //0x8000...								//test covers them.
-					//SET VX to VY (0x8XY0)
-					registers[(opcode & 0x0F00) >> 8] = registers[(opcode & 0x00F0) >> 4];
-					pc += 2;
-					break;
-
-				case(0x0001): //0x8001...and so on
-					//SET VX to VX|=VY (0x8XY1)
-					registers[(opcode & 0x0F00) >> 8] |= registers[(opcode & 0x00F0) >> 4];
-					pc += 2;
-					break;
-
-				case(0x0002):
-					//SET VX to VX&=VY
-					registers[(opcode & 0x0F00) >> 8] &= registers[(opcode & 0x00F0) >> 4];
-					pc += 2;
-					break;
-
-				case(0x0003):
-					//SET VX to VX^=VY
-					registers[(opcode & 0x0F00) >> 8] ^= registers[(opcode & 0x00F0) >> 4];
-					pc += 2;
-					break;
-
-				case(0x0004):
-					//ADD VY TO VX (0x8XY4). SET CARRY FLAG IF REQUIRED
-					if(registers[(opcode & 0x00F0) >> 4] > (0xFF - registers[opcode & 0x0F00])){
-						registers[0xF] = 1;
-					} else {
-						registers[0xF] = 0;
-					}
-					registers[(opcode & 0x0F00) >> 8] += registers[(opcode & 0x00F0) >> 4];
-					pc += 2;
-					break;
-
-				case(0x0005):
-					//SUBTRACT VY FROM VX. UNSET CARRY FLAG IF REQUIRED
-					if(registers[(opcode & 0x00F0) >> 4] > registers[(opcode & 0x0F00) >> 8]) {
-						registers[0xF] = 0;
-					} else {
-						registers[0xF] = 1;
-					}
-					registers[(opcode & 0x0F00) >> 8] -= registers[(opcode & 0x00F0)];
-					pc += 2;
-					break;
-
-				case(0x0006):
-					//STORE LEAST SIGNIFICANT BIT OF VX IN VF, THEN SHIFT VX >> 1
-					registers[0xF] = registers[(opcode & 0x0F00) >> 8] & 0x1;
-					registers[(opcode & 0x0F00) >> 8] >>= 1;
-					pc+=2;
-					break;
-
-				case(0x0007):
-					//SUBTRACT VX FROM VY AND STORE RESULT IN VX. VF CLEARED IF THERE'S A BORROW, SET IF NOT
-					if(registers[(opcode & 0x0F00) >> 8] > registers[(opcode & 0x00F0) >> 4]) {
-						registers[0xF] = 0;
-					} else {
-						registers[0xF] = 1;
-					}
+	if(op.handler != plain)
+	{
+		fusedLow = address < fusedLow ? address : fusedLow;
+		fusedHigh = address > fusedHigh ? address : fusedHigh;
+	}
+}
 
-					registers[(opcode & 0x0F00) >> 8] = registers[(opcode & 0x00F0) >> 4] - registers[(opcode & 0x0F00) >> 4];
-					pc += 2;
-					break;
+//Every write into emulated memory comes through here. If the program overwrites its own code, whatever we decoded at that address
+//(or at the address just before it, since opcodes are two bytes long) is now wrong, so we throw it away and decode it again later.
+void emu::writeMem(unsigned short address, unsigned char value)
+{
+	address &= 0x0FFF;
+	mem[address] = value;
+	forget(address);
+}
 
-				case(0x000E):
-					//STORE THE MOST SIGNIFICANT BIT OF VX in VF, THEN SHIFT VX << 1
-					registers[0xF] = registers[(opcode & 0x0F00) >> 8] >> 7;
-					registers[(opcode & 0x0F00) >> 8] <<= 1;
-					pc += 2;
-					break;
+//A byte of memory changed, so anything we decoded or compiled from it is stale. It's part of the opcode at its own address and of the
+//one starting the byte before, and a superinstruction (see fuse()) starting up to five bytes before reads it too.
+void emu::forget(unsigned short address)
+{
+	dirtyPages |= 1 << (address >> 8);
+	decoded[address].handler = NULL;
+	decoded[(address - 1) & 0x0FFF].handler = NULL;
+	if(address >= fusedLow && address <= fusedHigh + 5)
+	{
+		for(int start = address - 2; start >= address - 5 && start >= 0; start--) {
+			decoded[start].handler = NULL;
+		}
+	}
+	if(jit != NULL) {
+		jit->invalidate(address);
+	}
+	if(aot != NULL && aot->isCode[address]) {
+		aot = NULL;						//The program just rewrote code that was compiled ahead of time. Interpret it from now on.
+	}
+}
 
-				default:
-					printf("UNIMPLEMENTED OPCODE: %0.4X\n", opcode);
-				}
-				break;
+//The decode cache and the JIT aren't part of the state, they're just derived from memory. Going back to a snapshot of the same game
+//usually changes only a handful of bytes of memory (if any), so rather than throw the whole cache away we find just the bytes that
+//differ, eight at a time, and forget those. `length` has to be a multiple of eight.
+bool emu::loadMem(unsigned short start, const unsigned char *bytes, size_t length)
+{
+	if(memcmp(mem + start, bytes, length) == 0) {
+		return false;
+	}
+
+	for(size_t i = 0; i < length; i += 8)
+	{
+		uint64_t now, then;
+		memcpy(&now, mem + start + i, 8);
+		memcpy(&then, bytes + i, 8);
+		if(now == then) {
+			continue;
+		}
+
+		for(size_t j = i; j < i + 8; j++)
+		{
+			if(mem[start + j] != bytes[j]) {
+				forget((unsigned short)(start + j));
+			}
+		}
+	}
+	memcpy(mem + start, bytes, length);
+	return true;
+}
 
-		case(0x9000):
-			//SKIPS NEXT INSTRUCTION IF VX != VY
-			if(registers[(opcode & 0x0F00) >> 8] != registers[(opcode & 0x00F0) >> 4]) {
-				pc += 4;
+#ifdef CHIP8_TRACE
+void emu::trace(unsigned short at, unsigned short opcode, const unsigned char *before)
+{
+	traceRecord record;
+	record.cycle = cycles;				//interpret() hasn't counted this one yet, so that's its own number
+	record.pc = at;
+	record.opcode = opcode;
+	record.index = index;
+	record.reg = TRACE_NO_REGISTER;
+	record.value = 0;
+
+	//VF only gets a mention if it's the only one that changed. Otherwise it's just the flag from an 8XYN.
+	for(int i = 0; i < REGISTERS - 1 && record.reg == TRACE_NO_REGISTER; i++) {
+		if(registers[i] != before[i]) {
+			record.reg = (uint8_t)i;
+		}
+	}
+	if(record.reg == TRACE_NO_REGISTER && registers[0xF] != before[0xF]) {
+		record.reg = 0xF;
+	}
+	if(record.reg != TRACE_NO_REGISTER) {
+		record.value = registers[record.reg];
+	}
+	tracer->record(record);
+}
+#endif
+
+/*Save states. emuState holds the whole machine in one block, so saving is just copying that block out.*/
+
+void emu::saveState(emuState &state) const
+{
+	memcpy(&state, static_cast<const emuState *>(this), sizeof(emuState));
+}
+
+void emu::restoreState(const emuState &state)
+{
+	loadMem(0, state.mem, MEM_SIZE);
+	memcpy(static_cast<emuState *>(this), &state, sizeof(emuState));
+	drawFlag = true;			//The screen is probably different now
+	if(aotWanted) {
+		attachAot();			//Memory might be back the way the compiled code expects, or might not be any more
+	}
+}
+
+/*And here are the handlers themselves, one per opcode. Each one does exactly what the big switch statement used to do, just with the
+ *operands already pulled out for it.*/
+
+void emu::op00E0(emu &chip, const decodedOp &op)
+{
+	//SCREEN CLEAR! Only the planes FN01 picked, which is just the first one unless it's an XO-CHIP ROM.
+	for(int plane = 0; plane < 2; plane++) {
+		if(chip.planes & (1 << plane)) {
+			memset(chip.graphics[plane], 0, sizeof(chip.graphics[plane]));
+		}
+	}
+	chip.drew();
+	chip.pc += 2;
+}
+
+/*SUPER-CHIP and XO-CHIP's scrolling. They move the selected planes by a number of pixels at the current resolution. Up and down move
+ *whole rows, which is a memmove. Left and right are four pixels at a time, which is a shift of every word, carrying across from one
+ *half of the row into the other in high resolution.*/
+
+void emu::op00CN(emu &chip, const decodedOp &op)
+{
+	//00CN SCROLL DOWN N ROWS
+	int height = chip.getHeight();
+	for(int plane = 0; plane < 2; plane++) {
+		if(chip.planes & (1 << plane)) {
+			memmove(chip.graphics[plane][op.n], chip.graphics[plane][0], (height - op.n) * sizeof(chip.graphics[plane][0]));
+			memset(chip.graphics[plane][0], 0, op.n * sizeof(chip.graphics[plane][0]));
+		}
+	}
+	chip.drew();
+	chip.pc += 2;
+}
+
+void emu::op00DN(emu &chip, const decodedOp &op)
+{
+	//00DN SCROLL UP N ROWS (XO-CHIP)
+	int height = chip.getHeight();
+	for(int plane = 0; plane < 2; plane++) {
+		if(chip.planes & (1 << plane)) {
+			memmove(chip.graphics[plane][0], chip.graphics[plane][op.n], (height - op.n) * sizeof(chip.graphics[plane][0]));
+			memset(chip.graphics[plane][height - op.n], 0, op.n * sizeof(chip.graphics[plane][0]));
+		}
+	}
+	chip.drew();
+	chip.pc += 2;
+}
+
+void emu::op00FB(emu &chip, const decodedOp &op)
+{
+	//00FB SCROLL RIGHT 4 PIXELS
+	int height = chip.getHeight();
+	for(int plane = 0; plane < 2; plane++) {
+		if(!(chip.planes & (1 << plane))) {
+			continue;
+		}
+		for(int y = 0; y < height; y++) {
+			uint64_t *row = chip.graphics[plane][y];
+			if(chip.hires) {
+				row[1] = (row[1] >> 4) | (row[0] << 60);
+			}
+			row[0] >>= 4;
+		}
+	}
+	chip.drew();
+	chip.pc += 2;
+}
+
+void emu::op00FC(emu &chip, const decodedOp &op)
+{
+	//00FC SCROLL LEFT 4 PIXELS
+	int height = chip.getHeight();
+	for(int plane = 0; plane < 2; plane++) {
+		if(!(chip.planes & (1 << plane))) {
+			continue;
+		}
+		for(int y = 0; y < height; y++) {
+			uint64_t *row = chip.graphics[plane][y];
+			if(chip.hires) {
+				row[0] = (row[0] << 4) | (row[1] >> 60);
+				row[1] <<= 4;
 			} else {
-				pc += 2;
+				row[0] <<= 4;
 			}
-			break;
+		}
+	}
+	chip.drew();
+	chip.pc += 2;
+}
 
-		case(0xA000):
-			//SETS I TO ADDRESS NNN
-			index = opcode & 0x0FFF;
-			pc += 2;
-			break;
+void emu::op00FD(emu &chip, const decodedOp &op)
+{
+	//00FD EXIT THE INTERPRETER. There's nothing to exit to, so stop right here, the same as a jump to itself.
+	chip.skipIdle(idleHalted);
+}
 
-		case(0xB000):
-			//JUMP TO THE ADDRESS NNN PLUS V0
-			pc = (opcode & 0x0FFF) + registers[0];
-			break;
+void emu::op00FE(emu &chip, const decodedOp &op)
+{
+	//00FE LOW RESOLUTION (64x32). Switching either way clears the screen, since the old picture doesn't fit the new grid.
+	chip.hires = 0;
+	memset(chip.graphics, 0, sizeof(chip.graphics));
+	chip.drew();
+	chip.pc += 2;
+}
 
-		case(0xC000):
-			//SET VX to "rand() & NN"
-			registers[(opcode & 0x0F00) >> 8] = (rand()%0xFF) & (opcode & 0x00FF);
-			pc += 2;
-			break;
+void emu::op00FF(emu &chip, const decodedOp &op)
+{
+	//00FF HIGH RESOLUTION (128x64)
+	chip.hires = 1;
+	memset(chip.graphics, 0, sizeof(chip.graphics));
+	chip.drew();
+	chip.pc += 2;
+}
+
+void emu::op00EE(emu &chip, const decodedOp &op)
+{
+	//RETURN FROM SUBROUTINE
+	if(chip.sp == 0)
+	{
+		chip.post(eventStackUnderflow, op.opcode);		//Nowhere to go back to. Stay put rather than read off the front of the stack.
+		return;
+	}
+	chip.pc = chip.stack[--chip.sp];
+	chip.pc += 2;
+}
+
+void emu::op0NNN(emu &chip, const decodedOp &op)
+{
+	chip.post(eventMachineCode, op.opcode);				//RUN MACHINE CODE AT ADDRESS 0x0NNN (DEPRECATED)
+}
+
+void emu::op1NNN(emu &chip, const decodedOp &op)
+{
+	//JUMP TO SUBROUTINE AT ADDRESS 0x1NNN
+	if(op.nnn == chip.pc)
+	{
+		chip.skipIdle(idleHalted);		//Jumping to itself is how a lot of ROMs stop for good
+	}
+	chip.pc = op.nnn;
+}
+
+void emu::op2NNN(emu &chip, const decodedOp &op)
+{
+	//CALL SUBROUTINE AT ADDRESS 0x2NNN
+	if(chip.sp >= 16)
+	{
+		chip.post(eventStackOverflow, op.opcode);		//No room to remember where we were. Stay put rather than write past the stack.
+		return;
+	}
+	chip.stack[chip.sp++] = chip.pc;
+	chip.pc = op.nnn;
+}
+
+void emu::op3XNN(emu &chip, const decodedOp &op)
+{
+	//SKIP THE NEXT INSTRUCTION IF VX EQUALS NN (0x3XNN)
+	if(chip.registers[op.x] == op.nn) {
+		chip.pc += 4;
+	} else {
+		chip.pc += 2;
+	}
+}
+
+void emu::op4XNN(emu &chip, const decodedOp &op)
+{
+	//SKIP THE NEXT INSTRUCTION IF VX DOES NOT EQUAL NN (0x4XNN)
+	if(chip.registers[op.x] != op.nn) {
+		chip.pc += 4;
+	} else {
+		chip.pc += 2;
+	}
+}
+
+void emu::op5XY0(emu &chip, const decodedOp &op)
+{
+	//SKIP THE NEXT INSTRUCTION IF VX = VY (0x5XY0)
+	if(chip.registers[op.x] == chip.registers[op.y]) {
+		chip.pc += 4;
+	} else {
+		chip.pc += 2;
+	}
+}
+
+void emu::op6XNN(emu &chip, const decodedOp &op)
+{
+	//SET VX TO NN (0x6XNN)
+	chip.registers[op.x] = op.nn;
+	chip.pc += 2;
+}
+
+void emu::op7XNN(emu &chip, const decodedOp &op)
+{
+	//ADD NN TO VX WITHOUT SETTING CARRY FLAG (0x7XNN)
+	chip.registers[op.x] += op.nn;
+	chip.pc += 2;
+}
+
+void emu::op8XY0(emu &chip, const decodedOp &op)
+{
+	//SET VX to VY (0x8XY0)
+	chip.registers[op.x] = chip.registers[op.y];
+	chip.pc += 2;
+}
+
+template<class quirks> void emu::op8XY1(emu &chip, const decodedOp &op)
+{
+	//SET VX to VX|=VY (0x8XY1)
+	chip.registers[op.x] |= chip.registers[op.y];
+	if(quirks::vfReset) {
+		chip.registers[0xF] = 0;		//The VIP did these in its ALU routine, which left VF cleared afterwards
+	}
+	chip.pc += 2;
+}
 
-		case(0xD000):
-			//DXYN. DRAW INSTRUCTIONS. A DOOZY. DO IT LATER.
+template<class quirks> void emu::op8XY2(emu &chip, const decodedOp &op)
+{
+	//SET VX to VX&=VY
+	chip.registers[op.x] &= chip.registers[op.y];
+	if(quirks::vfReset) {
+		chip.registers[0xF] = 0;
+	}
+	chip.pc += 2;
+}
+
+template<class quirks> void emu::op8XY3(emu &chip, const decodedOp &op)
+{
+	//SET VX to VX^=VY
+	chip.registers[op.x] ^= chip.registers[op.y];
+	if(quirks::vfReset) {
+		chip.registers[0xF] = 0;
+	}
+	chip.pc += 2;
+}
+
+//The arithmetic opcodes work out the flag first and write VF last, so that the flag still wins when X or Y happens to be F.
+
+void emu::op8XY4(emu &chip, const decodedOp &op)
+{
+	//ADD VY TO VX (0x8XY4). SET CARRY FLAG IF REQUIRED
+	unsigned char carry = (chip.registers[op.y] > (0xFF - chip.registers[op.x])) ? 1 : 0;
+	chip.registers[op.x] += chip.registers[op.y];
+	chip.registers[0xF] = carry;
+	chip.pc += 2;
+}
+
+void emu::op8XY5(emu &chip, const decodedOp &op)
+{
+	//SUBTRACT VY FROM VX. UNSET CARRY FLAG IF REQUIRED
+	unsigned char noBorrow = (chip.registers[op.y] > chip.registers[op.x]) ? 0 : 1;
+	chip.registers[op.x] -= chip.registers[op.y];
+	chip.registers[0xF] = noBorrow;
+	chip.pc += 2;
+}
+
+template<class quirks> void emu::op8XY6(emu &chip, const decodedOp &op)
+{
+	//STORE LEAST SIGNIFICANT BIT OF VX IN VF, THEN SHIFT VX >> 1 (OR VY INTO VX, ON PLATFORMS THAT SHIFT VY)
+	unsigned char source = chip.registers[quirks::shiftVy ? op.y : op.x];
+	chip.registers[op.x] = source >> 1;
+	chip.registers[0xF] = source & 0x1;
+	chip.pc += 2;
+}
+
+void emu::op8XY7(emu &chip, const decodedOp &op)
+{
+	//SUBTRACT VX FROM VY AND STORE RESULT IN VX. VF CLEARED IF THERE'S A BORROW, SET IF NOT
+	unsigned char noBorrow = (chip.registers[op.x] > chip.registers[op.y]) ? 0 : 1;
+	chip.registers[op.x] = chip.registers[op.y] - chip.registers[op.x];
+	chip.registers[0xF] = noBorrow;
+	chip.pc += 2;
+}
+
+template<class quirks> void emu::op8XYE(emu &chip, const decodedOp &op)
+{
+	//STORE THE MOST SIGNIFICANT BIT OF VX in VF, THEN SHIFT VX << 1 (OR VY INTO VX, ON PLATFORMS THAT SHIFT VY)
+	unsigned char source = chip.registers[quirks::shiftVy ? op.y : op.x];
+	chip.registers[op.x] = source << 1;
+	chip.registers[0xF] = source >> 7;
+	chip.pc += 2;
+}
+
+void emu::op9XY0(emu &chip, const decodedOp &op)
+{
+	//SKIPS NEXT INSTRUCTION IF VX != VY
+	if(chip.registers[op.x] != chip.registers[op.y]) {
+		chip.pc += 4;
+	} else {
+		chip.pc += 2;
+	}
+}
+
+void emu::opANNN(emu &chip, const decodedOp &op)
+{
+	//SETS I TO ADDRESS NNN
+	chip.index = op.nnn;
+	chip.pc += 2;
+}
+
+template<class quirks> void emu::opBNNN(emu &chip, const decodedOp &op)
+{
+	//JUMP TO THE ADDRESS NNN PLUS V0. SUPER-CHIP READS IT AS XNN PLUS VX, WHICH IS THE SAME ADDRESS WITH A DIFFERENT REGISTER.
+	chip.pc = op.nnn + chip.registers[quirks::jumpVx ? op.x : 0];
+}
+
+void emu::opCXNN(emu &chip, const decodedOp &op)
+{
+	//SET VX to "rand() & NN"
+	chip.registers[op.x] = chip.randomByte() & op.nn;
+	chip.pc += 2;
+}
+
+template<class quirks> void emu::opDXYN(emu &chip, const decodedOp &op)
+{
+	//DXYN. DRAW AN 8 PIXEL WIDE, N PIXEL TALL SPRITE FROM MEMORY AT I, AT (VX, VY). VF IS SET IF ANY PIXEL GETS TURNED OFF.
+	//Every row of the screen is one 64-bit word, so we line the sprite's byte up with column x by parking it in the top 8 bits
+	//and rotating it right by x. Rotating (rather than shifting) wraps whatever falls off the right edge round to the left.
+	//Rows that run off the bottom wrap back round to the top.
+	//Platforms that clip sprites just shift instead, so what falls off the right is gone, and stop at the bottom row. Either way the
+	//starting position itself always wraps onto the screen.
+	//That's the plain 64x32 one-plane case, which is nearly every draw there is. High resolution, 16x16 sprites and drawing on
+	//XO-CHIP's second plane go the long way round in drawSprite().
+	if(chip.hires || chip.planes != 1 || (quirks::superChip && op.n == 0))
+	{
+		drawSprite<quirks>(chip, op);
+		return;
+	}
+
+	unsigned int x = chip.registers[op.x] % SCREEN_WIDTH;
+	unsigned int y = chip.registers[op.y] % SCREEN_HEIGHT;
+	unsigned int height = op.n;
+	uint64_t collision = 0;
+
+	if(quirks::clipSprites && y + height > SCREEN_HEIGHT) {
+		height = SCREEN_HEIGHT - y;
+	}
+
+	for(unsigned int yline = 0; yline < height; yline++)
+	{
+		uint64_t sprite = (uint64_t)chip.mem[(chip.index + yline) & 0x0FFF] << 56;
+		uint64_t line = quirks::clipSprites ? sprite >> x : (sprite >> x) | (sprite << ((SCREEN_WIDTH - x) % SCREEN_WIDTH));
+		uint64_t &row = chip.graphics[0][(y + yline) % SCREEN_HEIGHT][0];
+
+		collision |= row & line;	//Any pixel that's on in both gets turned off, which is exactly what VF reports
+		row ^= line;
+	}
+
+	chip.registers[0xF] = (collision != 0) ? 1 : 0;
+	PROFILE(chip.profile->draws++; if(collision != 0) chip.profile->collisions++;)
+	chip.drew();
+	chip.pc += 2;
+}
+
+template<class quirks> void emu::drawSprite(emu &chip, const decodedOp &op)
+{
+	//The general DXYN. The screen is 64 or 128 pixels wide, so a row is one or two words; the sprite is 8 pixels wide, or 16 for
+	//SUPER-CHIP's DXY0 (16 rows of two bytes each); and it's drawn once on every plane FN01 picked, each plane taking the next
+	//sprite's worth of bytes from I. Lining the sprite up is the same idea as before, just across two words: park it in the top bits,
+	//shift it right by x, and whatever runs off the right edge either wraps round to x = 0 or is dropped.
+	//VF is 1 if any pixel on any plane got turned off. SUPER-CHIP 1.1 counted colliding rows in high resolution instead; nothing we
+	//know of needs that, and every modern interpreter reports 1.
+	unsigned int width = chip.hires ? 128 : 64;
+	unsigned int height = chip.hires ? 64 : 32;
+	unsigned int x = chip.registers[op.x] % width;
+	unsigned int y = chip.registers[op.y] % height;
+	bool big = quirks::superChip && op.n == 0;
+	unsigned int spriteWidth = big ? 16 : 8;
+	unsigned int rows = big ? 16 : op.n;
+	unsigned short address = chip.index;
+	uint64_t collision = 0;
+
+	for(int plane = 0; plane < 2; plane++)
+	{
+		if(!(chip.planes & (1 << plane))) {
+			continue;
+		}
+
+		for(unsigned int yline = 0; yline < rows; yline++)
+		{
+			uint64_t sprite = chip.mem[address & 0x0FFF];
+			if(big) {
+				sprite = sprite << 8 | chip.mem[(address + 1) & 0x0FFF];
+			}
+			address += big ? 2 : 1;
+
+			unsigned int row = y + yline;
+			if(row >= height)
 			{
-				unsigned short x = registers[(opcode & 0x0F00) >> 8];
-				unsigned short y = registers[(opcode & 0x00F0) >> 4];
-				unsigned short height = opcode & 0x000F;
-				unsigned short pixel;
-
-				registers[0xF] = 0;
-				for(int yline = 0; yline < height; yline++)
-				{
-					pixel = mem[index + yline];
-					for(int xline = 0; xline < 8; xline++)
-					{
-						if((pixel & (0x80 >> xline)) != 0)
-						{
-							if(graphics[(x+xline+((y+yline) * 64))] == 1)
-							{
-								registers[0xF] = 1;
-							}
-							graphics[(x+xline+((y+yline) * 64))] ^= 1;
-						}
-					}
+				if(quirks::clipSprites) {
+					continue;				//Still have to step past its bytes, so the next plane's sprite starts in the right place
 				}
+				row -= height;
 			}
-				drawFlag = true;
-				pc += 2;
-				break;
 
-		case(0xE000):
-			switch(opcode & 0x00FF)
-			{
-				case(0x009E):
-					//EX9E SKIP THE NEXT INSTRUCTION IF KEY IN VX IS PRESSED
-					if(input[registers[(opcode & 0x0F00) >> 8]] != 0)
-					{
-						pc += 4;
-					} else
-					{
-						pc += 2;
-					}
-					break;
-				case(0x00A1):
-					//EXA1 SKIP THE NEXT INSTRUCTION IF THE KEY IN VX ISN'T PRESSED
-					if(input[registers[(opcode & 0x0F00) >> 8]] = 0)
-					{
-						pc += 4;
-					} else
-					{
-						pc += 2;
-					}
-					pc += 2;
-					break;
-				default:
-					printf("Something broke. Bad.\n");
+			uint64_t top = sprite << (64 - spriteWidth);
+			uint64_t left, right = 0;
+			if(x < 64) {
+				left = top >> x;
+				if(x != 0) {
+					right = top << (64 - x);
 				}
-				break;
+			} else {
+				left = 0;
+				right = top >> (x - 64);
+			}
+			if(!chip.hires) {
+				right = 0;					//Off the edge of a 64 pixel screen
+			}
+			if(!quirks::clipSprites && x + spriteWidth > width) {
+				left |= top << (width - x);	//The part that ran off the right, back round at the left
+			}
 
-		case(0xF000):
-			switch(opcode & 0x00FF)
-			{
-				case(0x0007):
-					//FX07 SET VX TO VALUE OF DELAY TIMER
-					registers[(opcode & 0x0F00) >> 8] = delayTimer;
-					pc += 2;
-					break;
-
-				case(0x000A):
-				{
-					//FX0A WAITING FOR A KEY PRESS TO STORE IN VX
-					//INSTRUCTIONS HALTED UNTIL KEY PRESS, SO DO NOT ADVANCE PC UNTIL KEY PRESS EXISTS
-
-					bool keyPress = false;
-
-					for(int i = 0; i < 16; i++)
-					{
-						if(input[i] != 0)
-						{
-							registers[(opcode & 0x0F00) >> 8] = i;		//We need to set the right register to the value of the keypress
-							keyPress = true;							//And then flag that key has been pressed.
-						}
-					}
+			uint64_t *line = chip.graphics[plane][row];
+			collision |= (line[0] & left) | (line[1] & right);
+			line[0] ^= left;
+			line[1] ^= right;
+		}
+	}
 
-					if(!keyPress)										//If after looping through the entire input array no key has been
-					{													//pressed...
-						return;											//...we need to jump back and try again.
-					}
+	chip.registers[0xF] = (collision != 0) ? 1 : 0;
+	PROFILE(chip.profile->draws++; if(collision != 0) chip.profile->collisions++;)
+	chip.drew();
+	chip.pc += 2;
+}
 
-					pc += 2;											//Only after a successful test can we increment the PC
-					break;
-				}
+void emu::opEX9E(emu &chip, const decodedOp &op)
+{
+	//EX9E SKIP THE NEXT INSTRUCTION IF KEY IN VX IS PRESSED
+	if(chip.input[chip.registers[op.x] & 0xF] != 0)
+	{
+		chip.pc += 4;
+	} else
+	{
+		chip.pc += 2;
+	}
+}
 
-				case (0x0015):
-					//FX15 SET DELAY TIMER TO VX
-					delayTimer = registers[(opcode & 0x0F00) >> 8];
-					pc += 2;
-					break;
-
-				case(0x0018):
-					//FX18 SET SOUND TIMER TO VX
-					soundTimer = registers[(opcode & 0x0F00) >> 8];
-					pc += 2;
-					break;
-
-				case(0x001E):
-					//FX1E ADD VX TO I
-					index += registers[(opcode & 0x0F00) >> 8];
-					pc += 2;
-					break;
-
-				case(0x0029):
-					//FX29 SET INDEX TO LOCATION OF SPRITE FOR THE CHARACTER IN VX
-					index = registers[(opcode & 0x0F00) >> 8] * 0x5;
-					pc += 2;
-					break;
-
-				case(0x0033):
-					//FX33 STORE THE BCD REPRESENTATION OF VX IN I
-					mem[index]  = registers[(opcode & 0x0F00) >> 8] / 100;
-					mem[index+1]= (registers[(opcode & 0x0F00) >> 8] / 10) % 10;
-					mem[index+2]= (registers[(opcode & 0x0F00) >> 8] % 100) % 10;
-					pc += 2;
-					break;
-
-				case(0x0055):
-					//FX55 STORE V0 TO VX IN MEMORY STARTING AT ADDRESS AT INDEX
-
-					for(int i = 0; i < registers[(opcode & 0x0F00) >> 8]; i++)
-					{
-						mem[index+i] = registers[i];
-					}
-					pc += 2;
-					break;
+void emu::opEXA1(emu &chip, const decodedOp &op)
+{
+	//EXA1 SKIP THE NEXT INSTRUCTION IF THE KEY IN VX ISN'T PRESSED
+	if(chip.input[chip.registers[op.x] & 0xF] == 0)
+	{
+		chip.pc += 4;
+	} else
+	{
+		chip.pc += 2;
+	}
+}
 
-				case(0x0065):
-					//FX65 COPY MEMORY VALUES STARTING AT INDEX INTO REGISTERS V0 THRU VX
+void emu::opFX07(emu &chip, const decodedOp &op)
+{
+	//FX07 SET VX TO VALUE OF DELAY TIMER
+	chip.registers[op.x] = chip.delayTimer;
+	chip.pc += 2;
+
+	//Is this the top of a "wait for the delay timer" loop? That's FX07, then 3XNN or 4XNN on the same register, then a jump straight
+	//back here, either as the instruction the skip skips (so we go round while it doesn't skip) or the one after (so we go round while
+	//it does). If the timer says go round, every trip is the same three instructions leaving everything exactly as it is now, until
+	//the next tickTimers(). So go round as many times as fit before runTarget all at once.
+	unsigned short next = chip.pc & 0x0FFF;
+	if(next > 0x0FFA)
+	{
+		return;
+	}
+	unsigned short skip = chip.mem[next] << 8 | chip.mem[next + 1];
+	unsigned short loop = 0x1000 | (next - 2);
+	if(((skip & 0xF000) != 0x3000 && (skip & 0xF000) != 0x4000) || ((skip & 0x0F00) >> 8) != op.x)
+	{
+		return;
+	}
 
-					for(int i = 0; i < registers[(opcode & 0x0F00) >> 8]; i++)
-					{
-						registers[i] = mem[index+i];
-					}
-					pc += 2;
-					break;
+	bool equal = chip.delayTimer == (skip & 0x00FF);
+	bool skips = (skip & 0xF000) == 0x3000 ? equal : !equal;
+	unsigned short landsOn = skips ? next + 4 : next + 2;
+	if((chip.mem[landsOn] << 8 | chip.mem[landsOn + 1]) == loop)
+	{
+		chip.idle = idleTimer;
+		TRACE(if(chip.tracer != NULL) return;)
+		PROFILE(return;)
+		if(chip.runTarget > chip.cycles + 1)		//+1 for this FX07, which interpret() is about to count
+		{
+			unsigned long long left = chip.runTarget - (chip.cycles + 1);
+			chip.cycles += left - left % 3;
+		}
+	}
+}
 
-				default:
-					printf("UNIMPLEMENTED OPCODE: %0.4X\n", opcode);
-				}
-				break;
+void emu::opFX0A(emu &chip, const decodedOp &op)
+{
+	//FX0A WAITING FOR A KEY PRESS TO STORE IN VX
+	//INSTRUCTIONS HALTED UNTIL KEY PRESS, SO DO NOT ADVANCE PC UNTIL KEY PRESS EXISTS
+
+	bool keyPress = false;
 
-		default:
-			printf("UNIMPLEMENTED OPCODE: %0.4X\n", opcode);
+	for(int i = 0; i < 16; i++)
+	{
+		if(chip.input[i] != 0)
+		{
+			chip.registers[op.x] = i;		//We need to set the right register to the value of the keypress
+			keyPress = true;				//And then flag that key has been pressed.
+		}
+	}
 
+	if(!keyPress)							//If after looping through the entire input array no key has been
+	{										//pressed...
+		PROFILE(chip.profile->keyWaits++;)
+		chip.skipIdle(idleKey);				//Nothing can press a key until whoever is running us gets control back
+		return;								//...we need to jump back and try again.
 	}
-	//UPDATE TIMERS
-	if(delayTimer > 0)
+
+	chip.pc += 2;							//Only after a successful test can we increment the PC
+}
+
+void emu::opFX15(emu &chip, const decodedOp &op)
+{
+	//FX15 SET DELAY TIMER TO VX
+	chip.delayTimer = chip.registers[op.x];
+	chip.pc += 2;
+}
+
+void emu::opFX18(emu &chip, const decodedOp &op)
+{
+	//FX18 SET SOUND TIMER TO VX. THE BUZZER IS ON WHILE IT'S ABOVE ZERO.
+	if((chip.soundTimer == 0) != (chip.registers[op.x] == 0)) {
+		chip.post(chip.registers[op.x] != 0 ? eventSoundOn : eventSoundOff, op.opcode);
+	}
+	chip.soundTimer = chip.registers[op.x];
+	chip.pc += 2;
+}
+
+void emu::opFX1E(emu &chip, const decodedOp &op)
+{
+	//FX1E ADD VX TO I
+	chip.index += chip.registers[op.x];
+	chip.pc += 2;
+}
+
+void emu::opFX29(emu &chip, const decodedOp &op)
+{
+	//FX29 SET INDEX TO LOCATION OF SPRITE FOR THE CHARACTER IN VX
+	chip.index = chip.registers[op.x] * 0x5;
+	chip.pc += 2;
+}
+
+void emu::opFX30(emu &chip, const decodedOp &op)
+{
+	//FX30 SET INDEX TO LOCATION OF THE BIG 8x10 SPRITE FOR THE DIGIT IN VX (SUPER-CHIP)
+	chip.index = BIGFONT_START + (chip.registers[op.x] & 0xF) * 10;
+	chip.pc += 2;
+}
+
+void emu::opFN01(emu &chip, const decodedOp &op)
+{
+	//FN01 DRAW ON THE PLANES IN N FROM NOW ON (XO-CHIP). 1 is the first plane, 2 the second, 3 both and 0 neither.
+	chip.planes = op.x & 3;
+	chip.pc += 2;
+}
+
+void emu::opFX33(emu &chip, const decodedOp &op)
+{
+	//FX33 STORE THE BCD REPRESENTATION OF VX IN I
+	unsigned char value = chip.registers[op.x];
+	chip.writeMem(chip.index, value / 100);
+	chip.writeMem(chip.index + 1, (value / 10) % 10);
+	chip.writeMem(chip.index + 2, value % 10);
+	chip.pc += 2;
+}
+
+template<class quirks> void emu::opFX55(emu &chip, const decodedOp &op)
+{
+	//FX55 STORE V0 TO VX IN MEMORY STARTING AT ADDRESS AT INDEX
+
+	for(int i = 0; i <= op.x; i++)
 	{
-		--delayTimer;
+		chip.writeMem(chip.index + i, chip.registers[i]);
+	}
+	if(quirks::loadStoreIncrement) {
+		chip.index += op.x + 1;
 	}
+	chip.pc += 2;
+}
 
-	if(soundTimer > 0)
+template<class quirks> void emu::opFX65(emu &chip, const decodedOp &op)
+{
+	//FX65 COPY MEMORY VALUES STARTING AT INDEX INTO REGISTERS V0 THRU VX
+
+	for(int i = 0; i <= op.x; i++)
 	{
-		if(soundTimer == 1)
+		chip.registers[i] = chip.mem[(chip.index + i) & 0x0FFF];
+	}
+	if(quirks::loadStoreIncrement) {
+		chip.index += op.x + 1;
+	}
+	chip.pc += 2;
+}
+
+void emu::opBad(emu &chip, const decodedOp &op)
+{
+	chip.post(eventBadOpcode, op.opcode);				//Something broke. Bad.
+}
+
+void emu::opUnknown(emu &chip, const decodedOp &op)
+{
+	chip.post(eventBadOpcode, op.opcode);				//UNIMPLEMENTED OPCODE
+}
+
+/*The superinstructions. Each one always runs its first opcode. It only goes on to the next if that still fits before runTarget, in
+ *which case it counts it in cycles itself; interpret() counts the last one that ran, as usual.*/
+
+template<class quirks> void emu::opANNN_DXYN(emu &chip, const decodedOp &op)
+{
+	//ANNN THEN DXYN: POINT I AT A SPRITE AND DRAW IT
+	chip.index = op.nnn;
+	chip.pc += 2;
+	if(chip.cycles + 2 > chip.runTarget) {
+		return;
+	}
+	chip.cycles++;
+	opDXYN<quirks>(chip, op);
+}
+
+void emu::op6XNN_6YNN(emu &chip, const decodedOp &op)
+{
+	//6XNN THEN 6YNN: LOAD TWO REGISTERS. THE SECOND ONE IS IN y, ITS VALUE IN n.
+	chip.registers[op.x] = op.nn;
+	chip.pc += 2;
+	if(chip.cycles + 2 > chip.runTarget) {
+		return;
+	}
+	chip.cycles++;
+	chip.registers[op.y] = (unsigned char)op.n;
+	chip.pc += 2;
+}
+
+void emu::op7XNN_3XNN_1NNN(emu &chip, const decodedOp &op)
+{
+	//7XKK, 3XNN, 1NNN: ADD KK (IN y) TO VX, SKIP THE JUMP IF VX IS NOW NN, OTHERWISE JUMP TO NNN. When the jump comes straight
+	//back here, that's a counting loop, and we keep going round without leaving for as long as whole trips fit.
+	unsigned short top = chip.pc;
+	if(chip.cycles + 3 > chip.runTarget)
+	{
+		chip.registers[op.x] += op.y;		//Not enough room for all three, so just the 7XKK
+		chip.pc += 2;
+		return;
+	}
+
+	for(;;)
+	{
+		chip.registers[op.x] += op.y;
+		if(chip.registers[op.x] == op.nn)
 		{
-			--soundTimer;
-			printf("HONK\n");
+			chip.pc = top + 6;				//Skipped the jump
+			chip.cycles++;					//For the 7XKK. interpret() counts the 3XNN.
+			return;
 		}
+
+		chip.pc = op.nnn;
+		if(op.nnn != top || chip.cycles + 6 > chip.runTarget)
+		{
+			chip.cycles += 2;				//interpret() counts the jump
+			return;
+		}
+		chip.cycles += 3;					//Round again
 	}
 }
 
+template<class quirks> static quirkFlags flagsOf()
+{
+	quirkFlags flags = { quirks::shiftVy, quirks::loadStoreIncrement, quirks::jumpVx, quirks::clipSprites, quirks::vfReset,
+		quirks::superChip, quirks::xoChip };
+	return flags;
+}
+
+quirkFlags quirksFor(emuPlatform platform)
+{
+	switch(platform)
+	{
+		case(platformChip8):  return flagsOf<quirksChip8>();
+		case(platformSchip):  return flagsOf<quirksSchip>();
+		case(platformXochip): return flagsOf<quirksXochip>();
+		default:              return flagsOf<quirksDefault>();
+	}
+}
+
+static const char *const platformNames[] = { "default", "chip8", "schip", "xochip" };
+
+const char *platformName(emuPlatform platform)
+{
+	return platform <= platformXochip ? platformNames[platform] : "?";
+}
+
+bool platformNamed(const char *name, emuPlatform &platform)
+{
+	for(int i = 0; i <= platformXochip; i++)
+	{
+		if(strcmp(name, platformNames[i]) == 0)
+		{
+			platform = (emuPlatform)i;
+			return true;
+		}
+	}
+	return false;
+}
+
 void emu::debugRender()
 {
-	// Draw
-	for(int y = 0; y < 32; ++y)
+	//Dump the screen to stdout as '0's and ' 's, at whatever resolution it's in. No backend, no cursor tricks, so it's only really
+	//useful for a one-off look.
+	char line[128 + 2];
+	int width = getWidth();
+	for(int y = 0; y < getHeight(); ++y)
 	{
-		for(int x = 0; x < 64; ++x)
+		for(int x = 0; x < width; ++x)
 		{
-			if(graphics[(y*64) + x] == 0)
-				pixel = 0x2588 ;
-			else
-				pixel = ' ';
+			line[x] = getPixel(x, y) ? '0' : ' ';
 		}
+		line[width] = '\n';
+		line[width + 1] = '\0';
+		fputs(line, stdout);
 	}
 }
@@ -1,64 +1,303 @@
-class emu {
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+class emu;
+class jitCompiler;
+struct emuProfile;
+struct aotProgram;
+class eventQueue;
+class traceWriter;
+enum emuEventKind : unsigned char;
+
+/*Decoding an opcode means masking and shifting the same bits out of it every single time it runs. Most ROMs spend their whole life in
+ *a handful of small loops, so we decode each address once, remember the result here, and reuse it until the memory under it changes.*/
+struct decodedOp {
+	void (*handler)(emu &chip, const decodedOp &op);	//The function that executes this opcode. NULL means "not decoded yet".
+	unsigned short opcode;		//The raw opcode, kept around for error messages
+	unsigned short nnn;			//The lowest 12 bits (0x0NNN), used as an address
+	unsigned char x;			//The second nibble (0x0X00), used as a register number
+	unsigned char y;			//The third nibble (0x00Y0), used as a register number
+	unsigned char n;			//The lowest nibble (0x000N)
+	unsigned char nn;			//The lowest byte (0x00NN)
+#ifdef CHIP8_PROFILE
+	unsigned char kind;			//profileClass() of the opcode, worked out once here so counting it is just an increment
+#endif
+};
+
+/*The definition for a CHIP-8 system is below. Everything the machine is made of lives in this one plain struct, laid out in one
+ *contiguous block with no pointers in it, so the whole machine can be copied with a single memcpy. That's what save states are.
+ *The biggest arrays go first so nothing needs padding between them.*****************************************************************/
+
+struct emuState {
+	unsigned char mem[4096];		//The CHIP-8 has 4096K of memory. In other words, 0x1000 memory locations. We'd like as much control
+									//over the size of data accessed as possible, so rather than using a larger datatype that'll read
+									//in bigger chunks, we go for the smallest possible, which is a char.
+
+	uint64_t graphics[2][64][2];	//The CHIP-8 uses a 64x32 grid of pixels for drawing, and each pixel is either on or off. That's one
+									//bit per pixel, and a row of 64 pixels fits exactly in one 64-bit integer, so each row is a single
+									//uint64_t. The leftmost pixel (x = 0) is the most significant bit. Drawing a sprite row is then one
+									//shift and one XOR instead of eight separate pixels.
+									//SUPER-CHIP's high resolution mode is 128x64, which is two words a row: graphics[plane][y][0] holds
+									//x = 0 to 63 and [1] holds 64 to 127. In low resolution only rows 0-31 and word [0] are used, so
+									//it's exactly the old 64x32 screen. XO-CHIP adds a second bit plane, which is the second [plane];
+									//a pixel's colour is its bit from each plane. Scrolling is shifting words and moving whole rows.
+
+	/*All of these values are 2-byte values on the CHIP-8 system. They can't be negative, either, so
+	  we will represent them all as unsigned short variables. Many will be self-explanatory, but I will
+	  describe what each one is for nonetheless.*****************************************************************************************/
+
+	unsigned short index;			//This variable represents the index register of the CHIP-8, which supports 2-byte values also.
+	unsigned short pc;				//This variable represents the program counter of the CHIP-8, which supports 2-byte values.
+	unsigned short stack[16];		//This represents the stack you'll need to implement to support program jumps. You use it to store
+									//the current value of the program counter so the program will remember where it's supposed to jump
+									//back to once the jump or subroutine has finished. Since the program counter is 2-bytes, you'll
+									//need an array of 2-byte values to represent the stack. Ergo, another unsigned short.
+	unsigned short sp;				//Finally, this variable represents the stack pointer of the CHIP-8. Used to remember which
+									//of the stack to reference to determine what program counter value to use. Again, 2-byte values.
+
+	/*The rest of the CHIP-8 system uses 8-bit (1 byte) values, most easily represented as unsigned char datatypes***********************/
+
+	unsigned char registers[16];	//The CHIP-8 has 15 general purpose registers that use 1-byte values. The 16th is used as a carry flag
+	unsigned char input[16]; 		//The CHIP-8 has a keyboard with 16 values, and each value is 8-bits in size. Another array of chars works
+									//for that purpose.
+
+	unsigned char delayTimer;		//Both of these timers can have a value from 0 to FF. They count down at 60hz, whatever speed the CPU
+	unsigned char soundTimer;		//runs at, so they only change when tickTimers() is called. Pacing those calls is the driver's job.
+
+	unsigned char hires;			//1 in SUPER-CHIP's 128x64 mode (00FF), 0 in the normal 64x32 one (00FE)
+	unsigned char planes;			//Which bit planes DXYN, 00E0 and the scrolls work on. XO-CHIP's FN01 changes it, otherwise it's
+									//always 1, just the first plane.
+	unsigned char reserved[6];		//Unused. It would be padding before cycles anyway, but spelled out and zeroed, so that copying or
+									//comparing a whole emuState never touches bytes nobody set.
+
+	unsigned long long cycles;		//Not part of the real CHIP-8. Just a count of how many instructions we've executed.
+	uint64_t randomState;			//Where CXNN's random number generator is up to. Every emu has its own, so a run can be replayed
+									//exactly and threads never fight over libc's rand().
+};
+
+/*CHIP-8 grew up on several machines that didn't quite agree on what some opcodes do. Which one a ROM was written for decides how
+ *8XY6/8XYE shift, whether FX55/FX65 move I, where BNNN jumps, whether DXYN wraps sprites round the edges, and whether 8XY1/8XY2/8XY3
+ *clear VF. quirks.h has the details. platformDefault is how this emulator has always behaved, which matches none of them exactly.*/
+
+enum emuPlatform : unsigned char { platformDefault, platformChip8, platformSchip, platformXochip };
+
+class emu : private emuState {		//Private, so nobody outside can poke at the machine behind our back. They get saveState() instead.
 	public:								//Other parts of our emulator may need to access these functions, so we'll put these under public methods
 		emu();
 		~emu();
 
 		bool drawFlag;
 
-		void debugRender(); 			//Renders sprites as '0's and ' 's without a gfx backend to actually draw on the screen
+		void debugRender(); 			//Prints the screen to stdout as '0's and ' 's, without a gfx backend to actually draw on
 
 
 		void emuCycle(); 				// A full cycle fetches the opcode, decodes it, and executes it. This function will be responsible for
 										// all three of these tasks.
+		void runUntilCycle(unsigned long long cycle);	//Runs instructions until getCycles() reaches `cycle`, as fast as it can.
+														//It stops right on it, JIT, compiled code or neither.
+		void tickTimers();				// Counts the delay and sound timers down by one. Call it 60 times a second of emulated time.
+
+		/*Plenty of ROMs spend most of their time doing nothing: spinning on FX07 / 3XNN / 1NNN until the delay timer runs out, sitting
+		 *in FX0A until a key goes down, or jumping to themselves forever once the game is over. None of that can change until the
+		 *next tickTimers() or a change to input[], so runUntilCycle() spots these loops and jumps straight to the cycle it was asked
+		 *for instead of going round them millions of times. The cycle count, registers and pc come out exactly as if it had.
+		 *
+		 *getIdle() says whether the last emuCycle() or runUntilCycle() ended up in one of those loops, and which. A driver can use
+		 *it to stop running an instance that's waiting for a key nobody is going to press, or that has halted.*/
+
+		enum idleState { notIdle, idleTimer, idleKey, idleHalted };
+		idleState getIdle() const { return idle; }
+
+		/*runUntilCycle() only comes back at the cycle it was given. run() is for a driver that would rather hear about anything
+		 *interesting as soon as it happens: it runs up to `budget` instructions in the same tight loop, but stops straight after the
+		 *one that draws, switches the buzzer on or off, or does something wrong (the ones that post an event other than sound, see
+		 *events.h), and says which. Running out of budget while waiting for a key, or halted, say so too, so nobody has to ask
+		 *getIdle(). Like runUntilCycle(), it never goes past the budget, whatever runs the instructions.*/
+
+		enum stopReason { stopBudget, stopDraw, stopSound, stopError, stopKeyWait, stopHalted };
+		stopReason run(unsigned long long budget);
+		bool setJit(bool enabled);		//Switches this emulator between the interpreter and the JIT in jit.h. Returns false if the JIT
+										//can't run on this machine, in which case we just keep interpreting.
+		bool setAot(bool enabled);		//Runs the ROM through ahead-of-time compiled code (aot.h) whenever some that matches it has been
+										//built in. False if nothing matches what's loaded right now; loadRom() looks again either way.
+		void setEvents(eventQueue *queue) { events = queue; }	//Where sound and diagnostics go (see events.h). Only this emu's
+										//thread may push to it. NULL, the default, throws them away.
+#ifdef _WIN32
 		bool loadRom(const wchar_t * fileName);// We also need a function to load the ROM into the program memory, and fill the emulated memory's
 										   // array with the data. This function achieves that, and requires the filepath of the rom we're
 										   // emulating in order to function, hence the parameter. Why a const *char? Because we will get
 										   // this information from the command line when the program is run, and thus it will not change
 										   // at runtime and is required to be a pointer.
+#endif
+		bool loadRom(const char * fileName);	// The same, for systems where file paths are plain chars rather than wchar_ts.
+		bool loadRom(const unsigned char * rom, size_t romSize);	//And for a ROM that's already in memory. All three return false
+																	//if the ROM can't be read or won't fit.
+
+		unsigned long long getCycles() const { return cycles; }	//How many instructions have been executed since the ROM was loaded
+		unsigned short getPc() const { return pc; }
 
-	/*The definition for a CHIP-8 system is below.*******************************************************************************************/
+		void setPlatform(emuPlatform p);	//Which machine's quirks to follow. Call it before loadRom(). Each platform runs its own
+											//copy of the affected handlers, so there's no checking which platform we are as it runs.
+		emuPlatform getPlatform() const { return platform; }
 
-		unsigned char graphics[64*32]; //The CHIP-8 uses a 64x32 sprite grid for drawing. This array facilitates that. Each sprite on the
-										//grid is defined by an 8-bit value. The 'char' datatype is 8-bits (1 byte), so we can use an array of
-										//chars to represent our sprite grid.
+		void setSeed(uint64_t seed);	//Restarts CXNN's random numbers from this seed. Same seed, same input, same run, every time.
+		uint64_t getSeed() const { return seed; }	//Each emu starts off with a seed from the clock, so write this down if you
+													//might want to replay the run later
 
-		unsigned char input[16]; 		//The CHIP-8 has a keyboard with 16 values, and each value is 8-bits in size. Another array of chars works
-										//for that purpose.
+		/*The screen and the keyboard live in emuState below, but the rest of the program needs them, so they stay public.*/
+
+		using emuState::graphics;
+		bool isHires() const { return hires != 0; }
+		int getWidth() const { return hires ? 128 : 64; }
+		int getHeight() const { return hires ? 64 : 32; }
+		unsigned char getPixel(int x, int y) const {	//0 if the pixel at (x, y) is off. Otherwise bit 0 is its first plane and bit 1
+														//its second, which only XO-CHIP ROMs ever use.
+			return ((graphics[0][y][x >> 6] >> (63 - (x & 63))) & 1) | (((graphics[1][y][x >> 6] >> (63 - (x & 63))) & 1) << 1);
+		}
+		using emuState::input;
+
+		/*Save states. A save is one memcpy of the whole emuState into a buffer you own, so it never allocates and you can take
+		 *millions of them. Restoring is a memcpy back, plus throwing away whatever we'd decoded or compiled from memory that changed.
+		 *See savestate.h for a pool to keep them in and a file format to write them to disk with.*/
+
+		void saveState(emuState &state) const;
+		void restoreState(const emuState &state);
+
+#ifdef CHIP8_PROFILE
+		const emuProfile &getProfile() const { return *profile; }	//See profile.h. Starts again from zero every loadRom.
+#endif
+#ifdef CHIP8_TRACE
+		void setTrace(traceWriter *writer);	//Records every instruction from now on (see trace.h). NULL stops. The writer has to be
+											//open(), and only this emu's thread may record into it.
+#endif
 
 	private: 							//Everything from here onwards is part of the internal working of the CPU core. No other parts of
 										//our application need to modify anything here. Things like the variables to hold opcodes,
 										//arrays to represent emulator memory, and internal system timers go here.
 
-		/*All of these values are 2-byte values on the CHIP-8 system. They can't be negative, either, so
-		  we will represent them all as unsigned short variables. Many will be self-explanatory, but I will
-		  describe what each one is for nonetheless.*****************************************************************************************/
+		/*Lastly, you'll need to initialize the virtual system. We'll create a function here for that purpose. It's not going to need to
+		 *return any values either, seeing as how the CHIP-8 is such a simple system, so a void return type will do fine.*/
 
-		short pixel;             //uses unicode characters to set characters for pixel on/off states
+		 void initialize_chip8();
+		 bool readRom(FILE * pFile);		//The part of loadRom that doesn't care how the file was opened
 
-		unsigned short opcode;			//The variable to hold the current opcode being operated on
-		unsigned short index;			//This variable represents the index register of the CHIP-8, which supports 2-byte values also.
-		unsigned short pc;				//This variable represents the program counter of the CHIP-8, which supports 2-byte values.
-		unsigned short stack[16];		//This represents the stack you'll need to implement to support program jumps. You use it to store
-										//the current value of the program counter so the program will remember where it's supposed to jump
-										//back to once the jump or subroutine has finished. Since the program counter is 2-bytes, you'll
-										//need an array of 2-byte values to represent the stack. Ergo, another unsigned short.
-		unsigned short sp;				//Finally, this variable represents the stack pointer of the CHIP-8. Used to remember which
-										//of the stack to reference to determine what program counter value to use. Again, 2-byte values.
+		uint64_t seed;						//What `random` starts from every time a ROM is loaded
+		unsigned char randomByte();
 
-		/*The rest of the CHIP-8 system uses 8-bit (1 byte) values, most easily represented as unsigned char datatypes***********************/
 
-		unsigned char registers[16];	//The CHIP-8 has 15 general purpose registers that use 1-byte values. The 16th is used as a carry flag
-		unsigned char mem[4096];		//The CHIP-8 has 4096K of memory. In other words, 0x1000 memory locations. We'd like as much control
-										//over the size of data accessed as possible, so rather than using a larger datatype that'll read
-										//in bigger chunks, we go for the smallest possible, which is a char.
+		/*The JIT, if it's switched on. It reads our registers and memory directly, so it gets to be a friend. Since we own it, copying
+		 *an emu around would leave two of them pointing at the same one, so copying is off the table too.*/
 
-		unsigned char delayTimer;		//Both of these timers can have a value from 0 to F, or in otherwords, 0-15. They count down at 60hz,
-		unsigned char soundTimer;		//so once a second. As part of emulator implementation, you'll want to find a way to slow down the
-										//such that it only executes 60 opcodes a second. That's outside the scope of this class, however.
+		friend class jitCompiler;
+		jitCompiler *jit;
 
-		/*Lastly, you'll need to initialize the virtual system. We'll create a function here for that purpose. It's not going to need to
-		 *return any values either, seeing as how the CHIP-8 is such a simple system, so a void return type will do fine.*/
+		const aotProgram *aot;				//Compiled code for the ROM that's loaded, if setAot() is on and there is some
+		bool aotWanted;
+		void attachAot();					//Finds the compiled program that matches memory as it is now
+		unsigned long runNative(long budget);	//Compiled code first, then the JIT. 0 if neither could run the next instruction.
 
-		 void initialize_chip8();
+		eventQueue *events;
+		void post(emuEventKind kind, unsigned short opcode);	//Queues an event at the current pc. Never waits.
+
+		emuPlatform platform;
+
+		unsigned long long runTarget;		//Where the current emuCycle(), runUntilCycle() or run() stops. The idle loop checks skip up
+		idleState idle;						//to here.
+		bool stopEarly;						//Inside run(), which stops after anything that draws or posts an event...
+		stopReason stopped;					//...and this is why
+		void stopAfterThis(stopReason why);
+		void drew();						//Sets drawFlag. Every opcode that changes the screen calls it.
+
+#ifdef CHIP8_PROFILE
+		emuProfile *profile;
+#endif
+#ifdef CHIP8_TRACE
+		traceWriter *tracer;
+		void trace(unsigned short at, unsigned short opcode, const unsigned char *before);	//Records one instruction
+#endif
+
+		friend class emuBatch;			//The batch engine in batch.h keeps our registers for us while it runs, see there for why
+		friend class forkArena;			//So does the tree search arena in fork.h, with memory a page at a time
+
+		emu(const emu &);
+		emu &operator=(const emu &);
+
+		/*The decoded instruction cache. One entry per memory address, filled in lazily by decode() the first time the program counter
+		 *lands there. Anything that writes to mem has to go through writeMem() so the cache never runs stale code.*****************/
+
+		decodedOp decoded[4096];
+		unsigned short fusedLow, fusedHigh;	//Where the superinstructions in there start, lowest and highest. forget() only needs to look
+											//further back than the byte before for writes in this range. Low > high means none.
+
+		void decode(unsigned short address);
+		template<class quirks> void decodeFor(unsigned short address);	//decode() for one platform's quirks
+		template<class quirks> void fuse(unsigned short address);		//Swaps in a superinstruction if one starts here
+		void interpret();				//Runs one instruction through the decode cache
+		void skipIdle(idleState why);
+		void writeMem(unsigned short address, unsigned char value);
+		void forget(unsigned short address);	//Throws away anything decoded or compiled from this byte
+		bool loadMem(unsigned short start, const unsigned char *bytes, size_t length);	//Copies bytes over memory, forgetting only
+																						//the ones that change. True if any did.
+		unsigned short dirtyPages;		//One bit per 256 bytes of memory, set by forget() whenever one of them changes. forkArena
+										//(fork.h) clears it once it has a copy.
+
+		/*One handler per opcode. They're static so the cache can hold plain function pointers, and they get the emulator passed in.
+		 *The ones the platforms disagree on are templates on a policy from quirks.h, so each platform gets its own copy with the
+		 *decisions made at compile time.*/
+
+		static void op00E0(emu &chip, const decodedOp &op);
+		static void op00EE(emu &chip, const decodedOp &op);
+		static void op00CN(emu &chip, const decodedOp &op);
+		static void op00DN(emu &chip, const decodedOp &op);
+		static void op00FB(emu &chip, const decodedOp &op);
+		static void op00FC(emu &chip, const decodedOp &op);
+		static void op00FD(emu &chip, const decodedOp &op);
+		static void op00FE(emu &chip, const decodedOp &op);
+		static void op00FF(emu &chip, const decodedOp &op);
+		static void op0NNN(emu &chip, const decodedOp &op);
+		static void op1NNN(emu &chip, const decodedOp &op);
+		static void op2NNN(emu &chip, const decodedOp &op);
+		static void op3XNN(emu &chip, const decodedOp &op);
+		static void op4XNN(emu &chip, const decodedOp &op);
+		static void op5XY0(emu &chip, const decodedOp &op);
+		static void op6XNN(emu &chip, const decodedOp &op);
+		static void op7XNN(emu &chip, const decodedOp &op);
+		static void op8XY0(emu &chip, const decodedOp &op);
+		template<class quirks> static void op8XY1(emu &chip, const decodedOp &op);
+		template<class quirks> static void op8XY2(emu &chip, const decodedOp &op);
+		template<class quirks> static void op8XY3(emu &chip, const decodedOp &op);
+		static void op8XY4(emu &chip, const decodedOp &op);
+		static void op8XY5(emu &chip, const decodedOp &op);
+		template<class quirks> static void op8XY6(emu &chip, const decodedOp &op);
+		static void op8XY7(emu &chip, const decodedOp &op);
+		template<class quirks> static void op8XYE(emu &chip, const decodedOp &op);
+		static void op9XY0(emu &chip, const decodedOp &op);
+		static void opANNN(emu &chip, const decodedOp &op);
+		template<class quirks> static void opBNNN(emu &chip, const decodedOp &op);
+		static void opCXNN(emu &chip, const decodedOp &op);
+		template<class quirks> static void opDXYN(emu &chip, const decodedOp &op);
+		template<class quirks> static void drawSprite(emu &chip, const decodedOp &op);	//DXYN in high resolution, 16x16 or more
+																						//than one plane
+		static void opEX9E(emu &chip, const decodedOp &op);
+		static void opEXA1(emu &chip, const decodedOp &op);
+		static void opFX07(emu &chip, const decodedOp &op);
+		static void opFX0A(emu &chip, const decodedOp &op);
+		static void opFX15(emu &chip, const decodedOp &op);
+		static void opFX18(emu &chip, const decodedOp &op);
+		static void opFX1E(emu &chip, const decodedOp &op);
+		static void opFX29(emu &chip, const decodedOp &op);
+		static void opFX30(emu &chip, const decodedOp &op);
+		static void opFN01(emu &chip, const decodedOp &op);
+		static void opFX33(emu &chip, const decodedOp &op);
+		template<class quirks> static void opFX55(emu &chip, const decodedOp &op);
+		template<class quirks> static void opFX65(emu &chip, const decodedOp &op);
+		static void opBad(emu &chip, const decodedOp &op);
+		static void opUnknown(emu &chip, const decodedOp &op);
+
+		//Superinstructions: runs of two or three opcodes that turn up together all the time, done by one handler. See fuse().
+		template<class quirks> static void opANNN_DXYN(emu &chip, const decodedOp &op);
+		static void op6XNN_6YNN(emu &chip, const decodedOp &op);
+		static void op7XNN_3XNN_1NNN(emu &chip, const decodedOp &op);
 };
 //All done describing the CHIP-8! Now move onto chip8.cpp, where we'll define all of the functions we've briefly described here.
@@ -0,0 +1,526 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "chip8.h"
+#include "batch.h"
+#include "quirks.h"
+
+/*chip8-difftest: runs random programs through the plain interpreter and through every faster way this emulator has of running them,
+ *and checks they all end up in exactly the same state.
+ *
+ *	chip8-difftest [--programs N] [--steps N] [--seed S] [--platform default|chip8|schip|xochip] [--write-rom PATH | --aot PATH]
+ *
+ *The interpreter, one emuCycle() at a time, is the reference. Each program is also run:
+ *	- with the JIT, one emuCycle() at a time
+ *	- with runUntilCycle() in chunks of random length, which is where superinstructions and idle loop skipping happen
+ *	- the same again with the JIT on
+ *	- with run() and random budgets, which stops early whenever something happens, with and without the JIT
+ *	- in an emuBatch, one lane per random seed and keyboard, next to an emu for each lane
+ *After every chunk the reference catches up to the same cycle and the two save states have to match byte for byte. Every path also has
+ *to stop exactly where it was asked to (or, for run(), sooner), JIT or not. Timers tick and keys go up and
+ *down at the same cycle on both sides, so FX07 and FX0A loops get skipped as well as run.
+ *
+ *The programs are mostly ordinary opcodes, with counting loops and timer waits planted in for the fused handlers and the idle skip to
+ *find, calls and returns, and FX33/FX55 writes aimed at the program itself so cached and compiled code has to be thrown away. Each
+ *platform gets N programs (300 unless you say) of up to --steps instructions (3000). Program i uses seed S + i, so a failure can be
+ *run again on its own with --seed and --programs 1, and its ROM is written to difftest-PLATFORM-SEED.ch8 to be traced.
+ *
+ *Code compiled ahead of time (aot.h) has to be built in before the program starts, so it's checked on one ROM at a time instead:
+ *
+ *	chip8-difftest --platform P --seed S --write-rom aotcheck.ch8	(a random program chip8-aot can follow all the way)
+ *	chip8-aot --platform P aotcheck.ch8 aotcheck_aot.cpp		(then build that into chip8-difftest, see README.md)
+ *	chip8-difftest --platform P --aot aotcheck.ch8
+ *
+ *The last one runs the ROM N times with the compiled code, one emuCycle() at a time, with runUntilCycle() and with run(), each time
+ *with a different seed for the chunks, timer ticks and keys, and holds it to the same rules as the JIT.
+ *
+ *Exits with 0 if everything matched and 1 if anything didn't.*/
+
+#define ROM_SIZE 0x200
+#define BODY_SIZE 0x1E0					//The random part. The subroutines go after it, where nothing jumps or falls into them.
+#define SUBROUTINES 4
+#define BATCH_LANES 19					//Not a multiple of 16, so the batch has a partly empty vector at the end too
+
+//A small xorshift, so the same seed makes the same programs whichever libc we were built against
+static unsigned int nextRandom(uint64_t &state) {
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return (unsigned int)((state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static unsigned int below(uint64_t &state, unsigned int n) {
+	return nextRandom(state) % n;
+}
+
+//One random opcode to go at `address`. Calls go to one of the subroutines randomProgram() puts after the body, and the platform's
+//extra opcodes only turn up on platforms that have them, since anything else stops the program where it is for good. A `compilable`
+//program is one chip8-aot can follow all the way through: I only ever points past the program, so FX33 and FX55 don't write over it,
+//and there are no BNNN jumps.
+static unsigned short randomOpcode(uint64_t &r, unsigned short address, const quirkFlags &quirks, const unsigned short *subroutines,
+	bool compilable) {
+	unsigned short x = below(r, 16) << 8;
+	unsigned short y = below(r, 16) << 4;
+	unsigned short nn = below(r, 256);
+	unsigned short anywhere = 0x200 + 2 * below(r, BODY_SIZE / 2);
+
+	switch(below(r, 24))
+	{
+		case(0): case(1): return 0x6000 | x | nn;
+		case(2): case(3): return 0x7000 | x | (below(r, 3) ? 1 : nn);
+		case(4): case(5): {
+			static const unsigned short kinds[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+			return 0x8000 | x | y | kinds[below(r, 9)];
+		}
+		case(6): return 0x3000 | x | below(r, 8);
+		case(7): return 0x4000 | x | below(r, 8);
+		case(8): return (below(r, 2) ? 0x5000 : 0x9000) | x | y;
+		case(9): return 0xA000 | (below(r, 4) || compilable ? 0x400 + below(r, 0x200) : anywhere);	//Sometimes right on top of the program
+		case(10): return 0xF01E | x;
+		case(11): return 0xF029 | x;
+		case(12): return (below(r, 2) ? 0xF033 : 0xF055) | below(r, 4) << 8;
+		case(13): return 0xF065 | below(r, 4) << 8;
+		case(14): case(15): return 0xD000 | x | y | below(r, 16);
+		case(16): return 0x1000 | (below(r, 8) ? anywhere : (address - 2 * below(r, 4)) & 0x0FFF);
+		case(17): return 0x2000 | subroutines[below(r, SUBROUTINES)];
+		case(18):
+			if(compilable) {
+				return 0x1000 | anywhere;
+			}
+			return 0xB200 | 2 * below(r, 0x40);				//Even with V0 = 0xFF added it stays in the program
+		case(19): return 0xC000 | x | nn;
+		case(20): {
+			static const unsigned short timers[] = { 0xF007, 0xF015, 0xF018 };
+			return timers[below(r, 3)] | x;
+		}
+		case(21): {
+			static const unsigned short keys[] = { 0xE09E, 0xE0A1, 0xF00A };
+			return keys[below(r, 3)] | x;
+		}
+		case(22): {
+			if(!quirks.superChip) {
+				return 0xD000 | x | y;				//An 8x0 sprite, which is nothing at all here
+			}
+			unsigned short extra[] = { 0x00FF, 0x00FE, (unsigned short)(0x00C0 | below(r, 16)), 0x00FB, 0x00FC,
+				(unsigned short)(0xF030 | x), (unsigned short)(0xD000 | x | y), (unsigned short)(0x00D0 | below(r, 16)),
+				(unsigned short)(0xF001 | below(r, 4) << 8) };
+			return extra[below(r, quirks.xoChip ? 9 : 7)];
+		}
+		default: return 0x00E0;
+	}
+}
+
+static void put(std::vector<unsigned char> &rom, unsigned short at, unsigned short opcode) {
+	rom[at] = opcode >> 8;
+	rom[at + 1] = opcode & 0xFF;
+}
+
+static std::vector<unsigned char> randomProgram(uint64_t seed, emuPlatform platform, bool compilable) {
+	uint64_t r = seed * 0x9E3779B97F4A7C15ULL + 1;
+	quirkFlags quirks = quirksFor(platform);
+	unsigned short subroutines[SUBROUTINES];
+	for(int i = 0; i < SUBROUTINES; i++) {
+		subroutines[i] = 0x200 + BODY_SIZE + 6 * i;
+	}
+
+	std::vector<unsigned char> rom(ROM_SIZE);
+	for(unsigned short i = 0; i < BODY_SIZE; i += 2) {
+		put(rom, i, randomOpcode(r, 0x200 + i, quirks, subroutines, compilable));
+	}
+
+	//Plant some of the loops real ROMs spend their time in: counting (7XNN / 3XNN / 1NNN back), and waiting for the delay timer
+	//(6X01 / FX15 / FX07 / 3X00 / 1NNN back)
+	for(int loops = below(r, 12); loops > 0; loops--)
+	{
+		unsigned short at = 2 * below(r, BODY_SIZE / 2 - 6);
+		unsigned short x = below(r, 15) << 8;
+		std::vector<unsigned short> loop;
+		if(below(r, 2)) {
+			loop.push_back(0x7000 | x | (below(r, 2) ? 1 : below(r, 256)));
+			loop.push_back(0x3000 | x | below(r, 256));
+			loop.push_back(0x1000 | (0x200 + at));
+		} else {
+			loop.push_back(0x6000 | x | (1 + below(r, 3)));
+			loop.push_back(0xF015 | x);
+			loop.push_back(0xF007 | x);
+			loop.push_back(0x3000 | x);
+			loop.push_back(0x1000 | (0x200 + at + 4));
+		}
+		for(size_t j = 0; j < loop.size(); j++) {
+			put(rom, at + 2 * j, loop[j]);
+		}
+	}
+
+	//Off the end of the body goes back to the start, and after that come the subroutines: a couple of ordinary opcodes and a return
+	put(rom, BODY_SIZE - 2, 0x1200);
+	for(int i = 0; i < SUBROUTINES; i++) {
+		unsigned short at = subroutines[i] - 0x200;
+		put(rom, at, 0x7000 | below(r, 15) << 8 | below(r, 256));
+		put(rom, at + 2, 0x8004 | below(r, 15) << 8 | below(r, 16) << 4);
+		put(rom, at + 4, 0x00EE);
+	}
+	return rom;
+}
+
+//Says which part of two states differs first, for the report
+static void describeDifference(const emuState &want, const emuState &got, char *out, size_t size) {
+	if(want.cycles != got.cycles) {
+		snprintf(out, size, "cycles is %llu, should be %llu", got.cycles, want.cycles);
+	} else if(want.pc != got.pc) {
+		snprintf(out, size, "pc is 0x%03X, should be 0x%03X", got.pc, want.pc);
+	} else if(want.index != got.index) {
+		snprintf(out, size, "I is 0x%03X, should be 0x%03X", got.index, want.index);
+	} else if(memcmp(want.registers, got.registers, sizeof(want.registers)) != 0) {
+		int i = 0;
+		while(want.registers[i] == got.registers[i]) {
+			i++;
+		}
+		snprintf(out, size, "V%X is 0x%02X, should be 0x%02X", i, got.registers[i], want.registers[i]);
+	} else if(want.sp != got.sp || memcmp(want.stack, got.stack, sizeof(want.stack)) != 0) {
+		snprintf(out, size, "the stack differs (sp %u, should be %u)", got.sp, want.sp);
+	} else if(memcmp(want.mem, got.mem, sizeof(want.mem)) != 0) {
+		int i = 0;
+		while(want.mem[i] == got.mem[i]) {
+			i++;
+		}
+		snprintf(out, size, "memory at 0x%03X is 0x%02X, should be 0x%02X", i, got.mem[i], want.mem[i]);
+	} else if(memcmp(want.graphics, got.graphics, sizeof(want.graphics)) != 0 || want.hires != got.hires || want.planes != got.planes) {
+		snprintf(out, size, "the screen differs");
+	} else if(want.delayTimer != got.delayTimer || want.soundTimer != got.soundTimer) {
+		snprintf(out, size, "timers are %u/%u, should be %u/%u", got.delayTimer, got.soundTimer, want.delayTimer, want.soundTimer);
+	} else if(want.randomState != got.randomState) {
+		snprintf(out, size, "the random number generator has moved on differently");
+	} else {
+		snprintf(out, size, "bytes nobody owns differ");
+	}
+}
+
+struct failure {
+	char what[160];
+};
+
+static bool compareStates(emu &reference, emu &other, emuState &want, emuState &got, failure &f) {
+	reference.saveState(want);
+	other.saveState(got);
+	if(memcmp(&want, &got, sizeof(emuState)) == 0) {
+		return true;
+	}
+	char difference[120];
+	describeDifference(want, got, difference, sizeof(difference));
+	snprintf(f.what, sizeof(f.what), "at cycle %llu %s", want.cycles, difference);
+	return false;
+}
+
+enum fastPath { jitCycles, fused, fusedJit, runBudget, runBudgetJit, aotCycles, aotFused, aotRunBudget };
+
+static const char *const fastPathNames[] = {
+	"the JIT (emuCycle)",
+	"runUntilCycle",
+	"runUntilCycle with the JIT",
+	"run(budget)",
+	"run(budget) with the JIT",
+	"compiled code (emuCycle)",
+	"runUntilCycle with compiled code",
+	"run(budget) with compiled code"
+};
+
+static bool checkFastPath(fastPath path, const std::vector<unsigned char> &rom, emuPlatform platform, uint64_t seed,
+	unsigned long long steps, emuState &want, emuState &got, failure &f)
+{
+	emu *reference = new emu;
+	emu *fast = new emu;
+	reference->setPlatform(platform);
+	fast->setPlatform(platform);
+	fast->setJit(path == jitCycles || path == fusedJit || path == runBudgetJit);
+	fast->setAot(path >= aotCycles);
+	reference->loadRom(&rom[0], rom.size());
+	fast->loadRom(&rom[0], rom.size());
+	reference->setSeed(seed);
+	fast->setSeed(seed);
+
+	uint64_t r = seed ^ 0xD1FF;
+	bool same = true;
+	while(same && fast->getCycles() < steps)
+	{
+		unsigned long long chunk = 1 + below(r, below(r, 4) ? 8 : 200);
+		unsigned long long start = fast->getCycles();
+		bool toTheEnd = true;				//Whether it should have used up the whole chunk
+		switch(path)
+		{
+			case(jitCycles):
+			case(aotCycles):
+				for(unsigned long long target = fast->getCycles() + chunk; fast->getCycles() < target; ) {
+					fast->emuCycle();
+				}
+				break;
+			case(fused):
+			case(fusedJit):
+			case(aotFused):
+				fast->runUntilCycle(fast->getCycles() + chunk);
+				break;
+			case(runBudget):
+			case(runBudgetJit):
+			case(aotRunBudget): {
+				emu::stopReason why = fast->run(chunk);
+				toTheEnd = why == emu::stopBudget || why == emu::stopKeyWait || why == emu::stopHalted;
+				break;
+			}
+		}
+
+		//Nothing is allowed to go past the end of the chunk, and only run() is allowed to stop short of it
+		unsigned long long end = start + chunk;
+		if(fast->getCycles() > end || (toTheEnd && fast->getCycles() != end)) {
+			snprintf(f.what, sizeof(f.what), "at cycle %llu: it stopped at cycle %llu, should have been %s%llu", start,
+				fast->getCycles(), toTheEnd ? "" : "at most ", end);
+			same = false;
+			break;
+		}
+
+		while(reference->getCycles() < fast->getCycles()) {
+			reference->emuCycle();
+		}
+		same = compareStates(*reference, *fast, want, got, f);
+
+		//Timer ticks and key changes, at the same cycle on both sides
+		if(below(r, 3) == 0) {
+			reference->tickTimers();
+			fast->tickTimers();
+		}
+		if(below(r, 4) == 0) {
+			unsigned int key = below(r, 16);
+			reference->input[key] ^= 1;
+			fast->input[key] ^= 1;
+		}
+	}
+
+	delete reference;
+	delete fast;
+	return same;
+}
+
+static bool checkBatch(const std::vector<unsigned char> &rom, emuPlatform platform, uint64_t seed, unsigned long long steps,
+	emuState &want, emuState &got, failure &f)
+{
+	//A few different seeds between the lanes, so some of them stay together and take the vector path while the rest wander off
+	emu *references = new emu[BATCH_LANES];
+	emuBatch batch(BATCH_LANES);
+	batch.setPlatform(platform);
+	batch.loadRom(&rom[0], rom.size());
+	for(int i = 0; i < BATCH_LANES; i++) {
+		references[i].setPlatform(platform);
+		references[i].loadRom(&rom[0], rom.size());
+		references[i].setSeed(seed + i % 3);
+		batch.lane(i).setSeed(seed + i % 3);
+	}
+
+	uint64_t r = seed ^ 0xBA7C;
+	bool same = true;
+	for(unsigned long long step = 1; same && step <= steps; step++)
+	{
+		batch.step();
+		for(int i = 0; i < BATCH_LANES; i++) {
+			references[i].emuCycle();
+		}
+
+		if(step % 64 == 0 || step == steps) {
+			for(int i = 0; same && i < BATCH_LANES; i++) {
+				same = compareStates(references[i], batch.lane(i), want, got, f);
+				if(!same) {
+					char detail[sizeof(f.what)];
+					memcpy(detail, f.what, sizeof(detail));
+					snprintf(f.what, sizeof(f.what), "in lane %d %.140s", i, detail);
+				}
+			}
+		}
+
+		if(below(r, 16) == 0) {
+			batch.tickTimers();
+			for(int i = 0; i < BATCH_LANES; i++) {
+				references[i].tickTimers();
+			}
+		}
+		if(below(r, 32) == 0) {
+			unsigned int lane = below(r, BATCH_LANES);
+			unsigned int key = below(r, 16);
+			batch.lane(lane).input[key] ^= 1;
+			references[lane].input[key] ^= 1;
+		}
+	}
+
+	delete[] references;
+	return same;
+}
+
+static void saveFailure(const std::vector<unsigned char> &rom, emuPlatform platform, uint64_t seed) {
+	char path[64];
+	snprintf(path, sizeof(path), "difftest-%s-%llu.ch8", platformName(platform), (unsigned long long)seed);
+	FILE * pFile = fopen(path, "wb");
+	if(pFile != NULL) {
+		fwrite(&rom[0], 1, rom.size(), pFile);
+		fclose(pFile);
+	}
+}
+
+//Compiled code can't be made up on the spot like a JIT block, so it gets one fixed ROM that was put through chip8-aot and built in. The
+//ROM stays the same and each seed gives it a different run of timer ticks, key presses and chunk lengths.
+static unsigned int checkAot(const char *romPath, emuPlatform platform, uint64_t firstSeed, unsigned int runs, unsigned long long steps,
+	emuState &want, emuState &got)
+{
+	std::vector<unsigned char> rom;
+	FILE * pFile = fopen(romPath, "rb");
+	if(pFile != NULL) {
+		int c;
+		while((c = fgetc(pFile)) != EOF) {
+			rom.push_back((unsigned char)c);
+		}
+		fclose(pFile);
+	}
+	if(rom.empty()) {
+		printf("Couldn't read %s\n", romPath);
+		return 1;
+	}
+
+	emu *probe = new emu;
+	probe->setPlatform(platform);
+	probe->loadRom(&rom[0], rom.size());
+	bool compiled = probe->setAot(true);
+	delete probe;
+	if(!compiled) {
+		printf("Nothing compiled for %s on %s is built in. Run chip8-aot --platform %s on it and build the output in with difftest.cpp.\n",
+			romPath, platformName(platform), platformName(platform));
+		return 1;
+	}
+
+	unsigned int failures = 0;
+	for(unsigned int i = 0; i < runs; i++)
+	{
+		uint64_t seed = firstSeed + i;
+		failure f;
+		for(int path = aotCycles; path <= aotRunBudget; path++)
+		{
+			if(!checkFastPath((fastPath)path, rom, platform, seed, steps, want, got, f)) {
+				printf("%s seed %llu: %s disagrees with the interpreter %s\n", romPath, (unsigned long long)seed, fastPathNames[path], f.what);
+				failures++;
+				break;
+			}
+		}
+	}
+	printf("%-8s %s, %u runs, %u disagreed\n", platformName(platform), romPath, runs, failures);
+	return failures;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int programs = 300;
+	unsigned long long steps = 3000;
+	uint64_t firstSeed = 1;
+	int onlyPlatform = -1;
+	const char *writePath = NULL;
+	const char *aotPath = NULL;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--programs") == 0 && i + 1 < argc) {
+			programs = (unsigned int)atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+			steps = strtoull(argv[++i], NULL, 10);
+		} else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			firstSeed = strtoull(argv[++i], NULL, 10);
+		} else if(strcmp(argv[i], "--platform") == 0 && i + 1 < argc) {
+			emuPlatform platform;
+			if(!platformNamed(argv[++i], platform)) {
+				printf("Unknown platform %s (try default, chip8, schip or xochip)\n", argv[i]);
+				return 1;
+			}
+			onlyPlatform = platform;
+		} else if(strcmp(argv[i], "--write-rom") == 0 && i + 1 < argc) {
+			writePath = argv[++i];
+		} else if(strcmp(argv[i], "--aot") == 0 && i + 1 < argc) {
+			aotPath = argv[++i];
+		} else {
+			printf("Usage: chip8-difftest [--programs N] [--steps N] [--seed S] [--platform default|chip8|schip|xochip] [--write-rom PATH | --aot PATH]\n");
+			return 1;
+		}
+	}
+
+	if(writePath != NULL)
+	{
+		emuPlatform platform = onlyPlatform >= 0 ? (emuPlatform)onlyPlatform : platformDefault;
+		std::vector<unsigned char> rom = randomProgram(firstSeed, platform, true);
+		FILE * pFile = fopen(writePath, "wb");
+		bool written = pFile != NULL && fwrite(&rom[0], 1, rom.size(), pFile) == rom.size();
+		if(pFile != NULL) {
+			fclose(pFile);
+		}
+		if(!written) {
+			printf("Couldn't write %s\n", writePath);
+			return 1;
+		}
+		return 0;
+	}
+
+	emuState *want = new emuState;
+	emuState *got = new emuState;
+	if(aotPath != NULL)
+	{
+		emuPlatform platform = onlyPlatform >= 0 ? (emuPlatform)onlyPlatform : platformDefault;
+		unsigned int failures = checkAot(aotPath, platform, firstSeed, programs, steps, *want, *got);
+		delete want;
+		delete got;
+		return failures == 0 ? 0 : 1;
+	}
+
+	emu *probe = new emu;				//An emu is mostly its decode cache, a bit big for the stack
+	bool jitWorks = probe->setJit(true);
+	delete probe;
+	if(!jitWorks) {
+		printf("The JIT can't run here, so only the interpreter's own fast paths get checked\n");
+	}
+
+	unsigned int failures = 0;
+	for(int p = platformDefault; p <= platformXochip; p++)
+	{
+		if(onlyPlatform >= 0 && p != onlyPlatform) {
+			continue;
+		}
+		emuPlatform platform = (emuPlatform)p;
+		unsigned int platformFailures = 0;
+
+		for(unsigned int i = 0; i < programs; i++)
+		{
+			uint64_t seed = firstSeed + i;
+			std::vector<unsigned char> rom = randomProgram(seed, platform, false);
+			failure f;
+			bool failed = false;
+
+			for(int path = jitCycles; path <= runBudgetJit; path++)
+			{
+				if(!jitWorks && (path == jitCycles || path == fusedJit || path == runBudgetJit)) {
+					continue;
+				}
+				if(!checkFastPath((fastPath)path, rom, platform, seed, steps, *want, *got, f)) {
+					printf("%s program %llu: %s disagrees with the interpreter %s\n", platformName(platform), (unsigned long long)seed,
+						fastPathNames[path], f.what);
+					failed = true;
+				}
+			}
+			if(!checkBatch(rom, platform, seed, steps, *want, *got, f)) {
+				printf("%s program %llu: emuBatch disagrees with the interpreter %s\n", platformName(platform), (unsigned long long)seed,
+					f.what);
+				failed = true;
+			}
+
+			if(failed) {
+				saveFailure(rom, platform, seed);
+				platformFailures++;
+			}
+		}
+
+		printf("%-8s %u programs, %u disagreed\n", platformName(platform), programs, platformFailures);
+		failures += platformFailures;
+	}
+
+	delete want;
+	delete got;
+	return failures == 0 ? 0 : 1;
+}
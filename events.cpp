@@ -0,0 +1,144 @@
+#include "events.h"
+#include "sound.h"
+
+#define LOG_BURST 5						//Lines per instance per kind of event per second. The rest are only counted.
+#define LOG_SLEEP_MS 5					//How long the logger thread naps when every queue is empty
+#define DRAIN_BATCH 256					//Events taken off one queue before moving on to the next, so one noisy instance can't hog it
+
+const char *eventName(emuEventKind kind) {
+	switch(kind)
+	{
+		case(eventSoundOn):        return "sound on";
+		case(eventSoundOff):       return "sound off";
+		case(eventBadOpcode):      return "unknown opcode";
+		case(eventMachineCode):    return "machine code call (0NNN)";
+		case(eventStackOverflow):  return "stack overflow";
+		case(eventStackUnderflow): return "stack underflow";
+		default:                   return "event";
+	}
+}
+
+eventQueue::eventQueue(unsigned int capacity) : head(0), dropped(0), tail(0) {
+	this->capacity = 1;
+	while(this->capacity < capacity) {
+		this->capacity <<= 1;
+	}
+	ring = new emuEvent[this->capacity];
+	tailSeen = 0;
+	headSeen = 0;
+}
+
+eventQueue::~eventQueue() {
+	delete[] ring;
+}
+
+eventLogger::eventLogger(unsigned int instances, FILE *log) : running(false), logged(0), suppressed(0) {
+	this->instances = instances;
+	this->log = log;
+	for(unsigned int i = 0; i < instances; i++) {
+		queues.push_back(new eventQueue);
+	}
+	waves.assign(instances, (squareWave *)NULL);
+	limit none = { 0, 0 };
+	limits.assign((size_t)instances * EVENT_KINDS, none);
+}
+
+eventLogger::~eventLogger() {
+	stop();
+	for(size_t i = 0; i < queues.size(); i++) {
+		delete queues[i];
+	}
+}
+
+void eventLogger::setSound(unsigned int instance, squareWave *wave) {
+	waves[instance] = wave;
+}
+
+void eventLogger::start() {
+	windowStart = std::chrono::steady_clock::now();
+	running = true;
+	logger = std::thread(&eventLogger::run, this);
+}
+
+void eventLogger::stop() {
+	if(running) {
+		running = false;
+		logger.join();
+	} else {
+		while(drain()) {
+		}
+		closeWindow();
+	}
+}
+
+unsigned long long eventLogger::eventsDropped() const {
+	unsigned long long total = 0;
+	for(size_t i = 0; i < queues.size(); i++) {
+		total += queues[i]->getDropped();
+	}
+	return total;
+}
+
+bool eventLogger::drain() {
+	bool any = false;
+	emuEvent event;
+	for(unsigned int i = 0; i < instances; i++)
+	{
+		for(int n = 0; n < DRAIN_BATCH && queues[i]->pop(event); n++)
+		{
+			any = true;
+			if(event.kind == eventSoundOn || event.kind == eventSoundOff)
+			{
+				if(waves[i] != NULL) {
+					waves[i]->event(event);
+				}
+				continue;
+			}
+
+			limit &l = limits[(size_t)i * EVENT_KINDS + event.kind];
+			if(l.printed < LOG_BURST) {
+				fprintf(log, "instance %u: %s %04X at 0x%03X, cycle %llu\n", i, eventName(event.kind), event.opcode, event.pc, event.cycle);
+				l.printed++;
+				logged++;
+			} else {
+				l.extra++;
+				suppressed++;
+			}
+		}
+	}
+	return any;
+}
+
+void eventLogger::closeWindow() {
+	for(unsigned int i = 0; i < instances; i++)
+	{
+		for(int kind = 0; kind < EVENT_KINDS; kind++)
+		{
+			limit &l = limits[(size_t)i * EVENT_KINDS + kind];
+			if(l.extra > 0) {
+				fprintf(log, "instance %u: ...and %llu more %s events\n", i, l.extra, eventName((emuEventKind)kind));
+			}
+			l.printed = 0;
+			l.extra = 0;
+		}
+	}
+	fflush(log);
+	windowStart = std::chrono::steady_clock::now();
+}
+
+void eventLogger::run() {
+	while(running)
+	{
+		if(!drain()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(LOG_SLEEP_MS));
+		}
+		if(std::chrono::steady_clock::now() - windowStart >= std::chrono::seconds(1)) {
+			closeWindow();
+		}
+	}
+
+	//Whatever the emulators managed to queue before we were told to stop still gets its say
+	while(drain()) {
+	}
+	closeWindow();
+}
@@ -0,0 +1,133 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+class squareWave;
+
+/*Things an emulator wants the outside world to hear about: the buzzer going on and off, and a ROM doing something it shouldn't. These
+ *used to be printf()s straight out of the opcode handlers, so a ROM stuck on a bad opcode printed a line per instruction and ran at the
+ *speed of the terminal. Now the handler drops a small event into a queue (see emu::setEvents()) and carries on, and a logger thread
+ *deals with it later.
+ *
+ *Each emulator gets its own eventQueue: a fixed-size ring with exactly one thread putting events in and one taking them out, which is
+ *all it takes to need no locks. push() never waits and never allocates. If the ring is full because the logger has fallen behind, the
+ *event is counted and thrown away. The emulator doesn't slow down for anybody.
+ *
+ *eventLogger owns a queue per instance and a thread that drains them all. Diagnostics get written out, at most a few lines per
+ *instance per kind per second, with the rest summed up in one line ("...and 59994 more"). Sound events go to that instance's
+ *squareWave (see sound.h), if it has one.*/
+
+enum emuEventKind : unsigned char {
+	eventSoundOn,				//The sound timer was set, so the buzzer starts...
+	eventSoundOff,				//...and now it's run out, or been set to 0
+	eventBadOpcode,				//An opcode this platform doesn't have. The pc stays put, so expect one of these every instruction.
+	eventMachineCode,			//0NNN, which would run COSMAC VIP machine code. Also stays put.
+	eventStackOverflow,			//2NNN with all 16 stack slots taken. Stays put instead of writing past the stack.
+	eventStackUnderflow,		//00EE with nothing on the stack. Stays put too.
+	EVENT_KINDS
+};
+
+struct emuEvent {
+	unsigned long long cycle;	//emu::getCycles() when it happened
+	unsigned short pc;
+	unsigned short opcode;
+	emuEventKind kind;
+};
+
+const char *eventName(emuEventKind kind);
+
+class eventQueue {
+	public:
+		eventQueue(unsigned int capacity = 1024);		//Rounded up to a power of two
+		~eventQueue();
+
+		//Emulator side
+		bool push(const emuEvent &event) {
+			size_t at = head.load(std::memory_order_relaxed);
+			if(at - tailSeen >= capacity) {
+				tailSeen = tail.load(std::memory_order_acquire);		//Only look at the other thread's counter when we seem full
+				if(at - tailSeen >= capacity) {
+					dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+					return false;
+				}
+			}
+			ring[at & (capacity - 1)] = event;
+			head.store(at + 1, std::memory_order_release);
+			return true;
+		}
+
+		//Logger side
+		bool pop(emuEvent &event) {
+			size_t at = tail.load(std::memory_order_relaxed);
+			if(at == headSeen) {
+				headSeen = head.load(std::memory_order_acquire);
+				if(at == headSeen) {
+					return false;
+				}
+			}
+			event = ring[at & (capacity - 1)];
+			tail.store(at + 1, std::memory_order_release);
+			return true;
+		}
+
+		unsigned long long getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+	private:
+		emuEvent *ring;
+		size_t capacity;
+
+		//The two ends are kept a cache line apart, so the emulator and the logger aren't fighting over one line all the time. Each side
+		//keeps its own copy of where the other end was last time it looked, and only reads the shared one when that copy says stop.
+		std::atomic<size_t> head;						//Next slot to write. Only the emulator changes it.
+		size_t tailSeen;
+		std::atomic<unsigned long long> dropped;
+		char apart[64];
+		std::atomic<size_t> tail;						//Next slot to read. Only the logger changes it.
+		size_t headSeen;
+
+		eventQueue(const eventQueue &);
+		eventQueue &operator=(const eventQueue &);
+};
+
+class eventLogger {
+	public:
+		eventLogger(unsigned int instances, FILE *log = stderr);
+		~eventLogger();						//Stops, if stop() hasn't been called
+
+		eventQueue &queue(unsigned int instance) { return *queues[instance]; }	//Hand it to that instance's emu::setEvents()
+		void setSound(unsigned int instance, squareWave *wave);	//Where that instance's sound events go. Before start().
+
+		void start();
+		void stop();						//Handles whatever's still queued, then joins the thread
+
+		unsigned long long eventsLogged() const { return logged; }
+		unsigned long long eventsSuppressed() const { return suppressed; }	//Over the rate limit, so only counted
+		unsigned long long eventsDropped() const;						//Never made it into a queue at all
+
+	private:
+		struct limit {
+			unsigned int printed;			//This second
+			unsigned long long extra;		//Over the limit this second
+		};
+
+		unsigned int instances;
+		FILE *log;
+		std::vector<eventQueue *> queues;
+		std::vector<squareWave *> waves;
+		std::vector<limit> limits;			//instances x EVENT_KINDS
+		std::chrono::steady_clock::time_point windowStart;
+		std::thread logger;
+		std::atomic<bool> running;
+		std::atomic<unsigned long long> logged;
+		std::atomic<unsigned long long> suppressed;
+
+		void run();
+		bool drain();						//False if every queue was empty
+		void closeWindow();					//Writes out the "...and N more" lines and starts a new second
+
+		eventLogger(const eventLogger &);
+		eventLogger &operator=(const eventLogger &);
+};
@@ -0,0 +1,142 @@
+#include "chip8.h"
+#include "fork.h"
+#include <string.h>
+
+#define PAGE_SIZE 256
+#define PAGE_COUNT (4096 / PAGE_SIZE)
+
+//Everything in emuState after mem: the screen, the registers, the stack, the timers and the rest. It's all one block, since mem comes
+//first, and it gets copied every time.
+#define HEAD_START offsetof(emuState, graphics)
+#define HEAD_SIZE (sizeof(emuState) - HEAD_START)
+
+struct forkPage {
+	unsigned char bytes[PAGE_SIZE];
+	unsigned int refs;					//Snapshots using it, plus one if it's in current[]
+	forkPage *nextFree;
+};
+
+struct forkState {
+	unsigned char head[HEAD_SIZE];
+	forkPage *pages[PAGE_COUNT];
+	forkState *nextFree;
+};
+
+forkArena::forkArena(emu &chip, unsigned int perSlab) : chip(chip) {
+	this->perSlab = perSlab > 0 ? perSlab : 1;
+	freeStates = NULL;
+	freePages = NULL;
+	states = 0;
+	pages = 0;
+	for(int i = 0; i < PAGE_COUNT; i++) {
+		current[i] = NULL;				//We don't know what the emu has yet, so the first fork() copies all of it
+	}
+}
+
+forkArena::~forkArena() {
+	for(size_t i = 0; i < stateSlabs.size(); i++) {
+		delete[] stateSlabs[i];
+	}
+	for(size_t i = 0; i < pageSlabs.size(); i++) {
+		delete[] pageSlabs[i];
+	}
+}
+
+//Off the free list, or a whole new slab of them if it's empty
+forkState *forkArena::newState() {
+	if(freeStates == NULL)
+	{
+		forkState *slab = new forkState[perSlab];
+		stateSlabs.push_back(slab);
+		for(unsigned int i = 0; i < perSlab; i++) {
+			slab[i].nextFree = i + 1 < perSlab ? &slab[i + 1] : NULL;
+		}
+		freeStates = slab;
+	}
+	forkState *state = freeStates;
+	freeStates = state->nextFree;
+	states++;
+	return state;
+}
+
+forkPage *forkArena::newPage() {
+	if(freePages == NULL)
+	{
+		forkPage *slab = new forkPage[perSlab];
+		pageSlabs.push_back(slab);
+		for(unsigned int i = 0; i < perSlab; i++) {
+			slab[i].nextFree = i + 1 < perSlab ? &slab[i + 1] : NULL;
+		}
+		freePages = slab;
+	}
+	forkPage *p = freePages;
+	freePages = p->nextFree;
+	p->refs = 1;
+	pages++;
+	return p;
+}
+
+void forkArena::drop(forkPage *p) {
+	if(p != NULL && --p->refs == 0)
+	{
+		p->nextFree = freePages;
+		freePages = p;
+		pages--;
+	}
+}
+
+forkState *forkArena::fork() {
+	forkState *state = newState();
+	memcpy(state->head, reinterpret_cast<const unsigned char *>(static_cast<const emuState *>(&chip)) + HEAD_START, HEAD_SIZE);
+
+	for(int i = 0; i < PAGE_COUNT; i++)
+	{
+		const unsigned char *bytes = chip.mem + i * PAGE_SIZE;
+
+		//Written to since we last looked. Plenty of writes put back exactly what was there (FX55 saving registers that haven't
+		//changed, say), so it's worth checking before giving it a page of its own.
+		if(current[i] == NULL || (((chip.dirtyPages >> i) & 1) && memcmp(current[i]->bytes, bytes, PAGE_SIZE) != 0))
+		{
+			forkPage *p = newPage();
+			memcpy(p->bytes, bytes, PAGE_SIZE);
+			drop(current[i]);
+			current[i] = p;
+		}
+		state->pages[i] = current[i];
+		current[i]->refs++;
+	}
+	chip.dirtyPages = 0;
+	return state;
+}
+
+void forkArena::load(const forkState *state) {
+	bool changed = false;
+	for(int i = 0; i < PAGE_COUNT; i++)
+	{
+		forkPage *p = state->pages[i];
+		if(p == current[i] && !((chip.dirtyPages >> i) & 1)) {
+			continue;					//The emu still has exactly this page
+		}
+
+		changed |= chip.loadMem((unsigned short)(i * PAGE_SIZE), p->bytes, PAGE_SIZE);
+		p->refs++;
+		drop(current[i]);
+		current[i] = p;
+	}
+	chip.dirtyPages = 0;
+
+	memcpy(reinterpret_cast<unsigned char *>(static_cast<emuState *>(&chip)) + HEAD_START, state->head, HEAD_SIZE);
+	chip.drawFlag = true;
+	if(chip.aotWanted && (changed || chip.aot == NULL)) {
+		chip.attachAot();				//Same as restoreState(): memory might or might not be what the compiled code expects now
+	}
+}
+
+void forkArena::release(forkState *state) {
+	for(int i = 0; i < PAGE_COUNT; i++) {
+		drop(state->pages[i]);
+	}
+	state->nextFree = freeStates;
+	freeStates = state;
+	states--;
+}
@@ -0,0 +1,53 @@
+#include <stddef.h>
+#include <vector>
+
+class emu;
+struct forkState;
+struct forkPage;
+
+/*Forking for tree search. A search that tries every move from every position needs to snapshot the machine, run it a bit, and go back,
+ *tens of thousands of times a second. saveState() copies all 4K of memory every time, even though a move or two almost never
+ *changes more than a few bytes of it.
+ *
+ *So a forkArena splits memory into 16 pages of 256 bytes, and snapshots share the pages they have in common. It works on one emu (the
+ *one it was made with): fork() takes a snapshot of it as it is now, and load() puts it back to any snapshot. Only the registers,
+ *stack, timers and screen (about 2K) are copied every time. A page is only copied when the emu has written to it since the last
+ *fork() or load(), which emu::forget() keeps track of, and load() only copies in the pages that differ from what the emu already has.
+ *
+ *Snapshots and pages come from slabs that the arena keeps for as long as it lives. release() puts them back on a free list, so after
+ *the first few thousand forks nothing touches the allocator at all.
+ *
+ *One arena per thread. Neither it nor its emu is safe to share.*/
+
+class forkArena {
+	public:
+		forkArena(emu &chip, unsigned int perSlab = 1024);
+		~forkArena();
+
+		forkState *fork();						//A snapshot of the emu as it is now. It stays valid until you release() it.
+		void load(const forkState *state);		//Puts the emu back to a snapshot. The snapshot is still there afterwards.
+		void release(forkState *state);			//Done with it
+
+		size_t statesInUse() const { return states; }
+		size_t pagesInUse() const { return pages; }
+
+	private:
+		emu &chip;
+		unsigned int perSlab;
+		std::vector<forkState *> stateSlabs;
+		std::vector<forkPage *> pageSlabs;
+		forkState *freeStates;
+		forkPage *freePages;
+		size_t states;
+		size_t pages;
+
+		forkPage *current[16];					//The pages the emu's memory matched at the last fork() or load(), apart from the ones
+												//its dirtyPages say have been written since. We hold a reference on each.
+
+		forkState *newState();
+		forkPage *newPage();
+		void drop(forkPage *p);
+
+		forkArena(const forkArena &);
+		forkArena &operator=(const forkArena &);
+};
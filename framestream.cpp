@@ -0,0 +1,299 @@
+#include "chip8.h"
+#include "framestream.h"
+#include "triplebuffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0			//macOS doesn't have it. We set SO_NOSIGPIPE on the socket there instead.
+#endif
+
+#define POLL_MS 16				//How long the server thread sleeps when nothing's happening. About one frame.
+
+frameServer::frameServer(unsigned int instances) : running(false), sent(0), skipped(0) {
+	this->instances = instances;
+	frames = new tripleBuffer[instances];
+	listener = -1;
+}
+
+frameServer::~frameServer() {
+	stop();
+	delete[] frames;
+}
+
+//Emulator side. This is all an emulator ever pays for being watched: one look at an atomic, and now and then one copy of its screen.
+bool frameServer::publish(unsigned int instance, const emu &chip, bool always) {
+	if(instance >= instances) {
+		return true;
+	}
+	if(!always && frames[instance].unfetched()) {
+		return false;
+	}
+	frame &next = frames[instance].writeBuffer();
+	memcpy(next.planes, chip.graphics, sizeof(chip.graphics));
+	next.hires = chip.isHires();
+	frames[instance].publish();
+	return true;
+}
+
+static void putCount(std::string &out, size_t count) {
+	while(count >= 0x80) {
+		out += (char)(count | 0x80);
+		count >>= 7;
+	}
+	out += (char)count;
+}
+
+static void putLittle(std::string &out, unsigned long long value, int bytes) {
+	for(int i = 0; i < bytes; i++) {
+		out += (char)((value >> (i * 8)) & 0xFF);
+	}
+}
+
+//Queues up the newest frame of every instance this viewer hasn't seen yet, each as a delta against what it has now
+void frameServer::encode(viewer &v) {
+	std::string body;
+	for(unsigned int i = 0; i < instances; i++)
+	{
+		const frame &newest = frames[i].readBuffer();
+		if(newest.number == 0 || newest.number == v.shownNumber[i]) {
+			continue;
+		}
+		if(v.shownNumber[i] != 0) {
+			skipped += newest.number - v.shownNumber[i] - 1;
+		}
+
+		const uint64_t *now = &newest.planes[0][0][0];
+		uint64_t *shown = &v.shown[i * FRAME_STREAM_WORDS];
+		body.clear();
+		size_t w = 0;
+		while(w < FRAME_STREAM_WORDS)
+		{
+			size_t start = w;
+			while(w < FRAME_STREAM_WORDS && now[w] == shown[w]) {
+				w++;
+			}
+			if(w == FRAME_STREAM_WORDS) {
+				break;
+			}
+			size_t changed = w;
+			while(w < FRAME_STREAM_WORDS && now[w] != shown[w]) {
+				w++;
+			}
+
+			putCount(body, changed - start);
+			putCount(body, w - changed);
+			for(size_t j = changed; j < w; j++) {
+				putLittle(body, now[j] ^ shown[j], 8);
+				shown[j] = now[j];
+			}
+		}
+
+		putLittle(v.pending, i, 4);
+		putLittle(v.pending, newest.number, 8);
+		v.pending += (char)(newest.hires ? 1 : 0);
+		putLittle(v.pending, body.size(), 2);
+		v.pending += body;
+		v.shownNumber[i] = newest.number;
+		sent++;
+	}
+}
+
+#ifndef _WIN32
+
+bool frameServer::listen(const char *address) {
+	if(strncmp(address, "unix:", 5) == 0)
+	{
+		sockaddr_un where;
+		memset(&where, 0, sizeof(where));
+		where.sun_family = AF_UNIX;
+		if(strlen(address + 5) >= sizeof(where.sun_path)) {
+			fprintf(stderr, "Socket path %s is too long\n", address + 5);
+			return false;
+		}
+		strcpy(where.sun_path, address + 5);
+		unlink(where.sun_path);			//Left behind by a run that didn't get to tidy up
+
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(listener < 0 || bind(listener, (sockaddr *)&where, sizeof(where)) != 0) {
+			fprintf(stderr, "Couldn't listen on %s: %s\n", address, strerror(errno));
+			stop();
+			return false;
+		}
+		unixPath = where.sun_path;
+	}
+	else
+	{
+		sockaddr_in where;
+		memset(&where, 0, sizeof(where));
+		where.sin_family = AF_INET;
+		where.sin_port = htons((unsigned short)atoi(address));
+		where.sin_addr.s_addr = htonl(INADDR_LOOPBACK);		//Local viewers only. Tunnel over ssh to watch from elsewhere.
+
+		int yes = 1;
+		listener = socket(AF_INET, SOCK_STREAM, 0);
+		if(listener >= 0) {
+			setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+		}
+		if(listener < 0 || bind(listener, (sockaddr *)&where, sizeof(where)) != 0) {
+			fprintf(stderr, "Couldn't listen on port %s: %s\n", address, strerror(errno));
+			stop();
+			return false;
+		}
+	}
+
+	if(::listen(listener, 16) != 0) {
+		fprintf(stderr, "Couldn't listen on %s: %s\n", address, strerror(errno));
+		stop();
+		return false;
+	}
+	fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+
+	running = true;
+	server = std::thread(&frameServer::serve, this);
+	return true;
+}
+
+void frameServer::accept() {
+	int socket = ::accept(listener, NULL, NULL);
+	if(socket < 0) {
+		return;
+	}
+	fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+	int yes = 1;
+	if(unixPath.empty()) {
+		setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));	//Frames are small and we want them there now
+	}
+#ifdef SO_NOSIGPIPE
+	setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+#endif
+
+	viewer *v = new viewer;
+	v->socket = socket;
+	v->pendingSent = 0;
+	v->shown.assign((size_t)instances * FRAME_STREAM_WORDS, 0);
+	v->shownNumber.assign(instances, 0);
+	v->pending = FRAME_STREAM_MAGIC;
+	putLittle(v->pending, FRAME_STREAM_VERSION, 2);
+	putLittle(v->pending, instances, 4);
+	viewers.push_back(v);
+}
+
+bool frameServer::flush(viewer &v) {
+	while(v.pendingSent < v.pending.size())
+	{
+		ssize_t n = send(v.socket, v.pending.data() + v.pendingSent, v.pending.size() - v.pendingSent, MSG_NOSIGNAL);
+		if(n > 0) {
+			v.pendingSent += (size_t)n;
+		} else if(n < 0 && errno == EINTR) {
+			continue;
+		} else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return true;				//Its socket buffer is full. Try again when poll() says there's room.
+		} else {
+			return false;
+		}
+	}
+	v.pending.clear();
+	v.pendingSent = 0;
+	return true;
+}
+
+void frameServer::serve() {
+	std::vector<pollfd> polls;
+	bool last = false;
+	while(!last)
+	{
+		last = !running;				//Once we're asked to stop, go round once more so everybody gets the final frames
+
+		polls.resize(viewers.size() + 1);
+		polls[0].fd = listener;
+		polls[0].events = POLLIN;
+		polls[0].revents = 0;
+		for(size_t i = 0; i < viewers.size(); i++) {
+			polls[i + 1].fd = viewers[i]->socket;
+			polls[i + 1].events = POLLIN | (viewers[i]->pending.empty() ? 0 : POLLOUT);
+			polls[i + 1].revents = 0;
+		}
+		if(!last) {
+			poll(&polls[0], polls.size(), POLL_MS);
+		}
+
+		if(polls[0].revents & POLLIN) {
+			accept();
+		}
+
+		for(unsigned int i = 0; i < instances; i++) {
+			frames[i].fetch();
+		}
+
+		for(size_t i = 0; i < viewers.size(); )
+		{
+			viewer &v = *viewers[i];
+			bool alive = true;
+
+			//Viewers don't talk, so anything readable is either junk to throw away or the connection closing
+			if(i + 1 < polls.size() && (polls[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+			{
+				char junk[256];
+				ssize_t n = recv(v.socket, junk, sizeof(junk), 0);
+				alive = n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+			}
+
+			if(alive && v.pending.empty()) {
+				encode(v);
+			}
+			if(!alive || !flush(v))
+			{
+				close(v.socket);
+				delete viewers[i];
+				viewers.erase(viewers.begin() + i);
+				continue;
+			}
+			i++;
+		}
+	}
+}
+
+void frameServer::stop() {
+	if(running) {
+		running = false;
+		server.join();
+	}
+	for(size_t i = 0; i < viewers.size(); i++) {
+		close(viewers[i]->socket);
+		delete viewers[i];
+	}
+	viewers.clear();
+	if(listener >= 0) {
+		close(listener);
+		listener = -1;
+	}
+	if(!unixPath.empty()) {
+		unlink(unixPath.c_str());
+		unixPath.clear();
+	}
+}
+
+#else
+
+bool frameServer::listen(const char *address) {
+	fprintf(stderr, "Frame streaming isn't available on Windows\n");
+	return false;
+}
+
+void frameServer::stop() {
+}
+
+#endif
@@ -0,0 +1,87 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+class emu;
+class tripleBuffer;
+
+/*Lets anybody watch a whole set of running emulators from somewhere else, over a local TCP port or a Unix socket, without slowing a
+ *single one of them down.
+ *
+ *Each emulator hands its screen over with publish() whenever it has drawn something. That's a copy into its own triple buffer (see
+ *triplebuffer.h) and nothing else, so it never waits on the network. The server has a thread of its own that picks up the newest frame
+ *of every instance and sends it to every viewer as the XOR against the last frame that viewer got from it, run-length coded, so a frame
+ *where one sprite moved costs a few dozen bytes.
+ *
+ *An emulator running flat out can draw millions of frames a second, far more than the server could ever look at. So publish() doesn't
+ *even copy the screen while the server still hasn't picked up the last one, and says so by returning false; keep drawFlag set and
+ *call it again next tick. The copy then only happens about once per pass of the server thread, 60 times a second. Pass `always` for a
+ *frame that mustn't be missed, like the last one before the emulator goes away.
+ *
+ *Viewers that can't keep up don't hold anything up either. We only encode a new frame for a viewer once it has taken everything we
+ *sent it before, and then it gets the newest frame, so any in between are simply skipped. The deltas are always against what that
+ *viewer actually has, so skipping frames never corrupts its picture.
+ *
+ *On the wire, everything little-endian:
+ *	"C8FS"		magic, once, when a viewer connects
+ *	2 bytes		version
+ *	4 bytes		number of instances
+ *then any number of frames:
+ *	4 bytes		instance
+ *	8 bytes		frame number (counts up by one for every publish(), so gaps are frames that were skipped)
+ *	1 byte		1 if it's 128x64, 0 if it's 64x32
+ *	2 bytes		length of the delta
+ *	delta		the screen (emu::graphics, as 256 words) XORed against the viewer's previous one for this instance: a list of
+ *				(how many words didn't change, how many did, those words XORed) with the counts seven bits to a byte, top bit
+ *				meaning more follow. Words after the last change aren't sent. A viewer's first frame is against a blank screen.
+ *
+ *Viewers never send anything. Closing the connection is how they leave. Not available on Windows.*/
+
+#define FRAME_STREAM_MAGIC "C8FS"
+#define FRAME_STREAM_VERSION 1
+#define FRAME_STREAM_WORDS 256		//2 planes x 64 rows x 2 words, like emu::graphics
+
+class frameServer {
+	public:
+		frameServer(unsigned int instances);
+		~frameServer();
+
+		bool listen(const char *address);		//"PORT" for TCP on 127.0.0.1, or "unix:PATH". Starts the server thread.
+		void stop();							//Sends what's left and disconnects everybody. The destructor does it too.
+
+		bool publish(unsigned int instance, const emu &chip, bool always = false);	//Emulator side. Only one thread at a time
+																					//per instance. See above.
+
+		unsigned long long framesSent() const { return sent; }
+		unsigned long long framesSkipped() const { return skipped; }	//Frames some viewer never got because it was behind
+
+	private:
+		struct viewer {
+			int socket;
+			std::string pending;				//Encoded but not taken by the socket yet
+			size_t pendingSent;
+			std::vector<uint64_t> shown;		//What it has for every instance, FRAME_STREAM_WORDS words each
+			std::vector<unsigned long long> shownNumber;
+		};
+
+		unsigned int instances;
+		tripleBuffer *frames;					//One per instance
+		std::vector<viewer *> viewers;
+		int listener;
+		std::string unixPath;					//To tidy away when we stop
+		std::thread server;
+		std::atomic<bool> running;
+		std::atomic<unsigned long long> sent;
+		std::atomic<unsigned long long> skipped;
+
+		void serve();
+		void accept();
+		void encode(viewer &v);
+		bool flush(viewer &v);					//False if the viewer's gone
+
+		frameServer(const frameServer &);
+		frameServer &operator=(const frameServer &);
+};
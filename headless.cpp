@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "chip8.h"
+#include "events.h"
+#include "framestream.h"
+#include "replay.h"
+#include "romcache.h"
+#include "profile.h"
+#include "quirks.h"
+#include "sound.h"
+#include "trace.h"
+#include "workpool.h"
+
+/*A driver with no screen at all. It reads a list of jobs, runs every one of them as its own emulator on a pool of worker threads, and
+ *reports what each one ended up doing. Handy for regression runs and for anything that wants a lot of emulators at once.
+ *
+ *The job file has one job per line, blank lines and lines starting with '#' are skipped:
+ *	ROMPATH CYCLES [INPUTSCRIPT]
+ *
+ *An input script presses and releases keys at given points in the run, one event per line:
+ *	CYCLE KEY STATE			e.g. "5000 A 1" presses key A once 5000 instructions have run, "6000 A 0" lets go of it
+ *
+ *The input script can also be a binary input log from replay.h. That brings its own platform, seed and instructions per tick with
+ *it, so the run it was recorded from plays back exactly.
+ *
+ *--platform chip8|schip|xochip runs every job with that platform's quirks (see quirks.h) instead of this emulator's defaults.
+ *
+ *Every job starts CXNN's random numbers from the same seed (1, or whatever --seed says), so running the same job file twice gives
+ *the same results.
+ *
+ *--stream PORT (or --stream unix:PATH) lets chip8-view, or anything else that speaks framestream.h, watch every instance while it runs.
+ *Each instance offers its screen at a timer tick whenever it has drawn something since it last sent one. Viewers that fall behind just
+ *miss frames, so watching never slows the run down.
+ *
+ *--wav PREFIX writes what each instance's buzzer played to PREFIX<instance>.wav, timed in emulated time (--ipt instructions are a
+ *sixtieth of a second). Bad opcodes, 0NNN and stack overflows are logged to stderr by a thread of their own, a few a second at most.
+ *
+ *--aot runs any ROM that chip8-aot compiled, and that was built in here, through its compiled code (see aot.h). ROMs without any are
+ *interpreted as usual.
+ *
+ *Built with -DCHIP8_PROFILE, --profile PREFIX writes each instance's profile (see profile.h) to PREFIX<instance>.txt as a report and
+ *PREFIX<instance>.prof as the raw histogram.
+ *
+ *Built with -DCHIP8_TRACE, --trace PREFIX records every instruction each instance runs (see trace.h) to PREFIX<instance>.trace. Compare
+ *two of them with chip8-tracediff.*/
+
+struct inputEvent {
+	unsigned long long cycle;
+	unsigned char key;
+	unsigned char state;
+};
+
+struct job {
+	std::string rom;
+	std::string inputScript;
+	unsigned long long budget;
+
+	//Filled in once the job has run
+	bool loaded;
+	unsigned long long cycles;
+	unsigned short pc;
+	unsigned long long frameHash;
+	double seconds;
+	size_t number;
+	const char *idle;					//What it was waiting on at the end, if anything. See emu::getIdle().
+};
+
+static bool eventBefore(const inputEvent &a, const inputEvent &b) {
+	return a.cycle < b.cycle;
+}
+
+static bool readInputScript(const std::string &path, std::vector<inputEvent> &events) {
+	FILE * pFile = fopen(path.c_str(), "r");
+	if(pFile == NULL) {
+		return false;
+	}
+
+	char line[256];
+	while(fgets(line, sizeof(line), pFile) != NULL) {
+		unsigned long long cycle;
+		unsigned int key, state;
+		if(line[0] == '#' || sscanf(line, "%llu %x %u", &cycle, &key, &state) != 3) {
+			continue;
+		}
+		inputEvent e = { cycle, (unsigned char)(key & 0xF), (unsigned char)(state != 0) };
+		events.push_back(e);
+	}
+	fclose(pFile);
+
+	std::stable_sort(events.begin(), events.end(), eventBefore);
+	return true;
+}
+
+static bool readJobs(const char *path, std::vector<job> &jobs) {
+	FILE * pFile = fopen(path, "r");
+	if(pFile == NULL) {
+		return false;
+	}
+
+	char line[1024];
+	while(fgets(line, sizeof(line), pFile) != NULL) {
+		char rom[512], script[512];
+		unsigned long long budget;
+		if(line[0] == '#') {
+			continue;
+		}
+		int fields = sscanf(line, "%511s %llu %511s", rom, &budget, script);
+		if(fields < 2) {
+			continue;
+		}
+
+		job j;
+		j.rom = rom;
+		j.budget = budget;
+		if(fields == 3) {
+			j.inputScript = script;
+		}
+		j.loaded = false;
+		j.cycles = 0;
+		j.pc = 0;
+		j.frameHash = 0;
+		j.seconds = 0;
+		j.number = jobs.size();
+		jobs.push_back(j);
+	}
+	fclose(pFile);
+	return true;
+}
+
+static unsigned long long hashWords(unsigned long long hash, const uint64_t *words, size_t count) {
+	const unsigned char *bytes = (const unsigned char *)words;
+	for(size_t i = 0; i < count * sizeof(uint64_t); i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+//FNV-1a over the framebuffer, so two runs can be compared without printing 2048 pixels each. Only what's on screen counts: the 32
+//rows of a 64x32 screen, or all of a 128x64 one, plus the second plane if anything has ever been drawn on it. That way a plain
+//CHIP-8 ROM hashes exactly the same as it did back when the screen was only ever 32 words.
+static unsigned long long hashFrame(const emu &chip) {
+	unsigned long long hash = 14695981039346656037ULL;
+	bool secondPlane = false;
+	for(int y = 0; y < 64; y++) {
+		secondPlane = secondPlane || chip.graphics[1][y][0] != 0 || chip.graphics[1][y][1] != 0;
+	}
+
+	for(int plane = 0; plane < (secondPlane ? 2 : 1); plane++) {
+		if(chip.isHires()) {
+			hash = hashWords(hash, &chip.graphics[plane][0][0], 64 * 2);
+		} else {
+			for(int y = 0; y < 32; y++) {
+				hash = hashWords(hash, &chip.graphics[plane][y][0], 1);
+			}
+		}
+	}
+	return hash;
+}
+
+//True if the file starts like an input log rather than a text script
+static bool isInputLog(const std::string &path) {
+	FILE * pFile = fopen(path.c_str(), "rb");
+	if(pFile == NULL) {
+		return false;
+	}
+	char magic[4];
+	bool isLog = fread(magic, 1, 4, pFile) == 4 && memcmp(magic, INPUT_LOG_MAGIC, 4) == 0;
+	fclose(pFile);
+	return isLog;
+}
+
+static frameServer *stream = NULL;		//Set by --stream
+static eventLogger *logger = NULL;		//Every instance's sound and diagnostics go through here
+
+#ifdef CHIP8_PROFILE
+static std::string profilePrefix;
+
+static void writeProfile(const job &j, const emu &chip) {
+	char number[32];
+	snprintf(number, sizeof(number), "%u", (unsigned int)j.number);
+	std::string base = profilePrefix + number;
+
+	FILE * pFile = fopen((base + ".txt").c_str(), "w");
+	if(pFile != NULL) {
+		fprintf(pFile, "%s\n\n", j.rom.c_str());
+		chip.getProfile().report(pFile, chip);
+		fclose(pFile);
+	}
+	pFile = fopen((base + ".prof").c_str(), "wb");
+	if(pFile != NULL) {
+		chip.getProfile().writeHistogram(pFile);
+		fclose(pFile);
+	}
+}
+#endif
+
+#ifdef CHIP8_TRACE
+static std::string tracePrefix;
+#endif
+
+static void runJob(job &j, romCache &roms, bool useJit, bool useAot, unsigned int instructionsPerTick, uint64_t seed, emuPlatform platform) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<inputEvent> events;
+	inputLog log;
+	bool replaying = !j.inputScript.empty() && isInputLog(j.inputScript);
+	if(replaying) {
+		FILE * pFile = fopen(j.inputScript.c_str(), "rb");
+		bool loaded = log.load(pFile);
+		fclose(pFile);
+		if(!loaded) {
+			fprintf(stderr, "Couldn't read input log %s\n", j.inputScript.c_str());
+			return;
+		}
+	}
+	else if(!j.inputScript.empty() && !readInputScript(j.inputScript, events)) {
+		fprintf(stderr, "Couldn't read input script %s\n", j.inputScript.c_str());
+		return;
+	}
+
+	//Job files tend to run the same ROM over and over, so every job gets its ROM from one shared cache instead of reading the file
+	const romImage *rom = roms.get(j.rom.c_str());
+	if(rom == NULL) {
+		return;
+	}
+
+	emu *chip = new emu;				//An emu is mostly its decode cache, which is a bit big for a worker's stack
+	chip->setPlatform(platform);
+	chip->setAot(useAot);				//Before loadRom(), which looks for compiled code that matches
+	chip->setEvents(&logger->queue((unsigned int)j.number));
+	if(!chip->loadRom(rom->data, rom->size)) {
+		delete chip;
+		return;
+	}
+	chip->setSeed(seed);
+	if(useJit) {
+		chip->setJit(true);
+	}
+
+#ifdef CHIP8_TRACE
+	traceWriter *trace = NULL;
+	if(!tracePrefix.empty()) {
+		char number[32];
+		snprintf(number, sizeof(number), "%u", (unsigned int)j.number);
+		std::string path = tracePrefix + number + ".trace";
+		trace = new traceWriter;
+		if(trace->open(path.c_str())) {
+			chip->setTrace(trace);
+		} else {
+			fprintf(stderr, "Couldn't write %s\n", path.c_str());
+			delete trace;
+			trace = NULL;
+		}
+	}
+#endif
+
+	if(replaying) {
+		log.replay(*chip, j.budget);
+	}
+
+	//Nobody's watching, so there's no sleeping between ticks here. Emulated time is just counted in instructions, and the timers tick
+	//every instructionsPerTick of them.
+	size_t nextEvent = 0;
+	unsigned long long nextTick = instructionsPerTick;
+	while(!replaying && chip->getCycles() < j.budget) {
+		while(nextEvent < events.size() && events[nextEvent].cycle <= chip->getCycles()) {
+			chip->input[events[nextEvent].key] = events[nextEvent].state;
+			nextEvent++;
+		}
+		//Run straight through to whichever comes first: the next timer tick, the next key change or the end
+		unsigned long long target = j.budget < nextTick ? j.budget : nextTick;
+		if(nextEvent < events.size() && events[nextEvent].cycle < target) {
+			target = events[nextEvent].cycle;
+		}
+		chip->runUntilCycle(target);
+		while(chip->getCycles() >= nextTick) {
+			chip->tickTimers();
+			nextTick += instructionsPerTick;
+		}
+		if(stream != NULL && chip->drawFlag && stream->publish((unsigned int)j.number, *chip)) {
+			chip->drawFlag = false;		//If the server was busy it stays set, and we offer the frame again next time round
+		}
+
+		//Waiting for a key that no event is ever going to press, or halted for good: from here on only the timers move. Park it.
+		//Tick the timers only as often as it takes them to get down to zero (each at its proper cycle, so the buzzer goes off when it
+		//should), then run out the budget in one go.
+		emu::idleState idle = chip->getIdle();
+		if((idle == emu::idleKey || idle == emu::idleHalted) && nextEvent == events.size()) {
+			for(int i = 0; i < 256 && nextTick <= j.budget; i++) {
+				chip->runUntilCycle(nextTick);
+				chip->tickTimers();
+				nextTick += instructionsPerTick;
+			}
+			chip->runUntilCycle(j.budget);
+			break;
+		}
+	}
+
+	if(stream != NULL && chip->drawFlag) {
+		stream->publish((unsigned int)j.number, *chip, true);	//However it finished, viewers get to see the last frame
+	}
+
+	static const char *const idleNames[] = { "no", "timer", "key", "halted" };
+	j.idle = idleNames[chip->getIdle()];
+
+	j.loaded = true;
+	j.cycles = chip->getCycles();
+	j.pc = chip->getPc();
+	j.frameHash = hashFrame(*chip);
+	j.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+#ifdef CHIP8_PROFILE
+	if(!profilePrefix.empty()) {
+		writeProfile(j, *chip);
+	}
+#endif
+#ifdef CHIP8_TRACE
+	if(trace != NULL) {
+		chip->setTrace(NULL);
+		trace->close();
+		if(trace->failed()) {
+			fprintf(stderr, "instance %u: ran out of room for the trace, so it stops early\n", (unsigned int)j.number);
+		}
+		delete trace;
+	}
+#endif
+	delete chip;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *jobFile = NULL;
+	unsigned int threads = 0;
+	unsigned int instructionsPerTick = 10;
+	bool useJit = false;
+	bool useAot = false;
+	uint64_t seed = 1;
+	emuPlatform platform = platformDefault;
+	const char *streamAddress = NULL;
+	const char *wavPrefix = NULL;
+
+	for(int i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = (unsigned int)atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--ipt") == 0 && i + 1 < argc) {
+			instructionsPerTick = (unsigned int)atoi(argv[++i]);
+			if(instructionsPerTick == 0) {
+				instructionsPerTick = 1;
+			}
+		} else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 0);
+		} else if(strcmp(argv[i], "--platform") == 0 && i + 1 < argc) {
+			if(!platformNamed(argv[++i], platform)) {
+				printf("Unknown platform %s (try chip8, schip or xochip)\n", argv[i]);
+				return 1;
+			}
+		} else if(strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+			streamAddress = argv[++i];
+		} else if(strcmp(argv[i], "--wav") == 0 && i + 1 < argc) {
+			wavPrefix = argv[++i];
+#ifdef CHIP8_PROFILE
+		} else if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+			profilePrefix = argv[++i];
+#endif
+#ifdef CHIP8_TRACE
+		} else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			tracePrefix = argv[++i];
+#endif
+		} else if(strcmp(argv[i], "--jit") == 0) {
+			useJit = true;
+		} else if(strcmp(argv[i], "--aot") == 0) {
+			useAot = true;
+		} else {
+			jobFile = argv[i];
+		}
+	}
+
+	if(jobFile == NULL) {
+		printf("Usage: chip8-headless [--threads N] [--ipt INSTRUCTIONS_PER_TICK] [--seed N] [--platform NAME] [--stream PORT|unix:PATH] [--wav PREFIX] [--jit] [--aot] JOBFILE\n");
+		return 1;
+	}
+
+	std::vector<job> jobs;
+	if(!readJobs(jobFile, jobs)) {
+		printf("Couldn't read job file %s\n", jobFile);
+		return 1;
+	}
+
+	if(streamAddress != NULL) {
+		stream = new frameServer((unsigned int)jobs.size());
+		if(!stream->listen(streamAddress)) {
+			return 1;
+		}
+	}
+
+	//Sound goes nowhere unless --wav asks for it, in which case every instance gets a file of its own
+	logger = new eventLogger((unsigned int)jobs.size());
+	std::vector<wavSink *> wavs;
+	std::vector<squareWave *> waves;
+	if(wavPrefix != NULL) {
+		for(size_t i = 0; i < jobs.size(); i++) {
+			char path[1024];
+			snprintf(path, sizeof(path), "%s%u.wav", wavPrefix, (unsigned int)i);
+			wavSink *wav = new wavSink;
+			if(!wav->open(path, 44100)) {
+				fprintf(stderr, "Couldn't write %s\n", path);
+			}
+			wavs.push_back(wav);
+			waves.push_back(new squareWave(*wav, instructionsPerTick * 60.0));
+			logger->setSound((unsigned int)i, waves.back());
+		}
+	}
+	logger->start();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	unsigned int poolSize;
+	romCache roms;
+	{
+		workPool pool(threads);
+		poolSize = pool.size();
+		for(size_t i = 0; i < jobs.size(); i++) {
+			job *j = &jobs[i];
+			romCache *cache = &roms;
+			pool.submit([j, cache, useJit, useAot, instructionsPerTick, seed, platform]() {
+				runJob(*j, *cache, useJit, useAot, instructionsPerTick, seed, platform);
+			});
+		}
+		pool.wait();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	logger->stop();
+	for(size_t i = 0; i < waves.size(); i++) {
+		delete waves[i];						//Each file ends where its buzzer last went off. Padding out the silence after that
+		delete wavs[i];							//to the end of a long run could take gigabytes.
+	}
+
+	unsigned long long total = 0;
+	int failed = 0;
+	for(size_t i = 0; i < jobs.size(); i++) {
+		const job &j = jobs[i];
+		if(!j.loaded) {
+			printf("instance %u: %s FAILED\n", (unsigned int)i, j.rom.c_str());
+			failed++;
+			continue;
+		}
+		printf("instance %u: %s ok cycles=%llu pc=0x%03X frame=%016llx time=%.3fs idle=%s\n",
+			(unsigned int)i, j.rom.c_str(), j.cycles, j.pc, j.frameHash, j.seconds, j.idle);
+		total += j.cycles;
+	}
+
+	printf("total: %u instances (%d failed), %llu instructions in %.3fs on %u threads, %.0f instructions/sec\n",
+		(unsigned int)jobs.size(), failed, total, seconds, poolSize, seconds > 0 ? total / seconds : 0.0);
+
+	if(stream != NULL) {
+		stream->stop();
+		printf("streamed %llu frames, %llu skipped for viewers that were behind\n", stream->framesSent(), stream->framesSkipped());
+		delete stream;
+	}
+	if(logger->eventsSuppressed() > 0 || logger->eventsDropped() > 0) {
+		printf("events: %llu logged, %llu over the rate limit, %llu dropped because the logger was behind\n",
+			logger->eventsLogged(), logger->eventsSuppressed(), logger->eventsDropped());
+	}
+	delete logger;
+
+	return failed == 0 ? 0 : 1;
+}
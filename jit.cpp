@@ -0,0 +1,422 @@
+#include "chip8.h"
+#include "jit.h"
+#include "quirks.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_X64
+#endif
+
+#ifdef JIT_X64
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+//Marks an address we already tried to compile and couldn't, so we don't keep trying every time we get there.
+static unsigned char noBlock;
+
+jitCompiler::jitCompiler(emu &chip) : chip(chip) {
+	code = NULL;
+	codeUsed = codeBase = exitOffset = 0;
+	enter = NULL;
+	patchCount = 0;
+
+	//Compiled code reaches into the emu object with fixed offsets, so work those out once here.
+	regOffset = (int)((unsigned char *)chip.registers - (unsigned char *)&chip);
+	indexOffset = (int)((unsigned char *)&chip.index - (unsigned char *)&chip);
+	pcOffset = (int)((unsigned char *)&chip.pc - (unsigned char *)&chip);
+
+#ifdef JIT_X64
+#ifdef _WIN32
+	code = (unsigned char *)VirtualAlloc(NULL, CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	void *memory = mmap(NULL, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	code = (memory == MAP_FAILED) ? NULL : (unsigned char *)memory;
+#endif
+	if(code != NULL) {
+		emitEntryExit();
+	}
+#endif
+
+	flush();
+}
+
+jitCompiler::~jitCompiler() {
+#ifdef JIT_X64
+	if(code != NULL) {
+#ifdef _WIN32
+		VirtualFree(code, 0, MEM_RELEASE);
+#else
+		munmap(code, CODE_SIZE);
+#endif
+	}
+#endif
+}
+
+bool jitCompiler::ready() const {
+	return code != NULL;
+}
+
+void jitCompiler::flush() {
+	codeUsed = codeBase;
+	patchCount = 0;
+	for(int i = 0; i < 4096; i++) {
+		blocks[i] = NULL;
+		isCode[i] = false;
+	}
+}
+
+void jitCompiler::invalidate(unsigned short address) {
+	//Blocks jump straight into each other, so picking one out of the middle would mean unpicking every jump into it. Self-modifying
+	//code is rare enough that just starting over is the simpler choice.
+	if(isCode[address & 0x0FFF]) {
+		flush();
+	}
+}
+
+unsigned long jitCompiler::run(long budget) {
+	if(code == NULL) {
+		return 0;
+	}
+
+	unsigned short address = chip.pc & 0x0FFF;
+	unsigned char *block = blocks[address];
+	if(block == NULL) {
+		block = compile(address);
+	}
+	if(block == &noBlock) {
+		return 0;
+	}
+
+	chip.pc = address;
+	return enter(&chip, budget, block);
+}
+
+/*Everything below is the x86-64 code generator. Each emit function just appends raw machine code bytes to the buffer. If you want to
+ *follow along, the Intel manual's opcode tables are the thing to look at. All of the V registers are addressed as [rdi + disp32], which
+ *in the ModRM byte is mod=10, rm=111, with the other register (al=0, cl=1) or the opcode extension in the middle three bits.*/
+
+void jitCompiler::emit8(unsigned char value) {
+	code[codeUsed++] = value;
+}
+
+void jitCompiler::emit16(unsigned short value) {
+	emit8(value & 0xFF);
+	emit8(value >> 8);
+}
+
+void jitCompiler::emit32(unsigned int value) {
+	emit16(value & 0xFFFF);
+	emit16(value >> 16);
+}
+
+void jitCompiler::emitReg(unsigned char op, unsigned char reg, unsigned char vReg) {
+	emit8(op);
+	emit8(0x80 | (reg << 3) | 7);
+	emit32(regOffset + vReg);
+}
+
+void jitCompiler::emitVfReset(const quirkFlags &quirks) {
+	if(quirks.vfReset) {
+		emitReg(0xC6, 0, 0xF); emit8(0);					//mov byte [VF], 0
+	}
+}
+
+void jitCompiler::patchJump(unsigned int offset, unsigned int destination) {
+	unsigned int rel = destination - (offset + 4);
+	memcpy(code + offset, &rel, 4);
+}
+
+void jitCompiler::emitEntryExit() {
+	//ENTRY: enter(chip, budget, block). Get the arguments into the registers described in jit.h, load the index register and go.
+#ifdef _WIN32
+	emit8(0x57);											//push rdi				(rdi and rsi belong to the caller on Windows)
+	emit8(0x56);											//push rsi
+	emit8(0x48); emit8(0x89); emit8(0xCF);					//mov rdi, rcx
+	emit8(0x48); emit8(0x89); emit8(0xD6);					//mov rsi, rdx
+	emit8(0x4C); emit8(0x89); emit8(0xC2);					//mov rdx, r8
+#endif
+	emit8(0x44); emit8(0x0F); emit8(0xB7); emit8(0x87);		//movzx r8d, word [rdi + index]
+	emit32(indexOffset);
+	emit8(0x45); emit8(0x31); emit8(0xC9);					//xor r9d, r9d
+	emit8(0xFF); emit8(0xE2);								//jmp rdx
+
+	//EXIT: every block that wants to go back to the interpreter ends up here. Store the index register back and return the count.
+	exitOffset = codeUsed;
+	emit8(0x66); emit8(0x44); emit8(0x89); emit8(0x87);		//mov word [rdi + index], r8w
+	emit32(indexOffset);
+	emit8(0x4C); emit8(0x89); emit8(0xC8);					//mov rax, r9
+#ifdef _WIN32
+	emit8(0x5E);											//pop rsi
+	emit8(0x5F);											//pop rdi
+#endif
+	emit8(0xC3);											//ret
+
+	codeBase = codeUsed;
+	enter = (entryFunc)(void *)code;
+}
+
+//Leaving a block: set the pc, then jump to wherever that pc lives. If it's already compiled we go straight there (block chaining),
+//otherwise we go back to the interpreter and remember this jump so compile() can point it at the new block later.
+void jitCompiler::emitExit(unsigned short target) {
+	emit8(0x66); emit8(0xC7); emit8(0x87);					//mov word [rdi + pc], target
+	emit32(pcOffset);
+	emit16(target);
+
+	emit8(0xE9);											//jmp rel32
+	unsigned int offset = codeUsed;
+	emit32(0);
+
+	unsigned char *block = blocks[target & 0x0FFF];
+	if(block != NULL && block != &noBlock) {
+		patchJump(offset, (unsigned int)(block - code));
+	} else {
+		patchJump(offset, exitOffset);
+		if(block == NULL && patchCount < MAX_PATCHES) {
+			patches[patchCount].target = target & 0x0FFF;
+			patches[patchCount].offset = offset;
+			patchCount++;
+		}
+	}
+}
+
+//Straight-line opcodes. Returns false for anything we don't compile, which ends the block. The arithmetic opcodes write VF last,
+//exactly like the interpreter's handlers, so X or Y being F behaves the same either way. The platform's quirks are settled here, while
+//compiling, so the code we emit is just as specialized as the interpreter's handlers.
+bool jitCompiler::emitOp(unsigned short opcode, const quirkFlags &quirks) {
+	unsigned char x = (opcode & 0x0F00) >> 8;
+	unsigned char y = (opcode & 0x00F0) >> 4;
+	unsigned char nn = opcode & 0x00FF;
+
+	switch(opcode & 0xF000)
+	{
+		case(0x6000):
+			emitReg(0xC6, 0, x); emit8(nn);					//mov byte [VX], NN
+			return true;
+
+		case(0x7000):
+			emitReg(0x80, 0, x); emit8(nn);					//add byte [VX], NN
+			return true;
+
+		case(0x8000):
+			switch(opcode & 0x000F)
+			{
+				case(0x0000):
+					emitReg(0x8A, 0, y);					//mov al, [VY]
+					emitReg(0x88, 0, x);					//mov [VX], al
+					return true;
+				case(0x0001):
+					emitReg(0x8A, 0, y);					//mov al, [VY]
+					emitReg(0x08, 0, x);					//or [VX], al
+					emitVfReset(quirks);
+					return true;
+				case(0x0002):
+					emitReg(0x8A, 0, y);					//mov al, [VY]
+					emitReg(0x20, 0, x);					//and [VX], al
+					emitVfReset(quirks);
+					return true;
+				case(0x0003):
+					emitReg(0x8A, 0, y);					//mov al, [VY]
+					emitReg(0x30, 0, x);					//xor [VX], al
+					emitVfReset(quirks);
+					return true;
+				case(0x0004):
+					emitReg(0x8A, 0, y);					//mov al, [VY]
+					emitReg(0x00, 0, x);					//add [VX], al
+					emit8(0x0F); emit8(0x92); emit8(0xC1);	//setc cl
+					emitReg(0x88, 1, 0xF);					//mov [VF], cl
+					return true;
+				case(0x0005):
+					emitReg(0x8A, 0, y);					//mov al, [VY]
+					emitReg(0x28, 0, x);					//sub [VX], al
+					emit8(0x0F); emit8(0x93); emit8(0xC1);	//setnc cl
+					emitReg(0x88, 1, 0xF);					//mov [VF], cl
+					return true;
+				case(0x0006):
+					if(quirks.shiftVy) {
+						emitReg(0x8A, 0, y);				//mov al, [VY]
+						emit8(0xD0); emit8(0xE8);			//shr al, 1
+						emit8(0x0F); emit8(0x92); emit8(0xC1);	//setc cl
+						emitReg(0x88, 0, x);				//mov [VX], al
+					} else {
+						emitReg(0xD0, 5, x);				//shr byte [VX], 1
+						emit8(0x0F); emit8(0x92); emit8(0xC1);	//setc cl
+					}
+					emitReg(0x88, 1, 0xF);					//mov [VF], cl
+					return true;
+				case(0x0007):
+					emitReg(0x8A, 0, y);					//mov al, [VY]
+					emitReg(0x2A, 0, x);					//sub al, [VX]
+					emit8(0x0F); emit8(0x93); emit8(0xC1);	//setnc cl
+					emitReg(0x88, 0, x);					//mov [VX], al
+					emitReg(0x88, 1, 0xF);					//mov [VF], cl
+					return true;
+				case(0x000E):
+					if(quirks.shiftVy) {
+						emitReg(0x8A, 0, y);				//mov al, [VY]
+						emit8(0xD0); emit8(0xE0);			//shl al, 1
+						emit8(0x0F); emit8(0x92); emit8(0xC1);	//setc cl
+						emitReg(0x88, 0, x);				//mov [VX], al
+					} else {
+						emitReg(0xD0, 4, x);				//shl byte [VX], 1
+						emit8(0x0F); emit8(0x92); emit8(0xC1);	//setc cl
+					}
+					emitReg(0x88, 1, 0xF);					//mov [VF], cl
+					return true;
+			}
+			return false;
+
+		case(0xA000):
+			emit8(0x41); emit8(0xB8);						//mov r8d, NNN
+			emit32(opcode & 0x0FFF);
+			return true;
+
+		case(0xF000):
+			switch(opcode & 0x00FF)
+			{
+				case(0x001E):
+					emit8(0x0F); emitReg(0xB6, 0, x);		//movzx eax, byte [VX]
+					emit8(0x41); emit8(0x01); emit8(0xC0);	//add r8d, eax
+					emit8(0x41); emit8(0x81); emit8(0xE0);	//and r8d, 0xFFFF
+					emit32(0xFFFF);
+					return true;
+				case(0x0029):
+					emit8(0x0F); emitReg(0xB6, 0, x);		//movzx eax, byte [VX]
+					emit8(0x44); emit8(0x8D); emit8(0x04); emit8(0x80);	//lea r8d, [rax + rax*4]
+					return true;
+			}
+			return false;
+	}
+
+	return false;
+}
+
+unsigned char *jitCompiler::compile(unsigned short address) {
+	//Make sure there's room for the biggest block we could possibly emit, otherwise start the buffer over.
+	if(codeUsed + MAX_BLOCK * 32 + 64 > CODE_SIZE) {
+		flush();
+	}
+
+	unsigned int start = codeUsed;
+	quirkFlags quirks = quirksFor(chip.platform);
+
+	//Budget check on the way in: if what's left won't cover the whole block, go back to the interpreter with the pc still pointing at
+	//this block. It runs the last few one at a time, so a run stops on exactly the instruction it was asked to, just as it would have
+	//without the JIT.
+	emit8(0x48); emit8(0x81); emit8(0xFE);					//cmp rsi, count
+	unsigned int cmpCount = codeUsed;
+	emit32(0);
+	emit8(0x0F); emit8(0x8C);								//jl exit
+	unsigned int budgetJump = codeUsed;
+	emit32(0);
+	patchJump(budgetJump, exitOffset);
+
+	emit8(0x48); emit8(0x81); emit8(0xEE);					//sub rsi, count
+	unsigned int subCount = codeUsed;
+	emit32(0);
+	emit8(0x49); emit8(0x81); emit8(0xC1);					//add r9, count
+	unsigned int addCount = codeUsed;
+	emit32(0);
+
+	unsigned short pc = address;
+	unsigned int count = 0;
+	bool ended = false;
+
+	while(count < MAX_BLOCK && pc < 0x0FFF && !ended)
+	{
+		unsigned short opcode = chip.mem[pc] << 8 | chip.mem[pc + 1];
+		unsigned char x = (opcode & 0x0F00) >> 8;
+		unsigned char y = (opcode & 0x00F0) >> 4;
+		unsigned char nn = opcode & 0x00FF;
+
+		if(emitOp(opcode, quirks)) {
+			isCode[pc] = isCode[pc + 1] = true;
+			count++;
+			pc += 2;
+			continue;
+		}
+
+		//Not a straight-line opcode. A jump or a skip still gets compiled, as the last thing in the block. Anything else gets left
+		//for the interpreter, and the block just ends in front of it.
+		unsigned char jcc = 0;
+		switch(opcode & 0xF000)
+		{
+			case(0x1000):
+				if((opcode & 0x0FFF) == pc) {
+					break;									//Jumping to itself: the interpreter fast-forwards over those, see emu::getIdle()
+				}
+				isCode[pc] = isCode[pc + 1] = true;
+				count++;
+				emitExit(opcode & 0x0FFF);
+				ended = true;
+				break;
+			case(0x3000):
+				emitReg(0x80, 7, x); emit8(nn);				//cmp byte [VX], NN
+				jcc = 0x84;									//je = skip
+				break;
+			case(0x4000):
+				emitReg(0x80, 7, x); emit8(nn);				//cmp byte [VX], NN
+				jcc = 0x85;									//jne = skip
+				break;
+			case(0x5000):
+				if((opcode & 0x000F) == 0) {
+					emitReg(0x8A, 0, y);					//mov al, [VY]
+					emitReg(0x38, 0, x);					//cmp [VX], al
+					jcc = 0x84;
+				}
+				break;
+			case(0x9000):
+				if((opcode & 0x000F) == 0) {
+					emitReg(0x8A, 0, y);					//mov al, [VY]
+					emitReg(0x38, 0, x);					//cmp [VX], al
+					jcc = 0x85;
+				}
+				break;
+		}
+
+		if(jcc != 0) {
+			isCode[pc] = isCode[pc + 1] = true;
+			count++;
+			emit8(0x0F); emit8(jcc);						//jcc skip
+			unsigned int skipJump = codeUsed;
+			emit32(0);
+			emitExit(pc + 2);
+			patchJump(skipJump, codeUsed);
+			emitExit(pc + 4);
+			ended = true;
+		}
+		break;
+	}
+
+	if(count == 0) {
+		//Couldn't compile even one opcode here. Give the space back and remember not to try again.
+		codeUsed = start;
+		blocks[address] = &noBlock;
+		return &noBlock;
+	}
+
+	if(!ended) {
+		emitExit(pc);										//Ran into something for the interpreter. Fall through to it.
+	}
+
+	memcpy(code + cmpCount, &count, 4);
+	memcpy(code + subCount, &count, 4);
+	memcpy(code + addCount, &count, 4);
+	blocks[address] = code + start;
+
+	//Anyone who was waiting on this address can now jump straight here.
+	for(unsigned int i = 0; i < patchCount; ) {
+		if(patches[i].target == address) {
+			patchJump(patches[i].offset, start);
+			patches[i] = patches[--patchCount];
+		} else {
+			i++;
+		}
+	}
+
+	return code + start;
+}
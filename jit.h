@@ -0,0 +1,72 @@
+/*A small basic-block JIT for x86-64. Instead of decoding and dispatching one opcode at a time, we look at a whole run of simple opcodes
+ *starting at the program counter, translate all of them into native machine code once, and then just call that code every time the
+ *program comes back to the same address. It only ever handles the opcodes that touch registers and the index register. Anything that
+ *touches memory, the screen, the stack, the timers or the keyboard ends the block and is left to the interpreter.
+ *
+ *While compiled code runs, the emulator lives in host registers:
+ *	rdi - pointer to the emu being run (the CHIP-8 registers V0-VF are addressed off this)
+ *	rsi - remaining instruction budget
+ *	r8  - the index register
+ *	r9  - how many CHIP-8 instructions we've executed so far
+ *and the program counter only gets written back when a block exits.*/
+
+class emu;
+struct quirkFlags;
+
+class jitCompiler {
+	public:
+		jitCompiler(emu &chip);
+		~jitCompiler();
+
+		bool ready() const;						//False if this host can't run the JIT (not x86-64, or no executable memory)
+
+		unsigned long run(long budget);			//Runs compiled blocks starting at the current pc for as long as whole blocks fit in
+												//`budget` and we don't reach code we can't compile. Never runs more than `budget`. Returns
+												//how many instructions were executed, so 0 means "the interpreter has to do this one".
+
+		void invalidate(unsigned short address);//Called whenever emulated memory is written. Throws away compiled code if it covered it.
+		void flush();							//Throws away all compiled code
+
+	private:
+		typedef unsigned long (*entryFunc)(emu *chip, long budget, unsigned char *block);
+
+		enum {
+			CODE_SIZE = 1024 * 1024,			//How much executable memory we grab for compiled blocks
+			MAX_BLOCK = 128,					//Longest run of CHIP-8 opcodes we'll put in one block
+			MAX_PATCHES = 8192					//How many block exits we'll remember for chaining
+		};
+
+		struct patch {
+			unsigned short target;				//The CHIP-8 address this exit wants to go to
+			unsigned int offset;				//Where its jump's rel32 lives in the code buffer
+		};
+
+		emu &chip;
+
+		unsigned char *code;					//Executable memory
+		unsigned int codeUsed;					//How much of it is taken
+		unsigned int codeBase;					//Where compiled blocks start (everything before is the entry/exit code)
+		unsigned int exitOffset;				//Where the shared "return to the interpreter" code lives
+		entryFunc enter;
+
+		unsigned char *blocks[4096];			//Native entry point for each CHIP-8 address, NULL if not compiled yet
+		bool isCode[4096];						//Which bytes of emulated memory have been compiled into some block
+		patch patches[MAX_PATCHES];				//Block exits still jumping back to the interpreter, waiting for their target to get compiled
+		unsigned int patchCount;
+
+		int regOffset;							//Where things live inside the emu object, so compiled code can reach them off rdi
+		int indexOffset;
+		int pcOffset;
+
+		unsigned char *compile(unsigned short address);
+		void emitEntryExit();
+		void emitExit(unsigned short target);
+		bool emitOp(unsigned short opcode, const quirkFlags &quirks);
+
+		void emit8(unsigned char value);
+		void emit16(unsigned short value);
+		void emit32(unsigned int value);
+		void emitReg(unsigned char op, unsigned char reg, unsigned char vReg);
+		void emitVfReset(const quirkFlags &quirks);	//mov byte [VF], 0 on platforms where 8XY1/8XY2/8XY3 clear it
+		void patchJump(unsigned int offset, unsigned int destination);
+};
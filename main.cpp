@@ -1,6 +1,22 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <signal.h>
+#include "termrender.h"
+#endif
 #include "chip8.h"
+#include "events.h"
+#include "scheduler.h"
+#include "sound.h"
+#include "triplebuffer.h"
+#include "profile.h"
+#include "quirks.h"
 
 // //SDL screen constants
 //
@@ -15,14 +31,98 @@
 /Trying to use Javidx9's console rendering techniques...
 /**********************/
 
-int nScreenWidth = 64;
-int nScreenHeight = 32;
+#ifdef _WIN32
+int nScreenWidth = 128;
+int nScreenHeight = 64;
+#endif
 
 int pitch = 0;
 void* pixels = NULL;
 
 emu chip8;
 
+/*Drawing happens on its own thread, so a slow console or terminal never holds up the emulator. The emulator thread copies the
+ *screen into `frames` whenever something was drawn, and the render thread picks up whatever the newest frame is at its own pace.*/
+tripleBuffer frames;
+std::atomic<bool> rendering(true);
+
+//Emulator side: if the last tick drew anything, hand a copy of the screen over to the render thread
+static void publishFrame()
+{
+	if(chip8.drawFlag)
+	{
+		frame &next = frames.writeBuffer();
+		memcpy(next.planes, chip8.graphics, sizeof(chip8.graphics));
+		next.hires = chip8.isHires();
+		frames.publish();
+		chip8.drawFlag = false;
+	}
+}
+
+/*Turbo mode (--turbo) runs the emulator as fast as the host will go instead of 60 ticks a second. Ticks run TURBO_BATCH at a time
+ *between looks at the outside world, and only every renderEvery-th one gets handed to the renderer (--render-every N, 0 for never).
+ *The render thread still only draws 60 times a second whatever we publish, so the console or terminal never holds us up.*/
+#define TURBO_BATCH 64
+
+static bool turbo = false;
+static unsigned int renderEvery = 1;
+
+static void runTurboBatch(frameScheduler &scheduler)
+{
+	for(int i = 0; i < TURBO_BATCH; i++)
+	{
+		scheduler.runTick(chip8);
+
+		//drawFlag stays set through the ticks we skip, so whatever they drew still goes out with the next one we publish
+		if(renderEvery != 0 && scheduler.getFrame() % renderEvery == 0)
+		{
+			publishFrame();
+		}
+	}
+}
+
+/*The buzzer and anything the ROM does wrong come out of the emulator as events (see events.h), and the logger's own thread deals with
+ *them so the emulator never waits on the console. --wav FILE records the buzzer, in emulated time; otherwise nobody hears it.*/
+eventLogger logger(1);
+static wavSink wav;
+static nullSink silence;
+static squareWave *buzzer = NULL;
+
+static void startEvents(const char *wavPath, unsigned int instructionsPerTick)
+{
+	soundSink *sink = &silence;
+	if(wavPath != NULL)
+	{
+		if(wav.open(wavPath, 44100))
+			sink = &wav;
+		else
+			fprintf(stderr, "Couldn't write %s\n", wavPath);
+	}
+	buzzer = new squareWave(*sink, instructionsPerTick * 60.0);
+	logger.setSound(0, buzzer);
+	chip8.setEvents(&logger.queue(0));
+	logger.start();
+}
+
+static void stopEvents()
+{
+	logger.stop();
+	buzzer->finish(chip8.getCycles());
+	wav.close();
+}
+
+//Render side: sleep until the next display refresh. There's no point looking for new frames faster than 60 a second.
+static void waitForRefresh(std::chrono::steady_clock::time_point &next)
+{
+	next += std::chrono::microseconds(1000000 / 60);
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(next < now) {
+		next = now;			//Fell behind (the window was dragged, the terminal was stuck). Don't try to catch up.
+	}
+	std::this_thread::sleep_until(next);
+}
+
 // bool init()
 // {
 // 	if(SDL_Init(SDL_INIT_VIDEO) < 0)
@@ -44,7 +144,7 @@ emu chip8;
 // {
 // 	for(int i = 0; i < 2048; i++)
 // 	{
-// 		if(chip8.graphics[i] == 1)
+// 		if(chip8.getPixel(i % 64, i / 64) == 1)
 // 		{
 // 			screenBuffer[(i*4)] = 255;
 // 			screenBuffer[(i*4)+1] = 255;
@@ -81,26 +181,84 @@ emu chip8;
 // 	SDL_RenderPresent(renderer);
 // }
 
+#ifdef _WIN32
+static void renderThread(HANDLE hConsole)
+{
+	wchar_t *screen = new wchar_t[nScreenWidth*nScreenHeight];
+	DWORD dwBytesWritten = 0;
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+
+	while(rendering)
+	{
+		if(frames.fetch())
+		{
+			//The console is always 128x64. A 64x32 picture gets every pixel drawn twice each way to fill it.
+			const frame &shown = frames.readBuffer();
+			int scale = shown.hires ? 1 : 2;
+			for(int y = 0; y < nScreenHeight; y++)
+			{
+				for(int x = 0; x < nScreenWidth; x++)
+				{
+					int px = x / scale, py = y / scale;
+					uint64_t word = shown.planes[0][py][px >> 6] | shown.planes[1][py][px >> 6];
+					screen[(y * nScreenWidth) + x] = ((word >> (63 - (px & 63))) & 1) ? 0x2588 : ' ';
+				}
+			}
+			WriteConsoleOutputCharacterW(hConsole, screen, nScreenWidth * nScreenHeight, {0, 0}, &dwBytesWritten);
+		}
+		waitForRefresh(next);
+	}
+	delete[] screen;
+}
+
 int wmain(int argc, wchar_t *argv[], wchar_t **envp)
 {
 	if(argc < 2)
 	{
-		printf("Usage: emu ROMPATH\n");
+		printf("Usage: emu ROMPATH [INSTRUCTIONS_PER_TICK] [--turbo] [--render-every N] [--platform chip8|schip|xochip] [--wav FILE]\n");
 		return 1;
 	}
 
+	//How many instructions to run for every 60hz timer tick. 10 gives about 600 instructions a second, which most games are happy with.
+	unsigned int instructionsPerTick = 10;
+	emuPlatform platform = platformDefault;
+	char wavPath[1024] = {0};
+	for(int i = 2; i < argc; i++)
+	{
+		if(wcscmp(argv[i], L"--turbo") == 0)
+			turbo = true;
+		else if(wcscmp(argv[i], L"--wav") == 0 && i + 1 < argc)
+			wcstombs(wavPath, argv[++i], sizeof(wavPath) - 1);
+		else if(wcscmp(argv[i], L"--render-every") == 0 && i + 1 < argc)
+			renderEvery = _wtoi(argv[++i]);
+		else if(wcscmp(argv[i], L"--platform") == 0 && i + 1 < argc)
+		{
+			char name[16] = {0};
+			wcstombs(name, argv[++i], sizeof(name) - 1);
+			if(!platformNamed(name, platform))
+			{
+				printf("Unknown platform %s\n", name);
+				return 1;
+			}
+		}
+		else
+			instructionsPerTick = _wtoi(argv[i]);
+	}
+	frameScheduler scheduler(instructionsPerTick);
+	chip8.setPlatform(platform);
+
 	if(!chip8.loadRom(argv[1]))
 	{
 		printf("Ya failed.\n");
 		return 1;
 	}
+	startEvents(wavPath[0] != 0 ? wavPath : NULL, instructionsPerTick);
 
 	//Create console screen buffer
 
-	wchar_t *screen = new wchar_t[nScreenWidth*nScreenHeight];
 	HANDLE hConsole = CreateConsoleScreenBuffer(GENERIC_READ | GENERIC_WRITE, 0, NULL, CONSOLE_TEXTMODE_BUFFER, NULL);
 	SetConsoleActiveScreenBuffer(hConsole);
-	DWORD dwBytesWritten = 0;
+	std::thread renderer(renderThread, hConsole);
 
 	// init();
 	// SDL_Window* window = SDL_CreateWindow("Chip8 by Aerosol", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_RESIZABLE);
@@ -127,9 +285,6 @@ int wmain(int argc, wchar_t *argv[], wchar_t **envp)
 
 	while(1)
 	{
-		short pixel = ' ';
-		screen[nScreenWidth * nScreenHeight - 1] = '\0';
-		WriteConsoleOutputCharacterW(hConsole, screen, nScreenWidth * nScreenHeight, {0, 0}, &dwBytesWritten);
 		// while(SDL_PollEvent(&e) != 0)
 		// {
 		// 	if(e.type == SDL_QUIT)
@@ -149,19 +304,16 @@ int wmain(int argc, wchar_t *argv[], wchar_t **envp)
 			updateTexture(texture);
 			display(renderer, texture);*/
 
-
-			chip8.emuCycle();
-			chip8.debugRender();
-			for(int x = 0; x < nScreenWidth; x++)
+			if(turbo)
 			{
-				for(int y = 0; y < nScreenHeight; y++)
-				{
-					if(chip8.graphics[(y*64) + x] == 0)
-						pixel = 0x2588 ;
-					else
-						pixel = ' ';
-				}
+				runTurboBatch(scheduler);
+				continue;
 			}
+
+			scheduler.runTick(chip8);
+
+			//Only publish when something was actually drawn. Most ticks don't touch the screen at all.
+			publishFrame();
 			// if(chip8.drawFlag)
 			// {
 			// 	copyToBuffer();
@@ -178,7 +330,110 @@ int wmain(int argc, wchar_t *argv[], wchar_t **envp)
 			// 	chip8.drawFlag = false;
 			// }
 		// }
+
+		scheduler.waitForNextTick();		//Sleep until the next tick's due instead of spinning flat out
 	}
 	// close(window, texture, renderer);
+	rendering = false;
+	renderer.join();
+	stopEvents();
+	return 0;
+}
+#else
+//Everywhere else, draw in the terminal with termRenderer.
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int)
+{
+	running = 0;		//Ctrl-C lands here. Leave the loop so the renderer can give the terminal its cursor back.
+}
+
+static void renderThread()
+{
+	termRenderer screen;
+	screen.begin();
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+
+	while(rendering)
+	{
+		if(frames.fetch()) {
+			screen.draw(frames.readBuffer().planes, frames.readBuffer().hires);
+		}
+		waitForRefresh(next);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc < 2)
+	{
+		printf("Usage: emu ROMPATH [INSTRUCTIONS_PER_TICK] [--turbo] [--render-every N] [--platform chip8|schip|xochip] [--wav FILE]\n");
+		return 1;
+	}
+
+	unsigned int instructionsPerTick = 10;
+	emuPlatform platform = platformDefault;
+	const char *wavPath = NULL;
+	for(int i = 2; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--turbo") == 0)
+			turbo = true;
+		else if(strcmp(argv[i], "--wav") == 0 && i + 1 < argc)
+			wavPath = argv[++i];
+		else if(strcmp(argv[i], "--render-every") == 0 && i + 1 < argc)
+			renderEvery = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--platform") == 0 && i + 1 < argc)
+		{
+			if(!platformNamed(argv[++i], platform))
+			{
+				printf("Unknown platform %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else
+			instructionsPerTick = atoi(argv[i]);
+	}
+	frameScheduler scheduler(instructionsPerTick);
+	chip8.setPlatform(platform);
+
+	if(!chip8.loadRom(argv[1]))
+	{
+		printf("Ya failed.\n");
+		return 1;
+	}
+	startEvents(wavPath, instructionsPerTick);
+
+	signal(SIGINT, stop);
+
+	std::thread renderer(renderThread);
+
+	while(running)
+	{
+		if(turbo)
+		{
+			runTurboBatch(scheduler);
+			continue;
+		}
+
+		scheduler.runTick(chip8);
+		publishFrame();
+		scheduler.waitForNextTick();
+	}
+
+	rendering = false;
+	renderer.join();		//Lets termRenderer tidy the terminal up before we exit
+	stopEvents();
+
+#ifdef CHIP8_PROFILE
+	//Profiling build: say where the time went, and keep the raw numbers in chip8.prof
+	chip8.getProfile().report(stderr, chip8);
+	FILE *histogram = fopen("chip8.prof", "wb");
+	if(histogram != NULL) {
+		chip8.getProfile().writeHistogram(histogram);
+		fclose(histogram);
+	}
+#endif
 	return 0;
 }
+#endif
@@ -0,0 +1,156 @@
+#include "chip8.h"
+#include "profile.h"
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+static const char *const classNames[emuProfile::CLASSES] = {
+	"00E0", "00EE", "0NNN", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+	"8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE", "9XY0",
+	"ANNN", "BNNN", "CXNN", "DXYN", "EX9E", "EXA1", "FX07", "FX0A", "FX15", "FX18",
+	"FX1E", "FX29", "FX33", "FX55", "FX65", "00CN", "00DN", "00FB", "00FC", "00FD",
+	"00FE", "00FF", "FX30", "FN01", "unknown"
+};
+
+enum { UNKNOWN_CLASS = emuProfile::CLASSES - 1 };
+
+//The same decisions as emu::decode(), just giving back a number instead of a handler. It goes by the opcode alone, so on a platform
+//without SUPER-CHIP's opcodes 00FF still counts as 00FF, even though it runs as 0NNN.
+unsigned char profileClass(unsigned short opcode) {
+	switch(opcode & 0xF000)
+	{
+		case(0x0000):
+			if(opcode == 0x00E0) return 0;
+			if(opcode == 0x00EE) return 1;
+			if((opcode & 0xFFF0) == 0x00C0) return 35;
+			if((opcode & 0xFFF0) == 0x00D0) return 36;
+			if(opcode >= 0x00FB && opcode <= 0x00FF) return 37 + (opcode - 0x00FB);
+			return 2;
+		case(0x8000):
+			switch(opcode & 0x000F)
+			{
+				case(0x0000): case(0x0001): case(0x0002): case(0x0003):
+				case(0x0004): case(0x0005): case(0x0006): case(0x0007):
+					return 10 + (opcode & 0x000F);
+				case(0x000E): return 18;
+			}
+			return UNKNOWN_CLASS;
+		case(0xE000):
+			if((opcode & 0x00FF) == 0x009E) return 24;
+			if((opcode & 0x00FF) == 0x00A1) return 25;
+			return UNKNOWN_CLASS;
+		case(0xF000):
+			switch(opcode & 0x00FF)
+			{
+				case(0x0007): return 26;
+				case(0x000A): return 27;
+				case(0x0015): return 28;
+				case(0x0018): return 29;
+				case(0x001E): return 30;
+				case(0x0029): return 31;
+				case(0x0033): return 32;
+				case(0x0055): return 33;
+				case(0x0065): return 34;
+				case(0x0030): return 42;
+				case(0x0001): return 43;
+			}
+			return UNKNOWN_CLASS;
+		case(0x9000): return 19;
+		case(0xA000): return 20;
+		case(0xB000): return 21;
+		case(0xC000): return 22;
+		case(0xD000): return 23;
+	}
+	return 2 + (opcode >> 12);			//1NNN to 7XNN are in order
+}
+
+const char *profileClassName(unsigned char kind) {
+	return kind < emuProfile::CLASSES ? classNames[kind] : "?";
+}
+
+void emuProfile::clear() {
+	memset(this, 0, sizeof(*this));
+}
+
+static bool busiestFirst(const std::pair<unsigned long long, int> &a, const std::pair<unsigned long long, int> &b) {
+	return a.first > b.first;
+}
+
+void emuProfile::report(FILE *out, const emu &chip) const {
+	unsigned long long total = 0;
+	for(int i = 0; i < CLASSES; i++) {
+		total += byClass[i];
+	}
+	double percent = total > 0 ? 100.0 / total : 0;
+
+	fprintf(out, "Interpreted %llu instructions", total);
+	if(jitInstructions > 0) {
+		fprintf(out, " (and %llu more in JIT code, not broken down below)", jitInstructions);
+	}
+	fprintf(out, "\n\nBy opcode:\n");
+
+	std::vector<std::pair<unsigned long long, int> > sorted;
+	for(int i = 0; i < CLASSES; i++) {
+		if(byClass[i] > 0) {
+			sorted.push_back(std::make_pair(byClass[i], i));
+		}
+	}
+	std::sort(sorted.begin(), sorted.end(), busiestFirst);
+	for(size_t i = 0; i < sorted.size(); i++) {
+		fprintf(out, "  %-8s %14llu  %5.1f%%\n", classNames[sorted[i].second], sorted[i].first, sorted[i].first * percent);
+	}
+
+	//The hottest addresses, and what's there now. (If the ROM rewrote its own code, it might not be what ran.)
+	emuState *state = new emuState;
+	chip.saveState(*state);
+
+	sorted.clear();
+	for(int i = 0; i < 4096; i++) {
+		if(byPc[i] > 0) {
+			sorted.push_back(std::make_pair(byPc[i], i));
+		}
+	}
+	std::sort(sorted.begin(), sorted.end(), busiestFirst);
+
+	fprintf(out, "\nHottest addresses:\n");
+	for(size_t i = 0; i < sorted.size() && i < 32; i++) {
+		int pc = sorted[i].second;
+		unsigned short opcode = state->mem[pc] << 8 | state->mem[(pc + 1) & 0x0FFF];
+		fprintf(out, "  0x%03X  %04X %-8s %14llu  %5.1f%%\n", pc, opcode, classNames[profileClass(opcode)], sorted[i].first, sorted[i].first * percent);
+	}
+	delete state;
+
+	fprintf(out, "\nFX0A waiting for a key: %llu\n", keyWaits);
+	fprintf(out, "Sprites drawn: %llu, collided: %llu (%.1f%%)\n", draws, collisions, draws > 0 ? 100.0 * collisions / draws : 0.0);
+	fprintf(out, "Delay timer ran out: %llu, sound timer ran out: %llu\n", delayExpired, soundExpired);
+}
+
+static bool write64(FILE *out, unsigned long long value) {
+	unsigned char bytes[8];
+	for(int i = 0; i < 8; i++) {
+		bytes[i] = (value >> (i * 8)) & 0xFF;
+	}
+	return fwrite(bytes, 1, 8, out) == 8;
+}
+
+bool emuProfile::writeHistogram(FILE *out) const {
+	unsigned char header[8];
+	memcpy(header, PROFILE_MAGIC, 4);
+	header[4] = PROFILE_VERSION & 0xFF;
+	header[5] = PROFILE_VERSION >> 8;
+	header[6] = CLASSES & 0xFF;
+	header[7] = CLASSES >> 8;
+	if(fwrite(header, 1, 8, out) != 8) {
+		return false;
+	}
+
+	bool ok = true;
+	for(int i = 0; i < CLASSES; i++) {
+		ok = ok && write64(out, byClass[i]);
+	}
+	for(int i = 0; i < 4096; i++) {
+		ok = ok && write64(out, byPc[i]);
+	}
+	return ok && write64(out, jitInstructions) && write64(out, keyWaits) && write64(out, draws) && write64(out, collisions)
+		&& write64(out, delayExpired) && write64(out, soundExpired);
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+
+class emu;
+
+/*Optional profiling. Build with -DCHIP8_PROFILE and every emu keeps count of:
+ *	- how many times each kind of opcode ran
+ *	- how many times the opcode at each address ran, which shows you the loops a ROM spends its life in
+ *	- how many times FX0A went round again because no key was down
+ *	- how many sprites were drawn, and how many of those collided
+ *	- how many times each timer ran down to zero
+ *
+ *Without CHIP8_PROFILE, the PROFILE() lines in chip8.cpp turn into nothing at all, so a normal build doesn't pay a single instruction
+ *for any of this.
+ *
+ *Instructions the JIT runs natively don't go through the interpreter, so they only get counted as a total (jitInstructions). Profile
+ *with the JIT off to see where they went.
+ *
+ *A profiling build also runs idle loops (waiting on the delay timer, waiting in FX0A, jumping to itself) round and round for real
+ *instead of skipping to the end of the run, so every trip shows up in byPc, byClass and keyWaits. That makes it slower when a ROM is
+ *mostly waiting, but the counts add up to the cycles that were run.*/
+
+#ifdef CHIP8_PROFILE
+#define PROFILE(code) code
+#else
+#define PROFILE(code)
+#endif
+
+#define PROFILE_MAGIC "C8PF"
+#define PROFILE_VERSION 2				//2 added SUPER-CHIP and XO-CHIP's opcodes, before "unknown"
+
+struct emuProfile {
+	enum { CLASSES = 45 };
+
+	unsigned long long byClass[CLASSES];	//Indexed by profileClass()
+	unsigned long long byPc[4096];
+	unsigned long long jitInstructions;
+	unsigned long long keyWaits;			//FX0A executions that found no key down and will run again
+	unsigned long long draws;				//DXYN executions...
+	unsigned long long collisions;			//...and how many of them turned a pixel off
+	unsigned long long delayExpired;		//Times the delay timer ticked down to zero
+	unsigned long long soundExpired;		//Same for the sound timer
+
+	void clear();
+
+	void report(FILE *out, const emu &chip) const;	//Opcode kinds and the hottest addresses, busiest first, as text
+	bool writeHistogram(FILE *out) const;			//All the counters, as a flat binary file:
+													//	"C8PF", 2 byte version, 2 byte number of classes, then every counter as
+													//	8 bytes: byClass[], byPc[4096], jitInstructions, keyWaits, draws,
+													//	collisions, delayExpired, soundExpired. All little-endian.
+};
+
+unsigned char profileClass(unsigned short opcode);	//Which kind of opcode this is, 0 to CLASSES-1
+const char *profileClassName(unsigned char kind);		//"8XY4", "DXYN" and so on
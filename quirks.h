@@ -0,0 +1,73 @@
+enum emuPlatform : unsigned char;
+
+/*Quirks. The original COSMAC VIP interpreter, SUPER-CHIP on the HP48 and XO-CHIP each settled a handful of opcodes differently, and
+ *ROMs written for one of them can break on the others. Each platform is a policy struct of compile-time constants, and the handlers
+ *that care are templates on it (see emu::decodeFor() in chip8.cpp). Picking a platform picks which copies of those handlers the decode
+ *cache points at, so the interpreter never checks a quirk flag while it runs.
+ *
+ *	shiftVy				8XY6/8XYE put VY shifted into VX. Otherwise VX is shifted where it is.
+ *	loadStoreIncrement	FX55/FX65 leave I pointing just past the last register. Otherwise I doesn't move.
+ *	jumpVx				BNNN jumps to XNN + VX. Otherwise it's NNN + V0.
+ *	clipSprites			DXYN cuts sprites off at the edges of the screen. Otherwise they wrap round to the other side.
+ *	vfReset				8XY1/8XY2/8XY3 clear VF.
+ *	superChip			SUPER-CHIP's extra opcodes: 128x64 mode (00FE/00FF), scrolling (00CN/00FB/00FC), 16x16 sprites (DXY0),
+ *						the big font (FX30) and 00FD to stop. Without it those are just 0NNN and an 8x0 sprite.
+ *	xoChip				XO-CHIP's second bit plane (FN01 picks which planes get drawn on) and scrolling up (00DN).*/
+
+struct quirksDefault {				//What this emulator has always done
+	static const bool shiftVy = false;
+	static const bool loadStoreIncrement = false;
+	static const bool jumpVx = false;
+	static const bool clipSprites = false;
+	static const bool vfReset = false;
+	static const bool superChip = false;
+	static const bool xoChip = false;
+};
+
+struct quirksChip8 {				//The COSMAC VIP
+	static const bool shiftVy = true;
+	static const bool loadStoreIncrement = true;
+	static const bool jumpVx = false;
+	static const bool clipSprites = true;
+	static const bool vfReset = true;
+	static const bool superChip = false;
+	static const bool xoChip = false;
+};
+
+struct quirksSchip {				//SUPER-CHIP 1.1
+	static const bool shiftVy = false;
+	static const bool loadStoreIncrement = false;
+	static const bool jumpVx = true;
+	static const bool clipSprites = true;
+	static const bool vfReset = false;
+	static const bool superChip = true;
+	static const bool xoChip = false;
+};
+
+struct quirksXochip {				//XO-CHIP
+	static const bool shiftVy = true;
+	static const bool loadStoreIncrement = true;
+	static const bool jumpVx = false;
+	static const bool clipSprites = false;
+	static const bool vfReset = false;
+	static const bool superChip = true;
+	static const bool xoChip = true;
+};
+
+/*The same answers as plain values, for code that decides once per block or per batch step rather than per instruction: the JIT and
+ *the batch engine.*/
+
+struct quirkFlags {
+	bool shiftVy;
+	bool loadStoreIncrement;
+	bool jumpVx;
+	bool clipSprites;
+	bool vfReset;
+	bool superChip;
+	bool xoChip;
+};
+
+quirkFlags quirksFor(emuPlatform platform);
+
+const char *platformName(emuPlatform platform);				//"chip8", "schip", "xochip", or "default"
+bool platformNamed(const char *name, emuPlatform &platform);	//The other way round. False if it's none of those.
@@ -0,0 +1,181 @@
+#include "chip8.h"
+#include "replay.h"
+#include <string.h>
+
+inputLog::inputLog() {
+	seed = 0;
+	platform = platformDefault;
+	instructionsPerTick = 10;
+	lastKeys = 0;
+}
+
+static unsigned short keyMask(const emu &chip) {
+	unsigned short keys = 0;
+	for(int i = 0; i < 16; i++) {
+		if(chip.input[i] != 0) {
+			keys |= 1 << i;
+		}
+	}
+	return keys;
+}
+
+void inputLog::begin(const emu &chip, unsigned int instructionsPerTick) {
+	events.clear();
+	seed = chip.getSeed();
+	platform = chip.getPlatform();
+	this->instructionsPerTick = instructionsPerTick > 0 ? instructionsPerTick : 1;
+	lastKeys = keyMask(chip);
+
+	//Whatever's already held down counts as the first event
+	if(lastKeys != 0) {
+		event e = { chip.getCycles(), lastKeys };
+		events.push_back(e);
+	}
+}
+
+void inputLog::record(const emu &chip) {
+	unsigned short keys = keyMask(chip);
+	if(keys == lastKeys) {
+		return;
+	}
+	lastKeys = keys;
+
+	//Two changes before the same instruction: only the last one was ever seen by the game
+	if(!events.empty() && events.back().cycle == chip.getCycles()) {
+		events.back().keys = keys;
+		return;
+	}
+	event e = { chip.getCycles(), keys };
+	events.push_back(e);
+}
+
+void inputLog::replay(emu &chip, unsigned long long cycles) const {
+	if(chip.getPlatform() != platform) {
+		chip.setPlatform(platform);
+	}
+	chip.setSeed(seed);
+	memset(chip.input, 0, sizeof(chip.input));
+
+	size_t nextEvent = 0;
+	unsigned long long nextTick = chip.getCycles() + instructionsPerTick;
+	unsigned long long end = chip.getCycles() + cycles;
+	while(chip.getCycles() < end) {
+		while(nextEvent < events.size() && events[nextEvent].cycle <= chip.getCycles()) {
+			for(int i = 0; i < 16; i++) {
+				chip.input[i] = (events[nextEvent].keys >> i) & 1;
+			}
+			nextEvent++;
+		}
+		unsigned long long target = end < nextTick ? end : nextTick;
+		if(nextEvent < events.size() && events[nextEvent].cycle < target) {
+			target = events[nextEvent].cycle;
+		}
+		chip.runUntilCycle(target);
+		while(chip.getCycles() >= nextTick) {
+			chip.tickTimers();
+			nextTick += instructionsPerTick;
+		}
+	}
+}
+
+static bool write32(FILE *file, uint32_t value) {
+	unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+	return fwrite(bytes, 1, 4, file) == 4;
+}
+
+static bool read32(FILE *file, uint32_t &value) {
+	unsigned char bytes[4];
+	if(fread(bytes, 1, 4, file) != 4) {
+		return false;
+	}
+	value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+	return true;
+}
+
+bool inputLog::save(FILE *file) const {
+	unsigned char version[2] = { INPUT_LOG_VERSION & 0xFF, INPUT_LOG_VERSION >> 8 };
+	if(fwrite(INPUT_LOG_MAGIC, 1, 4, file) != 4 || fwrite(version, 1, 2, file) != 2 || !write32(file, instructionsPerTick)
+		|| !write32(file, (uint32_t)seed) || !write32(file, (uint32_t)(seed >> 32)) || fputc(platform, file) == EOF
+		|| !write32(file, (uint32_t)events.size())) {
+		return false;
+	}
+
+	//Events get built up in one buffer and written in one go. Nearly all of them take 3 or 4 bytes.
+	std::vector<unsigned char> buffer;
+	buffer.reserve(events.size() * 4);
+	unsigned long long last = 0;
+	for(size_t i = 0; i < events.size(); i++) {
+		unsigned long long delta = events[i].cycle - last;
+		last = events[i].cycle;
+		while(delta >= 0x80) {
+			buffer.push_back((unsigned char)(delta | 0x80));
+			delta >>= 7;
+		}
+		buffer.push_back((unsigned char)delta);
+		buffer.push_back(events[i].keys & 0xFF);
+		buffer.push_back(events[i].keys >> 8);
+	}
+	return buffer.empty() || fwrite(&buffer[0], 1, buffer.size(), file) == buffer.size();
+}
+
+bool inputLog::load(FILE *file) {
+	char magic[4];
+	unsigned char version[2];
+	uint32_t ipt, seedLow, seedHigh, count;
+	if(fread(magic, 1, 4, file) != 4 || memcmp(magic, INPUT_LOG_MAGIC, 4) != 0) {
+		fputs("Not an input log\n", stderr);
+		return false;
+	}
+	unsigned int logVersion = 0;
+	if(fread(version, 1, 2, file) == 2) {
+		logVersion = version[0] | (version[1] << 8);
+	}
+	if(logVersion != 1 && logVersion != INPUT_LOG_VERSION) {
+		fputs("Input log is from a version we don't know\n", stderr);
+		return false;
+	}
+	int logPlatform = platformDefault;		//Version 1 logs were all made before there was a choice
+	if(!read32(file, ipt) || !read32(file, seedLow) || !read32(file, seedHigh) || (logVersion >= 2 && (logPlatform = fgetc(file)) == EOF)
+		|| !read32(file, count)) {
+		fputs("Input log is damaged\n", stderr);
+		return false;
+	}
+	if(logPlatform > platformXochip) {
+		fputs("Input log is for a platform we don't know\n", stderr);
+		return false;
+	}
+
+	std::vector<event> loaded;
+	unsigned long long cycle = 0;
+	for(uint32_t i = 0; i < count; i++) {
+		unsigned long long delta = 0;
+		int shift = 0;
+		int byte;
+		do {
+			byte = fgetc(file);
+			if(byte == EOF || shift > 63) {
+				fputs("Input log is damaged\n", stderr);
+				return false;
+			}
+			delta |= (unsigned long long)(byte & 0x7F) << shift;
+			shift += 7;
+		} while(byte & 0x80);
+
+		int low = fgetc(file);
+		int high = fgetc(file);
+		if(low == EOF || high == EOF) {
+			fputs("Input log is damaged\n", stderr);
+			return false;
+		}
+		cycle += delta;
+		event e = { cycle, (unsigned short)(low | (high << 8)) };
+		loaded.push_back(e);
+	}
+
+	events.swap(loaded);
+	instructionsPerTick = ipt > 0 ? ipt : 1;
+	seed = seedLow | ((uint64_t)seedHigh << 32);
+	platform = (emuPlatform)logPlatform;
+	lastKeys = events.empty() ? 0 : events.back().keys;
+	return true;
+}
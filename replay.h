@@ -0,0 +1,63 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+class emu;
+enum emuPlatform : unsigned char;
+
+/*Record and replay. A CHIP-8 run is completely decided by four things: the ROM, the platform (see quirks.h), CXNN's seed, and which
+ *keys were held down when. An inputLog writes down the last three, so handing it the same ROM plays the run back exactly, down to the
+ *last pixel, as fast as the machine can go. When something goes wrong in the field, the log is all you need to see it happen again.
+ *
+ *Recording: load the ROM, call begin(), then call record() every time you change chip.input. Nothing gets stored unless a key
+ *actually changed, so a log is a few bytes per key press.
+ *
+ *Replaying follows the same rules as chip8-headless: input changes land at the instruction count they were recorded at, and the
+ *timers tick every instructionsPerTick instructions. frameScheduler::runTick() keeps to exactly that too, so a run recorded with the
+ *scheduler driving it replays the same way.
+ *
+ *On disk:
+ *	"C8IN"		magic
+ *	2 bytes		version
+ *	4 bytes		instructions per tick
+ *	8 bytes		seed
+ *	1 byte		platform (an emuPlatform; version 1 logs don't have it and replay as platformDefault)
+ *	4 bytes		number of events
+ *	events		for each: instructions since the last event (7 bits to a byte, top bit means more follow), then the 16 keys
+ *				as a 2 byte mask (bit n is key n)
+ *All little-endian.*/
+
+#define INPUT_LOG_MAGIC "C8IN"
+#define INPUT_LOG_VERSION 2
+
+class inputLog {
+	public:
+		inputLog();
+
+		void begin(const emu &chip, unsigned int instructionsPerTick);	//Starts a fresh log for the ROM chip has just loaded
+		void record(const emu &chip);				//Call after changing chip.input
+
+		void replay(emu &chip, unsigned long long cycles) const;		//chip must have the same ROM freshly loaded. Runs it for `cycles`
+																		//instructions with the recorded platform, seed and input. It's the
+																		//same run with or without the JIT.
+
+		bool save(FILE *file) const;
+		bool load(FILE *file);						//False if it isn't an input log or it's damaged
+
+		size_t size() const { return events.size(); }
+		uint64_t getSeed() const { return seed; }
+		emuPlatform getPlatform() const { return platform; }
+		unsigned int getInstructionsPerTick() const { return instructionsPerTick; }
+
+	private:
+		struct event {
+			unsigned long long cycle;
+			unsigned short keys;					//Bit n set means key n is down
+		};
+
+		std::vector<event> events;
+		uint64_t seed;
+		emuPlatform platform;
+		unsigned int instructionsPerTick;
+		unsigned short lastKeys;
+};
@@ -0,0 +1,235 @@
+#include "chip8.h"
+#include "rewind.h"
+#include <string.h>
+
+rewindBuffer::rewindBuffer(unsigned int maxFrames, size_t arenaBytes, unsigned int keyframeEvery) {
+	this->maxFrames = maxFrames > 0 ? maxFrames : 1;
+	this->keyframeEvery = keyframeEvery > 0 ? keyframeEvery : 1;
+	entries = new entry[this->maxFrames];
+	arena = new unsigned char[arenaBytes];
+	arenaSize = arenaBytes;
+
+	key = new emuState;
+	zero = new emuState;
+	memset(zero, 0, sizeof(emuState));
+	scratch = new unsigned char[sizeof(emuState) * 2 + 16];		//Worst case for encodeDelta() is well under twice the state
+
+	clear();
+}
+
+rewindBuffer::~rewindBuffer() {
+	delete[] scratch;
+	delete zero;
+	delete key;
+	delete[] arena;
+	delete[] entries;
+}
+
+void rewindBuffer::clear() {
+	first = next = 0;
+	head = 0;
+	haveKey = false;
+}
+
+size_t rewindBuffer::bytesUsed() const {
+	size_t used = 0;
+	for(unsigned long long frame = first; frame < next; frame++) {
+		used += entries[frame % maxFrames].length;
+	}
+	return used;
+}
+
+/*The delta format: a list of (how many bytes to skip, how many bytes follow, those bytes) until the end of the entry. The counts are
+ *written seven bits to a byte, with the top bit meaning "there's more", so small counts (nearly all of them) take one byte. Bytes
+ *after the last change aren't written at all.*/
+
+static void putCount(unsigned char *out, size_t &used, size_t count) {
+	while(count >= 0x80) {
+		out[used++] = (unsigned char)(count | 0x80);
+		count >>= 7;
+	}
+	out[used++] = (unsigned char)count;
+}
+
+static size_t getCount(const unsigned char *in, size_t &used) {
+	size_t count = 0;
+	int shift = 0;
+	unsigned char byte;
+	do {
+		byte = in[used++];
+		count |= (size_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while(byte & 0x80);
+	return count;
+}
+
+static size_t encodeDelta(const unsigned char *now, const unsigned char *base, size_t size, unsigned char *out) {
+	size_t used = 0;
+	size_t i = 0;
+	while(i < size)
+	{
+		size_t start = i;
+
+		//Skip everything that didn't change. Nearly all of the state doesn't, so check a whole word at a time while we can.
+		while(i + 8 <= size) {
+			uint64_t a, b;
+			memcpy(&a, now + i, 8);
+			memcpy(&b, base + i, 8);
+			if(a != b) {
+				break;
+			}
+			i += 8;
+		}
+		while(i < size && now[i] == base[i]) {
+			i++;
+		}
+		if(i == size) {
+			break;
+		}
+
+		size_t changed = i;
+		while(i < size && now[i] != base[i]) {
+			i++;
+		}
+
+		putCount(out, used, changed - start);
+		putCount(out, used, i - changed);
+		for(size_t j = changed; j < i; j++) {
+			out[used++] = now[j] ^ base[j];
+		}
+	}
+	return used;
+}
+
+//XORs a delta back into `state`, which should start out as whatever it was encoded against
+static void applyDelta(const unsigned char *in, size_t length, unsigned char *state) {
+	size_t used = 0;
+	size_t position = 0;
+	while(used < length)
+	{
+		position += getCount(in, used);
+		size_t count = getCount(in, used);
+		for(size_t j = 0; j < count; j++) {
+			state[position++] ^= in[used++];
+		}
+	}
+}
+
+void rewindBuffer::decode(const entry &e, emuState &state) {
+	applyDelta(arena + e.offset, e.length, (unsigned char *)&state);
+}
+
+//Forgets the oldest frame. If that was a keyframe, the frames stored against it are useless now, so they go too.
+void rewindBuffer::dropOldest() {
+	first++;
+	while(first < next && at(first).keyframe != first) {
+		first++;
+	}
+	if(first == next) {
+		head = 0;				//Nothing left, so we might as well start again at the front
+	}
+}
+
+void rewindBuffer::record(const emu &chip) {
+	emuState now;
+	chip.saveState(now);
+
+	bool keyframe = !haveKey || next - keyNumber >= keyframeEvery;
+	size_t length;
+	size_t offset;
+
+	for(;;)
+	{
+		length = encodeDelta((const unsigned char *)&now, (const unsigned char *)(keyframe ? zero : key), sizeof(emuState), scratch);
+		if(length > arenaSize) {
+			return;				//The arena is too small to hold even this one frame
+		}
+
+		//Entries go one after the other, and wrap back to the start of the arena when they don't fit in what's left at the end.
+		//Whatever was in the way was recorded before anything else we're still holding, so it's always the oldest frames that go.
+		offset = head;
+		bool wrapped = offset + length > arenaSize;
+		if(wrapped) {
+			offset = 0;
+		}
+
+		bool restart = false;
+		while(first < next)
+		{
+			const entry &oldest = at(first);
+			bool inTheWay = oldest.offset < offset + length && offset < oldest.offset + oldest.length;
+			if(wrapped && oldest.offset >= head) {
+				inTheWay = true;		//Still sitting in the bit at the end we're skipping over. It's older than anything at the front.
+			}
+			if(!inTheWay && next - first < maxFrames) {
+				break;
+			}
+
+			//If the frame we're about to store depends on the keyframe that has to go, it has to become a keyframe itself
+			if(!keyframe && oldest.keyframe == keyNumber) {
+				keyframe = true;
+				restart = true;
+				break;
+			}
+			dropOldest();
+		}
+		if(!restart) {
+			break;
+		}
+	}
+
+	memcpy(arena + offset, scratch, length);
+	entry &e = at(next);
+	e.offset = offset;
+	e.length = length;
+	e.keyframe = keyframe ? next : keyNumber;
+	if(keyframe) {
+		memcpy(key, &now, sizeof(emuState));
+		keyNumber = next;
+		haveKey = true;
+	}
+	head = offset + length;
+	next++;
+}
+
+bool rewindBuffer::seek(unsigned int framesBack, emuState &state) {
+	if(framesBack >= frames()) {
+		return false;
+	}
+
+	unsigned long long frame = next - 1 - framesBack;
+	const entry &e = at(frame);
+
+	//Start from the keyframe. The newest one is already sitting decoded in `key`, anything older has to be decoded first.
+	if(e.keyframe == frame) {
+		memcpy(&state, zero, sizeof(emuState));
+	}
+	else if(e.keyframe == keyNumber) {
+		memcpy(&state, key, sizeof(emuState));
+	}
+	else {
+		memcpy(&state, zero, sizeof(emuState));
+		decode(at(e.keyframe), state);
+	}
+	decode(e, state);
+	return true;
+}
+
+bool rewindBuffer::rewind(emu &chip, unsigned int framesBack) {
+	emuState state;
+	if(!seek(framesBack, state)) {
+		return false;
+	}
+	chip.restoreState(state);
+
+	//Everything after this frame never happened now
+	next -= framesBack;
+	const entry &e = at(next - 1);
+	head = e.offset + e.length;
+	if(e.keyframe != keyNumber) {
+		memcpy(key, zero, sizeof(emuState));
+		decode(at(e.keyframe), *key);
+		keyNumber = e.keyframe;
+	}
+	return true;
+}
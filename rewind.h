@@ -0,0 +1,65 @@
+#include <stddef.h>
+
+class emu;
+struct emuState;
+
+/*Rewind. Call record() once a frame and it keeps the last however-many frames in a fixed block of memory, so you can go back to any
+ *of them later.
+ *
+ *Storing a whole emuState per frame would be about 4.4K a frame, or 16 megabytes a minute. But from one frame to the next, almost
+ *nothing in the machine changes: a few registers, a sprite or two on the screen, maybe a byte of memory. So every keyframeEvery
+ *frames we store a keyframe, and every other frame is stored as the XOR of its state against that keyframe. Anything that didn't
+ *change XORs to zero, and the zero runs get squashed down to a byte or two each, so most frames only take a few dozen bytes.
+ *
+ *Every frame is stored against its keyframe, not against the frame before it, so going back to any frame means decoding at most two
+ *entries (its keyframe and itself). That keeps seeking just as quick ten minutes back as one frame back.
+ *
+ *When the arena fills up the oldest frames get dropped to make room. A keyframe takes the frames that depend on it with it.*/
+
+class rewindBuffer {
+	public:
+		rewindBuffer(unsigned int maxFrames, size_t arenaBytes, unsigned int keyframeEvery = 120);
+		~rewindBuffer();
+
+		void record(const emu &chip);					//Remembers the machine as it is now. Call it once a frame.
+
+		bool seek(unsigned int framesBack, emuState &state);	//Fetches a recorded state. 0 is the newest frame. False if that's
+																//further back than we remember.
+		bool rewind(emu &chip, unsigned int framesBack);		//Puts the machine back to that frame and forgets every frame after it,
+																//so recording carries on from there
+
+		unsigned int frames() const { return (unsigned int)(next - first); }	//How many frames back we can go
+		size_t bytesUsed() const;						//How much of the arena the remembered frames take up
+		void clear();
+
+	private:
+		struct entry {
+			size_t offset;								//Where it lives in the arena
+			size_t length;
+			unsigned long long keyframe;				//The frame number of the keyframe it's stored against (its own, if it is one)
+		};
+
+		entry *entries;									//Indexed by frame number % maxFrames
+		unsigned int maxFrames;
+		unsigned long long first;						//Frame numbers we still remember are first..next-1
+		unsigned long long next;
+
+		unsigned char *arena;
+		size_t arenaSize;
+		size_t head;									//Where the next entry goes
+
+		unsigned int keyframeEvery;
+		emuState *key;									//The newest keyframe, decoded, so new frames can be XORed against it
+		unsigned long long keyNumber;
+		bool haveKey;
+
+		emuState *zero;									//Keyframes are stored as a delta against all zeros
+		unsigned char *scratch;							//Entries get encoded here first, so we know how big they are
+
+		entry &at(unsigned long long frame) { return entries[frame % maxFrames]; }
+		void dropOldest();
+		void decode(const entry &e, emuState &state);
+
+		rewindBuffer(const rewindBuffer &);
+		rewindBuffer &operator=(const rewindBuffer &);
+};
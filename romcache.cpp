@@ -0,0 +1,156 @@
+#include "romcache.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define ROMCACHE_READ		//Plain reads on Windows. ROMs are a few K at most, so mapping them buys very little there.
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define MAX_ROM_SIZE (4096 - 512)		//Everything from 0x200 to the end of memory
+
+romCache::romCache() {
+}
+
+romCache::~romCache() {
+	for(size_t i = 0; i < entries.size(); i++) {
+		release(entries[i]);
+	}
+}
+
+static uint64_t hashRom(const unsigned char *data, size_t size) {
+	uint64_t hash = 14695981039346656037ULL;
+	for(size_t i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+//Gets the file's contents into memory one way or another. Doesn't touch the cache itself, so it runs without holding the lock.
+romCache::entry *romCache::open(const char *path) {
+	entry *e = new entry;
+	e->mapping = NULL;
+	e->mappedSize = 0;
+
+#ifdef ROMCACHE_READ
+	FILE * pFile = fopen(path, "rb");
+	if(pFile == NULL) {
+		delete e;
+		return NULL;
+	}
+	fseek(pFile, 0, SEEK_END);
+	long size = ftell(pFile);
+	rewind(pFile);
+	if(size < 0 || size > MAX_ROM_SIZE) {
+		fclose(pFile);
+		delete e;
+		return NULL;
+	}
+
+	unsigned char *data = new unsigned char[size > 0 ? size : 1];
+	bool ok = fread(data, 1, size, pFile) == (size_t)size;
+	fclose(pFile);
+	if(!ok) {
+		delete[] data;
+		delete e;
+		return NULL;
+	}
+	e->mapping = data;
+	e->image.data = data;
+	e->image.size = size;
+#else
+	int fd = ::open(path, O_RDONLY);
+	if(fd < 0) {
+		delete e;
+		return NULL;
+	}
+
+	struct stat info;
+	if(fstat(fd, &info) != 0 || info.st_size > MAX_ROM_SIZE) {
+		close(fd);
+		delete e;
+		return NULL;
+	}
+
+	static const unsigned char nothing = 0;
+	e->image.data = &nothing;					//mmap won't map an empty file, and there's nothing to map anyway
+	e->image.size = info.st_size;
+	if(info.st_size > 0) {
+		void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(mapped == MAP_FAILED) {
+			close(fd);
+			delete e;
+			return NULL;
+		}
+		e->mapping = mapped;
+		e->mappedSize = info.st_size;
+		e->image.data = (const unsigned char *)mapped;
+	}
+	close(fd);									//The mapping stays good after the file's closed
+#endif
+
+	e->image.hash = hashRom(e->image.data, e->image.size);
+	return e;
+}
+
+void romCache::release(entry *e) {
+	if(e->mapping != NULL) {
+#ifdef ROMCACHE_READ
+		delete[] (unsigned char *)e->mapping;
+#else
+		munmap(e->mapping, e->mappedSize);
+#endif
+	}
+	delete e;
+}
+
+const romImage *romCache::get(const char *path) {
+	{
+		std::lock_guard<std::mutex> hold(lock);
+		std::map<std::string, entry *>::iterator found = byPath.find(path);
+		if(found != byPath.end()) {
+			return &found->second->image;
+		}
+	}
+
+	entry *fresh = open(path);
+	if(fresh == NULL) {
+		fprintf(stderr, "Couldn't load %s into the ROM cache\n", path);
+		return NULL;
+	}
+
+	std::lock_guard<std::mutex> hold(lock);
+
+	//Somebody else might have loaded the same path while we weren't holding the lock
+	std::map<std::string, entry *>::iterator found = byPath.find(path);
+	if(found != byPath.end()) {
+		release(fresh);
+		return &found->second->image;
+	}
+
+	//Same contents as something we already have? Then use that and let this copy go.
+	typedef std::multimap<uint64_t, entry *>::iterator hashIterator;
+	std::pair<hashIterator, hashIterator> sameHash = byHash.equal_range(fresh->image.hash);
+	for(hashIterator i = sameHash.first; i != sameHash.second; ++i) {
+		const romImage &known = i->second->image;
+		if(known.size == fresh->image.size && memcmp(known.data, fresh->image.data, known.size) == 0) {
+			release(fresh);
+			byPath[path] = i->second;
+			return &i->second->image;
+		}
+	}
+
+	entries.push_back(fresh);
+	byHash.insert(std::make_pair(fresh->image.hash, fresh));
+	byPath[path] = fresh;
+	return &fresh->image;
+}
+
+size_t romCache::size() {
+	std::lock_guard<std::mutex> hold(lock);
+	return entries.size();
+}
@@ -0,0 +1,48 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*Keeps ROMs in memory so thousands of emulators can start on them without each one opening and reading the file.
+ *
+ *Each ROM file is mapped into memory (mmap, or just read in on Windows) the first time anybody asks for it, and then every later
+ *request, from any thread, gets the same bytes back. Two files with the same contents share one copy too, since they're looked up by
+ *a hash of what's in them. Hand the result to emu::loadRom(data, size) and starting an emulator is a single memcpy into mem.
+ *
+ *A ROM stays cached for as long as the cache is around. If the file changes on disk after that, you'll keep getting the old one.*/
+
+struct romImage {
+	const unsigned char *data;
+	size_t size;
+	uint64_t hash;						//FNV-1a of the contents
+};
+
+class romCache {
+	public:
+		romCache();
+		~romCache();
+
+		const romImage *get(const char *path);	//NULL if the file can't be read or won't fit in CHIP-8 memory. Safe to call from any
+												//thread, and the image stays put until the cache is destroyed.
+		size_t size();							//How many different ROMs are cached
+
+	private:
+		struct entry {
+			romImage image;
+			void *mapping;						//What to unmap (or delete[]) afterwards
+			size_t mappedSize;
+		};
+
+		std::mutex lock;
+		std::map<std::string, entry *> byPath;
+		std::multimap<uint64_t, entry *> byHash;
+		std::vector<entry *> entries;
+
+		entry *open(const char *path);
+		void release(entry *e);
+
+		romCache(const romCache &);
+		romCache &operator=(const romCache &);
+};
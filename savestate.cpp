@@ -0,0 +1,241 @@
+#include "chip8.h"
+#include "savestate.h"
+#include <string.h>
+
+statePool::statePool(size_t capacity) {
+	count = capacity;
+	states = new emuState[count];
+	freeList = new emuState *[count];
+
+	for(size_t i = 0; i < count; i++) {
+		freeList[i] = &states[count - 1 - i];		//Hand them out in address order, it's kinder to the cache
+	}
+	freeCount = count;
+}
+
+statePool::~statePool() {
+	delete[] freeList;
+	delete[] states;
+}
+
+emuState *statePool::acquire() {
+	if(freeCount == 0) {
+		return NULL;
+	}
+	return freeList[--freeCount];
+}
+
+void statePool::release(emuState *state) {
+	if(state != NULL) {
+		freeList[freeCount++] = state;
+	}
+}
+
+/*The on-disk format is:
+ *	"C8ST"		magic
+ *	2 bytes		version
+ *	2 bytes		length of the packed body
+ *	body		the fields of emuState in the order below, little-endian, with zero runs packed (see pack())
+ *	4 bytes		FNV-1a hash of the unpacked body, so a damaged file gets turned away instead of loaded*/
+
+enum {
+	RAW_SIZE_V1 = 4096 + 32 * 8 + 2 + 2 + 16 * 2 + 2 + 16 + 16 + 1 + 1 + 8,
+	RAW_SIZE_V2 = RAW_SIZE_V1 + 8,
+	RAW_SIZE = RAW_SIZE_V2 - 32 * 8 + 2 * 64 * 2 * 8 + 1 + 1,
+	PACKED_MAX = RAW_SIZE * 2		//Worst case: every other byte is a lone zero, which packs into two bytes
+};
+
+static void put16(unsigned char *&out, unsigned int value) {
+	*out++ = value & 0xFF;
+	*out++ = (value >> 8) & 0xFF;
+}
+
+static void put64(unsigned char *&out, uint64_t value) {
+	for(int i = 0; i < 8; i++) {
+		*out++ = (value >> (i * 8)) & 0xFF;
+	}
+}
+
+static unsigned int get16(const unsigned char *&in) {
+	unsigned int value = in[0] | (in[1] << 8);
+	in += 2;
+	return value;
+}
+
+static uint64_t get64(const unsigned char *&in) {
+	uint64_t value = 0;
+	for(int i = 0; i < 8; i++) {
+		value |= (uint64_t)in[i] << (i * 8);
+	}
+	in += 8;
+	return value;
+}
+
+static void serialize(const emuState &state, unsigned char *out) {
+	memcpy(out, state.mem, 4096);
+	out += 4096;
+	for(int plane = 0; plane < 2; plane++) {
+		for(int y = 0; y < 64; y++) {
+			put64(out, state.graphics[plane][y][0]);
+			put64(out, state.graphics[plane][y][1]);
+		}
+	}
+	put16(out, state.index);
+	put16(out, state.pc);
+	for(int i = 0; i < 16; i++) {
+		put16(out, state.stack[i]);
+	}
+	put16(out, state.sp);
+	memcpy(out, state.registers, 16);
+	out += 16;
+	memcpy(out, state.input, 16);
+	out += 16;
+	*out++ = state.delayTimer;
+	*out++ = state.soundTimer;
+	*out++ = state.hires;
+	*out++ = state.planes;
+	put64(out, state.cycles);
+	put64(out, state.randomState);
+}
+
+static void deserialize(const unsigned char *in, unsigned int version, emuState &state) {
+	memcpy(state.mem, in, 4096);
+	in += 4096;
+	//Before version 3 the screen was only ever 64x32 on one plane, one word per row
+	memset(state.graphics, 0, sizeof(state.graphics));
+	for(int plane = 0; plane < (version >= 3 ? 2 : 1); plane++) {
+		for(int y = 0; y < (version >= 3 ? 64 : 32); y++) {
+			state.graphics[plane][y][0] = get64(in);
+			if(version >= 3) {
+				state.graphics[plane][y][1] = get64(in);
+			}
+		}
+	}
+	state.index = get16(in);
+	state.pc = get16(in);
+	for(int i = 0; i < 16; i++) {
+		state.stack[i] = get16(in);
+	}
+	state.sp = get16(in);
+	memcpy(state.registers, in, 16);
+	in += 16;
+	memcpy(state.input, in, 16);
+	in += 16;
+	state.delayTimer = *in++;
+	state.soundTimer = *in++;
+	state.hires = version >= 3 ? *in++ : 0;
+	state.planes = version >= 3 ? *in++ : 1;
+	memset(state.reserved, 0, sizeof(state.reserved));	//Not in the file at all
+	state.cycles = get64(in);
+
+	//Version 1 came from before every emu had its own random numbers. Any state will do, as long as it isn't zero.
+	state.randomState = version >= 2 ? get64(in) : 0x2545F4914F6CDD1DULL;
+}
+
+//Any byte that isn't zero is written as it is. A run of zeros is written as a zero followed by how many there were (up to 255).
+static size_t pack(const unsigned char *in, size_t length, unsigned char *out) {
+	size_t used = 0;
+	for(size_t i = 0; i < length; )
+	{
+		if(in[i] != 0) {
+			out[used++] = in[i++];
+			continue;
+		}
+
+		unsigned int run = 0;
+		while(i < length && in[i] == 0 && run < 255) {
+			run++;
+			i++;
+		}
+		out[used++] = 0;
+		out[used++] = (unsigned char)run;
+	}
+	return used;
+}
+
+//The other way around. False if it doesn't come out to exactly `length` bytes.
+static bool unpack(const unsigned char *in, size_t packed, unsigned char *out, size_t length) {
+	size_t used = 0;
+	for(size_t i = 0; i < packed; )
+	{
+		if(in[i] != 0) {
+			if(used >= length) {
+				return false;
+			}
+			out[used++] = in[i++];
+			continue;
+		}
+
+		if(i + 1 >= packed || in[i + 1] == 0 || used + in[i + 1] > length) {
+			return false;
+		}
+		memset(out + used, 0, in[i + 1]);
+		used += in[i + 1];
+		i += 2;
+	}
+	return used == length;
+}
+
+static uint32_t hashBytes(const unsigned char *data, size_t length) {
+	uint32_t hash = 2166136261u;
+	for(size_t i = 0; i < length; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+	return hash;
+}
+
+bool writeState(FILE *file, const emuState &state) {
+	unsigned char raw[RAW_SIZE];
+	unsigned char packed[PACKED_MAX];
+	serialize(state, raw);
+	size_t length = pack(raw, RAW_SIZE, packed);
+
+	unsigned char header[8];
+	unsigned char *out = header + 4;
+	memcpy(header, STATE_MAGIC, 4);
+	put16(out, STATE_VERSION);
+	put16(out, (unsigned int)length);
+
+	unsigned char footer[4];
+	uint32_t hash = hashBytes(raw, RAW_SIZE);
+	for(int i = 0; i < 4; i++) {
+		footer[i] = (hash >> (i * 8)) & 0xFF;
+	}
+
+	return fwrite(header, 1, 8, file) == 8 && fwrite(packed, 1, length, file) == length && fwrite(footer, 1, 4, file) == 4;
+}
+
+bool readState(FILE *file, emuState &state) {
+	unsigned char header[8];
+	if(fread(header, 1, 8, file) != 8 || memcmp(header, STATE_MAGIC, 4) != 0) {
+		fputs("Not a save state\n", stderr);
+		return false;
+	}
+
+	const unsigned char *in = header + 4;
+	unsigned int version = get16(in);
+	size_t length = get16(in);
+	if(version < 1 || version > STATE_VERSION) {
+		fprintf(stderr, "Save state is version %u, we only know up to version %d\n", version, STATE_VERSION);
+		return false;
+	}
+	size_t rawSize = version == 1 ? RAW_SIZE_V1 : version == 2 ? RAW_SIZE_V2 : RAW_SIZE;
+
+	unsigned char packed[PACKED_MAX];
+	unsigned char raw[RAW_SIZE];
+	unsigned char footer[4];
+	if(length > PACKED_MAX || fread(packed, 1, length, file) != length || fread(footer, 1, 4, file) != 4
+		|| !unpack(packed, length, raw, rawSize)) {
+		fputs("Save state is damaged\n", stderr);
+		return false;
+	}
+
+	uint32_t hash = footer[0] | (footer[1] << 8) | (footer[2] << 16) | ((uint32_t)footer[3] << 24);
+	if(hash != hashBytes(raw, rawSize)) {
+		fputs("Save state is damaged\n", stderr);
+		return false;
+	}
+
+	deserialize(raw, version, state);
+	return true;
+}
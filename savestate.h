@@ -0,0 +1,42 @@
+#include <stddef.h>
+#include <stdio.h>
+
+/*Somewhere to keep save states, and a way to put them on disk.
+ *
+ *emu::saveState() copies the machine into any emuState you hand it. If you're taking lots of them (a search that branches off every
+ *state it visits, say), statePool grabs room for all of them in one allocation up front, so taking and dropping a snapshot is just
+ *popping and pushing a free list. It isn't thread safe; give each thread its own pool.
+ *
+ *On disk, a state is written field by field in little-endian order, so files move between machines, compilers and builds where the
+ *struct layout might differ. Runs of zero bytes are squashed (most of memory and most of the screen is zeros), so a typical state is
+ *well under a kilobyte instead of four and a half. The header carries a version number that goes up whenever emuState changes.*/
+
+#define STATE_MAGIC "C8ST"
+#define STATE_VERSION 3			//1: the original. 2: added CXNN's random number state. 3: the 128x64 two-plane screen.
+
+struct emuState;
+
+class statePool {
+	public:
+		statePool(size_t capacity);
+		~statePool();
+
+		emuState *acquire();					//NULL if every state in the pool is in use
+		void release(emuState *state);			//Gives a state from acquire() back
+
+		size_t capacity() const { return count; }
+		size_t available() const { return freeCount; }
+
+	private:
+		emuState *states;
+		emuState **freeList;
+		size_t count;
+		size_t freeCount;
+
+		statePool(const statePool &);
+		statePool &operator=(const statePool &);
+};
+
+bool writeState(FILE *file, const emuState &state);	//False if the write failed
+bool readState(FILE *file, emuState &state);		//False if it isn't a save state, it's damaged, or it's from a version we don't know.
+													//state is left alone in that case.
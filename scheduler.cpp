@@ -0,0 +1,40 @@
+#include "chip8.h"
+#include "scheduler.h"
+#include <thread>
+
+frameScheduler::frameScheduler(unsigned int instructionsPerTick, unsigned int ticksPerSecond) {
+	this->instructionsPerTick = instructionsPerTick;
+	frame = 0;
+	period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / ticksPerSecond;
+	deadline = std::chrono::steady_clock::now() + period;
+}
+
+void frameScheduler::runTick(emu &chip) {
+	chip.runUntilCycle(chip.getCycles() + instructionsPerTick);
+	chip.tickTimers();
+	frame++;
+}
+
+void frameScheduler::runFrames(emu &chip, unsigned long long n) {
+	for(unsigned long long i = 0; i < n; i++) {
+		runTick(chip);
+	}
+}
+
+void frameScheduler::runUntilFrame(emu &chip, unsigned long long frame) {
+	while(this->frame < frame) {
+		runTick(chip);
+	}
+}
+
+void frameScheduler::waitForNextTick() {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	//More than a few ticks behind: forget about catching up and start counting again from now.
+	if(now > deadline + period * 4) {
+		deadline = now;
+	}
+
+	std::this_thread::sleep_until(deadline);
+	deadline += period;
+}
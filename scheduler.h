@@ -0,0 +1,34 @@
+#include <chrono>
+
+/*Keeps an emulator running at the right speed. The CHIP-8 has no clock speed of its own that games agree on, but its timers always
+ *count down 60 times a second, so that's what we pace: each tick runs a fixed number of instructions, counts the timers down once, and
+ *then sleeps until the next tick is due.
+ *
+ *The deadlines are absolute (start time + n ticks), not "sleep 16ms after every frame". Sleeping a little too long once doesn't push
+ *every later frame back, the next sleep is just a bit shorter. If we fall so far behind that it can't be made up (the machine was
+ *suspended, say), we give up on the missed ticks rather than running them all at once.
+ *
+ *For turbo mode and batch runs, just don't call waitForNextTick(). runFrames() and runUntilFrame() do exactly that.*/
+
+class emu;
+
+class frameScheduler {
+	public:
+		frameScheduler(unsigned int instructionsPerTick, unsigned int ticksPerSecond = 60);
+
+		void runTick(emu &chip);			//Runs one tick's worth of instructions, then ticks the timers
+		void waitForNextTick();				//Sleeps until the next tick is due
+
+		void runFrames(emu &chip, unsigned long long n);			//n ticks back to back, no sleeping
+		void runUntilFrame(emu &chip, unsigned long long frame);	//Ticks with no sleeping until getFrame() reaches `frame`
+		unsigned long long getFrame() const { return frame; }		//How many ticks this scheduler has run
+
+		void setInstructionsPerTick(unsigned int n) { instructionsPerTick = n; }
+		unsigned int getInstructionsPerTick() const { return instructionsPerTick; }
+
+	private:
+		unsigned int instructionsPerTick;
+		unsigned long long frame;
+		std::chrono::steady_clock::duration period;
+		std::chrono::steady_clock::time_point deadline;
+};
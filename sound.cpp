@@ -0,0 +1,127 @@
+#include "events.h"
+#include "sound.h"
+#include <string.h>
+
+#define SOUND_CHUNK 4096				//Samples generated at a time
+#define SOUND_VOLUME 8000				//Out of 32767. A square wave at full volume is unpleasant.
+#define WAV_HEADER 44
+#define WAV_LIMIT (0xFFFFFFFFULL - WAV_HEADER)
+
+static void putLittle(unsigned char *out, unsigned long value, int bytes) {
+	for(int i = 0; i < bytes; i++) {
+		out[i] = (unsigned char)((value >> (i * 8)) & 0xFF);
+	}
+}
+
+wavSink::wavSink() {
+	file = NULL;
+	bytes = 0;
+}
+
+wavSink::~wavSink() {
+	close();
+}
+
+bool wavSink::open(const char *path, unsigned int sampleRate) {
+	close();
+	file = fopen(path, "wb");
+	if(file == NULL) {
+		return false;
+	}
+	bytes = 0;
+
+	//RIFF header for 16-bit mono PCM. Both sizes are 0 until close() knows them.
+	unsigned char header[WAV_HEADER];
+	memcpy(header, "RIFF\0\0\0\0WAVEfmt ", 16);
+	putLittle(header + 16, 16, 4);				//Size of the fmt chunk
+	putLittle(header + 20, 1, 2);				//PCM
+	putLittle(header + 22, 1, 2);				//One channel
+	putLittle(header + 24, sampleRate, 4);
+	putLittle(header + 28, sampleRate * 2, 4);	//Bytes a second
+	putLittle(header + 32, 2, 2);				//Bytes a sample
+	putLittle(header + 34, 16, 2);				//Bits a sample
+	memcpy(header + 36, "data\0\0\0\0", 8);
+	return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+void wavSink::write(const short *samples, size_t count) {
+	if(file == NULL) {
+		return;
+	}
+	if(bytes + count * 2 > WAV_LIMIT) {
+		count = (size_t)((WAV_LIMIT - bytes) / 2);
+	}
+
+	unsigned char out[SOUND_CHUNK * 2];
+	while(count > 0)
+	{
+		size_t n = count < SOUND_CHUNK ? count : SOUND_CHUNK;
+		for(size_t i = 0; i < n; i++) {
+			putLittle(out + i * 2, (unsigned short)samples[i], 2);		//Little-endian whatever this machine is
+		}
+		fwrite(out, 2, n, file);
+		bytes += n * 2;
+		samples += n;
+		count -= n;
+	}
+}
+
+void wavSink::close() {
+	if(file == NULL) {
+		return;
+	}
+	unsigned char size[4];
+	putLittle(size, (unsigned long)(bytes + WAV_HEADER - 8), 4);
+	fseek(file, 4, SEEK_SET);
+	fwrite(size, 1, 4, file);
+	putLittle(size, (unsigned long)bytes, 4);
+	fseek(file, 40, SEEK_SET);
+	fwrite(size, 1, 4, file);
+	fclose(file);
+	file = NULL;
+}
+
+squareWave::squareWave(soundSink &sink, double instructionsPerSecond, unsigned int sampleRate, double frequency) : sink(sink) {
+	samplesPerCycle = sampleRate / instructionsPerSecond;
+	halfPeriod = sampleRate / frequency / 2;
+	phase = 0;
+	high = true;
+	on = false;
+	written = 0;
+}
+
+//Writes samples up to where `cycle` falls, in whatever state the tone is in now
+void squareWave::advance(unsigned long long cycle) {
+	unsigned long long until = (unsigned long long)(cycle * samplesPerCycle);
+	short chunk[SOUND_CHUNK];
+	while(written < until)
+	{
+		size_t n = until - written < SOUND_CHUNK ? (size_t)(until - written) : SOUND_CHUNK;
+		if(!on) {
+			memset(chunk, 0, n * sizeof(short));
+		} else {
+			for(size_t i = 0; i < n; i++)
+			{
+				chunk[i] = high ? SOUND_VOLUME : -SOUND_VOLUME;
+				if(++phase >= halfPeriod) {
+					phase -= halfPeriod;
+					high = !high;
+				}
+			}
+		}
+		sink.write(chunk, n);
+		written += n;
+	}
+}
+
+void squareWave::event(const emuEvent &event) {
+	if(event.kind != eventSoundOn && event.kind != eventSoundOff) {
+		return;
+	}
+	advance(event.cycle);
+	on = event.kind == eventSoundOn;
+}
+
+void squareWave::finish(unsigned long long cycle) {
+	advance(cycle);
+}
@@ -0,0 +1,55 @@
+#include <stddef.h>
+#include <stdio.h>
+
+struct emuEvent;
+
+/*The CHIP-8 buzzer: one tone, on while the sound timer is above zero. squareWave turns an emulator's eventSoundOn/eventSoundOff events
+ *(see events.h) into 16-bit mono samples of a square wave and hands them to a soundSink. It runs on the logger thread, never the
+ *emulator's.
+ *
+ *Time comes from the events' cycle counts, not the clock, so the sound lines up with emulated time however fast the emulator actually
+ *ran: tell it how many instructions make a second (instructions per tick x 60). A WAV of a turbo run plays back at normal speed.*/
+
+class soundSink {
+	public:
+		virtual ~soundSink() {}
+		virtual void write(const short *samples, size_t count) = 0;
+};
+
+class nullSink : public soundSink {			//For when nobody's listening. Throws everything away.
+	public:
+		void write(const short *samples, size_t count) {}
+};
+
+class wavSink : public soundSink {			//Writes a .wav file. The sizes in its header get filled in by close().
+	public:
+		wavSink();
+		~wavSink();							//Closes it
+
+		bool open(const char *path, unsigned int sampleRate);
+		void close();
+		void write(const short *samples, size_t count);
+
+	private:
+		FILE *file;
+		unsigned long long bytes;			//Of samples written so far. A .wav can't hold more than 4GB, so we stop there.
+};
+
+class squareWave {
+	public:
+		squareWave(soundSink &sink, double instructionsPerSecond, unsigned int sampleRate = 44100, double frequency = 440.0);
+
+		void event(const emuEvent &event);	//Sound events switch the tone on or off from then on. Anything else is ignored.
+		void finish(unsigned long long cycle);	//Writes everything up to `cycle`, say at the end of the run
+
+	private:
+		soundSink &sink;
+		double samplesPerCycle;
+		double halfPeriod;					//In samples
+		double phase;						//How far into the current half of the wave we are
+		bool high;							//Which half it is
+		bool on;
+		unsigned long long written;			//Samples so far
+
+		void advance(unsigned long long cycle);
+};
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "framestream.h"
+#include "termrender.h"
+
+/*Watches one instance of a running chip8-headless --stream in the terminal.
+ *
+ *	chip8-view PORT|unix:PATH [INSTANCE]
+ *
+ *Every instance's frames arrive whether we show them or not (the deltas only make sense applied in order), but only INSTANCE (0 if
+ *you don't say) gets drawn. The picture stays up when the run finishes, until Ctrl-C.*/
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int)
+{
+	running = 0;
+}
+
+static int connectTo(const char *address)
+{
+	int s;
+	if(strncmp(address, "unix:", 5) == 0)
+	{
+		sockaddr_un where;
+		memset(&where, 0, sizeof(where));
+		where.sun_family = AF_UNIX;
+		strncpy(where.sun_path, address + 5, sizeof(where.sun_path) - 1);
+		s = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(s >= 0 && connect(s, (sockaddr *)&where, sizeof(where)) == 0) {
+			return s;
+		}
+	}
+	else
+	{
+		sockaddr_in where;
+		memset(&where, 0, sizeof(where));
+		where.sin_family = AF_INET;
+		where.sin_port = htons((unsigned short)atoi(address));
+		where.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		s = socket(AF_INET, SOCK_STREAM, 0);
+		if(s >= 0 && connect(s, (sockaddr *)&where, sizeof(where)) == 0) {
+			return s;
+		}
+	}
+	if(s >= 0) {
+		close(s);
+	}
+	return -1;
+}
+
+//Reads exactly `length` bytes. False if the server went away or we were told to stop.
+static bool readFully(int s, unsigned char *out, size_t length)
+{
+	size_t got = 0;
+	while(got < length && running)
+	{
+		ssize_t n = recv(s, out + got, length - got, 0);
+		if(n > 0) {
+			got += (size_t)n;
+		} else if(n < 0 && errno == EINTR) {
+			continue;
+		} else {
+			return false;
+		}
+	}
+	return got == length;
+}
+
+static unsigned long long getLittle(const unsigned char *in, int bytes)
+{
+	unsigned long long value = 0;
+	for(int i = 0; i < bytes; i++) {
+		value |= (unsigned long long)in[i] << (i * 8);
+	}
+	return value;
+}
+
+static size_t getCount(const unsigned char *in, size_t length, size_t &used)
+{
+	size_t count = 0;
+	int shift = 0;
+	while(used < length && shift < 64)
+	{
+		unsigned char byte = in[used++];
+		count |= (size_t)(byte & 0x7F) << shift;
+		shift += 7;
+		if(!(byte & 0x80)) {
+			break;
+		}
+	}
+	return count;
+}
+
+//XORs a delta into one instance's screen. False if it's damaged.
+static bool applyDelta(const unsigned char *in, size_t length, uint64_t *screen)
+{
+	size_t used = 0;
+	size_t position = 0;
+	while(used < length)
+	{
+		position += getCount(in, length, used);
+		size_t count = getCount(in, length, used);
+		if(position + count > FRAME_STREAM_WORDS || used + count * 8 > length) {
+			return false;
+		}
+		for(size_t j = 0; j < count; j++) {
+			screen[position++] ^= getLittle(in + used, 8);
+			used += 8;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc < 2)
+	{
+		printf("Usage: chip8-view PORT|unix:PATH [INSTANCE]\n");
+		return 1;
+	}
+	unsigned int watching = argc > 2 ? (unsigned int)atoi(argv[2]) : 0;
+
+	int s = connectTo(argv[1]);
+	if(s < 0)
+	{
+		fprintf(stderr, "Couldn't connect to %s: %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+
+	unsigned char header[10];
+	if(!readFully(s, header, sizeof(header)) || memcmp(header, FRAME_STREAM_MAGIC, 4) != 0
+		|| getLittle(header + 4, 2) != FRAME_STREAM_VERSION)
+	{
+		fprintf(stderr, "%s isn't a chip8 frame stream we understand\n", argv[1]);
+		close(s);
+		return 1;
+	}
+	unsigned int instances = (unsigned int)getLittle(header + 6, 4);
+	if(watching >= instances)
+	{
+		fprintf(stderr, "There are only %u instances\n", instances);
+		close(s);
+		return 1;
+	}
+
+	//No SA_RESTART, so Ctrl-C breaks us out of a recv() that's waiting on a quiet server
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stop;
+	sigaction(SIGINT, &action, NULL);
+
+	std::vector<uint64_t> screens((size_t)instances * FRAME_STREAM_WORDS, 0);
+	std::vector<unsigned char> body;
+	static uint64_t planes[2][64][2];
+	termRenderer screen;
+	screen.begin();
+
+	unsigned char frameHeader[15];
+	while(running && readFully(s, frameHeader, sizeof(frameHeader)))
+	{
+		unsigned int instance = (unsigned int)getLittle(frameHeader, 4);
+		bool hires = frameHeader[12] != 0;
+		body.resize((size_t)getLittle(frameHeader + 13, 2));
+		if(instance >= instances || (!body.empty() && !readFully(s, &body[0], body.size()))) {
+			break;
+		}
+		uint64_t *words = &screens[(size_t)instance * FRAME_STREAM_WORDS];
+		if(!body.empty() && !applyDelta(&body[0], body.size(), words)) {
+			break;
+		}
+
+		if(instance == watching)
+		{
+			memcpy(planes, words, sizeof(planes));
+			screen.draw(planes, hires);
+		}
+	}
+
+	//The run's over (or the stream broke). Leave the last picture up until we're told to go.
+	while(running) {
+		pause();
+	}
+	close(s);
+	return 0;
+}
@@ -0,0 +1,95 @@
+#include "termrender.h"
+
+//UTF-8 for ' ', '▀', '▄' and '█', indexed by (bottom pixel << 1) | top pixel
+static const char *glyphs[4] = { " ", "\xE2\x96\x80", "\xE2\x96\x84", "\xE2\x96\x88" };
+
+termRenderer::termRenderer(FILE *out) {
+	this->out = out;
+	valid = false;
+	shownHires = false;
+	started = false;
+}
+
+termRenderer::~termRenderer() {
+	if(started) {
+		buffer.clear();
+		moveTo(shownHires ? 33 : 17, 1);
+		buffer += "\x1b[?25h";			//Show the cursor again
+		fwrite(buffer.data(), 1, buffer.size(), out);
+		fflush(out);
+	}
+}
+
+void termRenderer::begin() {
+	fputs("\x1b[2J\x1b[?25l", out);		//Clear the screen, hide the cursor
+	fflush(out);
+	started = true;
+	valid = false;
+}
+
+void termRenderer::invalidate() {
+	valid = false;
+}
+
+void termRenderer::moveTo(int line, int column) {
+	char move[24];
+	snprintf(move, sizeof(move), "\x1b[%d;%dH", line, column);
+	buffer += move;
+}
+
+void termRenderer::draw(const uint64_t planes[2][64][2], bool hires) {
+	buffer.clear();
+
+	if(hires != shownHires)
+	{
+		buffer += "\x1b[2J";			//The picture changed size, so start again from a blank terminal
+		shownHires = hires;
+		valid = false;
+	}
+
+	int lines = hires ? 32 : 16;
+	int words = hires ? 2 : 1;
+	for(int line = 0; line < lines; line++)
+	{
+		int cursor = -1;				//Column the terminal cursor is at, if it's somewhere on this line
+		for(int word = 0; word < words; word++)
+		{
+			uint64_t top = planes[0][line * 2][word] | planes[1][line * 2][word];
+			uint64_t bottom = planes[0][line * 2 + 1][word] | planes[1][line * 2 + 1][word];
+
+			//Every bit set here is a character cell where either of its two pixels changed
+			uint64_t changed = ~0ULL;
+			if(valid) {
+				changed = (top ^ shown[line * 2][word]) | (bottom ^ shown[line * 2 + 1][word]);
+			}
+
+			while(changed != 0)
+			{
+				//Find the leftmost changed cell. Bit 63 is the first column of this word.
+				int bit = 0;
+				while((changed & (1ULL << (63 - bit))) == 0) {
+					bit++;
+				}
+				changed &= ~(1ULL << (63 - bit));
+
+				//Writing a character moves the cursor one to the right by itself, so runs of changed cells only need one move
+				int column = word * 64 + bit;
+				if(cursor != column) {
+					moveTo(line + 1, column + 1);
+				}
+				int cell = (int)((top >> (63 - bit)) & 1) | (int)(((bottom >> (63 - bit)) & 1) << 1);
+				buffer += glyphs[cell];
+				cursor = column + 1;
+			}
+
+			shown[line * 2][word] = top;
+			shown[line * 2 + 1][word] = bottom;
+		}
+	}
+	valid = true;
+
+	if(!buffer.empty()) {
+		fwrite(buffer.data(), 1, buffer.size(), out);
+		fflush(out);
+	}
+}
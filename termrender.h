@@ -0,0 +1,34 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+/*Draws the CHIP-8 screen in any terminal that understands ANSI escape codes, which is every terminal on Linux and macOS and anything
+ *you'd ssh in from.
+ *
+ *Terminal characters are roughly twice as tall as they are wide, so each character cell shows two pixel rows: '▀' is just the top one,
+ *'▄' just the bottom one, '█' both and ' ' neither. That fits the 64x32 screen in 64x16 characters and keeps the pixels square, and
+ *SUPER-CHIP's 128x64 one in 128x32. XO-CHIP's two planes are shown together: a pixel is lit if it's on in either.
+ *
+ *It also remembers what's already on the terminal, and only sends the cells that actually changed. Most frames only change a sprite or
+ *two, and over a slow ssh link that's the difference between a few dozen bytes a frame and several kilobytes.*/
+
+class termRenderer {
+	public:
+		termRenderer(FILE *out = stdout);
+		~termRenderer();					//Puts the cursor back and moves it below the picture
+
+		void begin();						//Clears the terminal and hides the cursor. Call before the first draw().
+		void draw(const uint64_t planes[2][64][2], bool hires);	//Brings the terminal up to date with a frame laid out like
+																	//emu::graphics, 128x64 if hires and 64x32 otherwise
+		void invalidate();					//Forgets what's on the terminal, so the next draw() redraws everything
+
+	private:
+		FILE *out;
+		uint64_t shown[64][2];				//What the terminal is showing right now
+		bool shownHires;					//...and at which resolution
+		bool valid;							//False until we've drawn a full frame
+		bool started;
+		std::string buffer;					//Everything for one frame gets built up here and written in one go
+
+		void moveTo(int line, int column);
+};
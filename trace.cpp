@@ -0,0 +1,193 @@
+#include "trace.h"
+#include <string.h>
+#include <chrono>
+
+#ifdef _WIN32
+#define TRACE_FWRITE		//Plain buffered writes on Windows
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define TRACE_WINDOW (64 << 20)			//How much of the file is mapped at once. A multiple of any page size there is.
+#define TRACE_BATCH 4096				//Records encoded at a time
+#define TRACE_SLEEP_MS 1				//How long the writer naps when the ring is empty
+
+void traceEncode(const traceRecord &record, unsigned char *out) {
+	for(int i = 0; i < 8; i++) {
+		out[i] = (record.cycle >> (i * 8)) & 0xFF;
+	}
+	out[8] = record.pc & 0xFF;
+	out[9] = record.pc >> 8;
+	out[10] = record.opcode & 0xFF;
+	out[11] = record.opcode >> 8;
+	out[12] = record.index & 0xFF;
+	out[13] = record.index >> 8;
+	out[14] = record.reg;
+	out[15] = record.value;
+}
+
+void traceDecode(const unsigned char *in, traceRecord &record) {
+	record.cycle = 0;
+	for(int i = 0; i < 8; i++) {
+		record.cycle |= (uint64_t)in[i] << (i * 8);
+	}
+	record.pc = in[8] | in[9] << 8;
+	record.opcode = in[10] | in[11] << 8;
+	record.index = in[12] | in[13] << 8;
+	record.reg = in[14];
+	record.value = in[15];
+}
+
+traceWriter::traceWriter(unsigned int capacity) : head(0), stalls(0), tail(0), running(false), broken(false) {
+	this->capacity = 1;
+	while(this->capacity < capacity) {
+		this->capacity <<= 1;
+	}
+	ring = new traceRecord[this->capacity];
+	tailSeen = 0;
+	headSeen = 0;
+	file = NULL;
+	fd = -1;
+	window = NULL;
+	windowStart = 0;
+	windowUsed = 0;
+}
+
+traceWriter::~traceWriter() {
+	close();
+	delete[] ring;
+}
+
+bool traceWriter::open(const char *path) {
+	close();
+
+#ifdef TRACE_FWRITE
+	file = fopen(path, "wb");
+	if(file == NULL) {
+		return false;
+	}
+#else
+	fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		return false;
+	}
+	if(!moveWindow(0)) {
+		::close(fd);
+		fd = -1;
+		return false;
+	}
+#endif
+
+	unsigned char header[TRACE_HEADER];
+	memcpy(header, TRACE_MAGIC, 4);
+	header[4] = TRACE_VERSION & 0xFF;
+	header[5] = TRACE_VERSION >> 8;
+	header[6] = TRACE_RECORD;
+	header[7] = 0;
+	write(header, sizeof(header));
+
+	running = true;
+	writer = std::thread(&traceWriter::run, this);
+	return true;
+}
+
+void traceWriter::close() {
+	if(!running) {
+		return;
+	}
+	running = false;
+	writer.join();
+
+#ifdef TRACE_FWRITE
+	fclose(file);
+	file = NULL;
+#else
+	munmap(window, TRACE_WINDOW);
+	window = NULL;
+	if(ftruncate(fd, (off_t)(windowStart + windowUsed)) != 0) {	//It grew a whole window at a time, so trim off what wasn't used
+		broken = true;
+	}
+	::close(fd);
+	fd = -1;
+#endif
+}
+
+//Maps the window starting at `start`, growing the file to cover it
+bool traceWriter::moveWindow(unsigned long long start) {
+#ifndef TRACE_FWRITE
+	if(window != NULL) {
+		munmap(window, TRACE_WINDOW);
+		window = NULL;
+	}
+	if(ftruncate(fd, (off_t)(start + TRACE_WINDOW)) != 0) {
+		return false;
+	}
+	void *mapped = mmap(NULL, TRACE_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)start);
+	if(mapped == MAP_FAILED) {
+		return false;
+	}
+	window = (unsigned char *)mapped;
+	windowStart = start;
+	windowUsed = 0;
+#endif
+	return true;
+}
+
+void traceWriter::write(const unsigned char *bytes, size_t length) {
+	if(broken) {
+		return;
+	}
+#ifdef TRACE_FWRITE
+	if(fwrite(bytes, 1, length, file) != length) {
+		broken = true;
+	}
+#else
+	while(length > 0)
+	{
+		if(windowUsed == TRACE_WINDOW && !moveWindow(windowStart + TRACE_WINDOW)) {
+			broken = true;				//Out of disk, most likely
+			return;
+		}
+		size_t n = TRACE_WINDOW - windowUsed < length ? TRACE_WINDOW - windowUsed : length;
+		memcpy(window + windowUsed, bytes, n);
+		windowUsed += n;
+		bytes += n;
+		length -= n;
+	}
+#endif
+}
+
+size_t traceWriter::drain() {
+	unsigned char encoded[TRACE_BATCH * TRACE_RECORD];
+	size_t total = 0;
+	for(;;)
+	{
+		size_t at = tail.load(std::memory_order_relaxed);
+		if(at == headSeen) {
+			headSeen = head.load(std::memory_order_acquire);
+			if(at == headSeen) {
+				return total;
+			}
+		}
+
+		size_t n = headSeen - at < TRACE_BATCH ? headSeen - at : TRACE_BATCH;
+		for(size_t i = 0; i < n; i++) {
+			traceEncode(ring[(at + i) & (capacity - 1)], encoded + i * TRACE_RECORD);
+		}
+		tail.store(at + n, std::memory_order_release);		//Those slots are free again as soon as they're encoded
+		write(encoded, n * TRACE_RECORD);
+		total += n;
+	}
+}
+
+void traceWriter::run() {
+	while(running)
+	{
+		if(drain() == 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(TRACE_SLEEP_MS));
+		}
+	}
+	drain();							//The emulator's done by now, so this gets everything
+}
@@ -0,0 +1,111 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+
+/*Optional execution tracing. Build with -DCHIP8_TRACE and hand an emu a traceWriter (emu::setTrace()), and every instruction it runs
+ *leaves a 16 byte record behind: the cycle, the pc, the opcode, I afterwards, and which register it changed and to what. That's enough
+ *to line two runs up instruction by instruction and find the first place they disagree. chip8-tracediff (tracediff.cpp) does that.
+ *
+ *While it's tracing, an emu runs every instruction through the interpreter, one at a time: nothing runs natively, nothing gets fused,
+ *and idle loops go round for real instead of being skipped. So a trace is the same whether the JIT was on or not, and has a record
+ *for every instruction a reference emulator would run.
+ *
+ *Writing the file mustn't hold the emulator up much, so record() only copies the record into a ring, and the writer's own thread
+ *takes them out, encodes them and copies them into a memory-mapped file. If that thread falls a whole ring behind, record() waits for
+ *room (and counts that it did) rather than lose anything: a trace with holes in it is no good for comparing.
+ *
+ *Without CHIP8_TRACE, the TRACE() lines in chip8.cpp turn into nothing at all.
+ *
+ *The file is:
+ *	"C8TR"		magic
+ *	2 bytes		version
+ *	2 bytes		size of a record (16)
+ *	records		each one 8 bytes cycle, 2 bytes pc, 2 bytes opcode, 2 bytes I, 1 byte register, 1 byte its new value
+ *All little-endian. The register is 0xFF when the instruction changed none. When it changed several (FX65, or an 8XYN that sets VF
+ *as well), it's the lowest-numbered one other than VF.*/
+
+#ifdef CHIP8_TRACE
+#define TRACE(code) code
+#else
+#define TRACE(code)
+#endif
+
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+#define TRACE_HEADER 8
+#define TRACE_RECORD 16
+#define TRACE_NO_REGISTER 0xFF
+
+struct traceRecord {
+	uint64_t cycle;
+	uint16_t pc;
+	uint16_t opcode;
+	uint16_t index;
+	uint8_t reg;					//TRACE_NO_REGISTER if none changed
+	uint8_t value;
+};
+
+void traceEncode(const traceRecord &record, unsigned char *out);		//TRACE_RECORD bytes, in the file's format
+void traceDecode(const unsigned char *in, traceRecord &record);
+
+class traceWriter {
+	public:
+		traceWriter(unsigned int capacity = 1 << 20);	//Records in the ring, rounded up to a power of two
+		~traceWriter();							//Closes it, if close() hasn't been called
+
+		bool open(const char *path);			//Creates the file and starts the writing thread
+		void close();							//Writes out whatever's still in the ring, trims the file to fit and joins the thread
+
+		//Emulator side
+		void record(const traceRecord &record) {
+			size_t at = head.load(std::memory_order_relaxed);
+			if(at - tailSeen >= capacity) {
+				tailSeen = tail.load(std::memory_order_acquire);
+				while(at - tailSeen >= capacity) {
+					stalls.store(stalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+					std::this_thread::yield();
+					tailSeen = tail.load(std::memory_order_acquire);
+				}
+			}
+			ring[at & (capacity - 1)] = record;
+			head.store(at + 1, std::memory_order_release);
+		}
+
+		unsigned long long getRecords() const { return head.load(std::memory_order_relaxed); }
+		unsigned long long getStalls() const { return stalls.load(std::memory_order_relaxed); }	//Times record() had to wait
+		bool failed() const { return broken.load(); }	//The file couldn't be written, or grown. Records after that were lost.
+
+	private:
+		traceRecord *ring;
+		size_t capacity;
+
+		//Laid out just like eventQueue's, see events.h
+		std::atomic<size_t> head;
+		size_t tailSeen;
+		std::atomic<unsigned long long> stalls;
+		char apart[64];
+		std::atomic<size_t> tail;
+		size_t headSeen;
+
+		std::thread writer;
+		std::atomic<bool> running;
+		std::atomic<bool> broken;
+
+		//Where the records go. On Windows that's plain fwrite()s; everywhere else it's a window onto the file that moves along as it
+		//fills, with the file grown a window at a time.
+		FILE *file;
+		int fd;
+		unsigned char *window;
+		unsigned long long windowStart;			//Where in the file the window is
+		size_t windowUsed;
+
+		void run();
+		size_t drain();							//Encodes and writes whatever's in the ring now. Returns how many records.
+		void write(const unsigned char *bytes, size_t length);
+		bool moveWindow(unsigned long long start);
+
+		traceWriter(const traceWriter &);
+		traceWriter &operator=(const traceWriter &);
+};
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+/*chip8-tracediff: finds the first instruction where two traces (see trace.h) disagree.
+ *
+ *	chip8-tracediff [--ignore-cycles] [--context N] A.trace B.trace
+ *
+ *Both files are read a block at a time and the blocks compared whole, so it goes at about the speed of the disk and never holds more
+ *than a couple of blocks in memory, however long the traces are. Only when a block differs do we look at its records one by one.
+ *
+ *--ignore-cycles leaves the cycle counts out of it, for comparing against an emulator that counts them differently (or starts from
+ *somewhere else). --context N prints the N records before the difference too (8 unless you say).
+ *
+ *Exits with 0 if the traces match, 1 if they don't, and 2 if one of them couldn't be read.*/
+
+#define BLOCK_RECORDS 65536
+
+struct traceFile {
+	FILE *file;
+	const char *path;
+	unsigned char *block;
+	size_t records;						//In the block
+	unsigned char *previous;			//The block before it, for context
+	size_t previousRecords;
+};
+
+static bool openTrace(traceFile &t, const char *path) {
+	t.path = path;
+	t.file = fopen(path, "rb");
+	if(t.file == NULL) {
+		fprintf(stderr, "Couldn't open %s\n", path);
+		return false;
+	}
+
+	unsigned char header[TRACE_HEADER];
+	if(fread(header, 1, sizeof(header), t.file) != sizeof(header) || memcmp(header, TRACE_MAGIC, 4) != 0) {
+		fprintf(stderr, "%s isn't a trace\n", path);
+		return false;
+	}
+	unsigned int version = header[4] | header[5] << 8;
+	unsigned int recordSize = header[6] | header[7] << 8;
+	if(version != TRACE_VERSION || recordSize != TRACE_RECORD) {
+		fprintf(stderr, "%s is trace version %u, and we only know version %u\n", path, version, TRACE_VERSION);
+		return false;
+	}
+
+	t.block = new unsigned char[BLOCK_RECORDS * TRACE_RECORD];
+	t.previous = new unsigned char[BLOCK_RECORDS * TRACE_RECORD];
+	t.records = 0;
+	t.previousRecords = 0;
+	return true;
+}
+
+//Moves on to the next block. False at the end of the file.
+static bool nextBlock(traceFile &t) {
+	unsigned char *swap = t.previous;
+	t.previous = t.block;
+	t.previousRecords = t.records;
+	t.block = swap;
+	t.records = fread(t.block, TRACE_RECORD, BLOCK_RECORDS, t.file);	//A torn record at the very end is left off
+	return t.records > 0;
+}
+
+//Record `i` of the current block, or counting back into the previous one if it's negative
+static const unsigned char *recordAt(const traceFile &t, long i) {
+	if(i >= 0) {
+		return t.block + i * TRACE_RECORD;
+	}
+	i += (long)t.previousRecords;
+	return i >= 0 ? t.previous + i * TRACE_RECORD : NULL;
+}
+
+static void printRecord(const char *label, unsigned long long number, const unsigned char *bytes) {
+	traceRecord r;
+	traceDecode(bytes, r);
+	printf("  %s #%-12llu cycle %-12llu pc 0x%03X  %04X  I=0x%03X", label, number, (unsigned long long)r.cycle, r.pc, r.opcode,
+		r.index);
+	if(r.reg != TRACE_NO_REGISTER) {
+		printf("  V%X=0x%02X", r.reg, r.value);
+	}
+	printf("\n");
+}
+
+static bool sameRecord(const unsigned char *a, const unsigned char *b, bool ignoreCycles) {
+	return ignoreCycles ? memcmp(a + 8, b + 8, TRACE_RECORD - 8) == 0 : memcmp(a, b, TRACE_RECORD) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	bool ignoreCycles = false;
+	long context = 8;
+	const char *paths[2] = { NULL, NULL };
+	int pathCount = 0;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--ignore-cycles") == 0) {
+			ignoreCycles = true;
+		} else if(strcmp(argv[i], "--context") == 0 && i + 1 < argc) {
+			context = atol(argv[++i]);
+		} else if(pathCount < 2) {
+			paths[pathCount++] = argv[i];
+		}
+	}
+	if(pathCount < 2)
+	{
+		printf("Usage: chip8-tracediff [--ignore-cycles] [--context N] A.trace B.trace\n");
+		return 2;
+	}
+
+	traceFile a, b;
+	if(!openTrace(a, paths[0]) || !openTrace(b, paths[1])) {
+		return 2;
+	}
+
+	unsigned long long compared = 0;			//Records before the current blocks
+	for(;;)
+	{
+		bool moreA = nextBlock(a);
+		bool moreB = nextBlock(b);
+		size_t common = a.records < b.records ? a.records : b.records;
+
+		//The usual case: the whole block matches, and that's one memcmp
+		size_t differ = common;
+		if(ignoreCycles || memcmp(a.block, b.block, common * TRACE_RECORD) != 0)
+		{
+			for(size_t i = 0; i < common; i++)
+			{
+				if(!sameRecord(a.block + i * TRACE_RECORD, b.block + i * TRACE_RECORD, ignoreCycles)) {
+					differ = i;
+					break;
+				}
+			}
+		}
+
+		if(differ < common)
+		{
+			unsigned long long at = compared + differ;
+			printf("First difference at record %llu\n", at);
+			if(context > 0) {
+				printf("Before it, both had:\n");
+				for(long i = (long)differ - context; i < (long)differ; i++) {
+					const unsigned char *before = recordAt(a, i);
+					if(before != NULL) {
+						printRecord(" ", compared + i, before);
+					}
+				}
+			}
+			printf("Then:\n");
+			printRecord("A", at, a.block + differ * TRACE_RECORD);
+			printRecord("B", at, b.block + differ * TRACE_RECORD);
+			return 1;
+		}
+
+		compared += common;
+		if(a.records != b.records)
+		{
+			//One of them ran out. Whichever has more in this block is the longer one.
+			const traceFile &longer = a.records > b.records ? a : b;
+			printf("Traces match for %llu records, then %s ends and %s goes on:\n", compared,
+				a.records > b.records ? b.path : a.path, longer.path);
+			printRecord(a.records > b.records ? "A" : "B", compared, longer.block + common * TRACE_RECORD);
+			return 1;
+		}
+		if(!moreA && !moreB) {
+			break;
+		}
+	}
+
+	printf("Traces match: %llu records\n", compared);
+	return 0;
+}
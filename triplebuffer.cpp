@@ -0,0 +1,25 @@
+#include "triplebuffer.h"
+#include <string.h>
+
+tripleBuffer::tripleBuffer() : middle(1) {
+	memset(frames, 0, sizeof(frames));
+	writing = 0;
+	reading = 2;
+	published = 0;
+}
+
+void tripleBuffer::publish() {
+	frames[writing].number = ++published;
+
+	//Release: everything written into the frame is visible to whoever picks this slot up with an acquire.
+	writing = middle.exchange(writing | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
+
+bool tripleBuffer::fetch() {
+	if((middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+		return false;
+	}
+
+	reading = middle.exchange(reading, std::memory_order_acq_rel) & ~FRESH;
+	return true;
+}
@@ -0,0 +1,39 @@
+#include <stdint.h>
+#include <atomic>
+
+/*Hands finished frames from the emulator thread to a render thread without either of them ever waiting on the other.
+ *
+ *There are three frame slots. The emulator owns one (it draws into it), the renderer owns one (it reads from it), and the third sits in
+ *the middle. Publishing a frame swaps the emulator's slot with the middle one; fetching swaps the renderer's slot with the middle one.
+ *Each swap is a single atomic exchange, so nobody ever takes a lock, nobody ever touches a slot someone else owns (so there's no
+ *tearing), and the renderer always gets the newest frame. Frames it was too slow to show just get overwritten.*/
+
+struct frame {
+	uint64_t planes[2][64][2];		//Same layout as emu::graphics
+	bool hires;						//128x64 rather than 64x32, like emu::isHires()
+	unsigned long long number;		//Counts up with every published frame
+};
+
+class tripleBuffer {
+	public:
+		tripleBuffer();
+
+		//Emulator side
+		frame &writeBuffer() { return frames[writing]; }
+		void publish();						//The write buffer is finished. Hand it over and start on a different one.
+		bool unfetched() const { return (middle.load(std::memory_order_relaxed) & FRESH) != 0; }	//The last frame published
+																	//is still waiting for the renderer, so a new one would replace it
+
+		//Renderer side
+		bool fetch();						//Picks up the newest frame if there's one we haven't seen. False if nothing new.
+		const frame &readBuffer() const { return frames[reading]; }
+
+	private:
+		enum { FRESH = 4 };					//Set in `middle` when it holds a frame the renderer hasn't fetched yet
+
+		frame frames[3];
+		std::atomic<unsigned int> middle;	//Which slot is in the middle, plus FRESH
+		unsigned int writing;				//Only ever touched by the emulator thread
+		unsigned int reading;				//Only ever touched by the render thread
+		unsigned long long published;
+};
@@ -0,0 +1,109 @@
+#include "workpool.h"
+
+workPool::workPool(unsigned int threads) : nextQueue(0), pending(0), stopping(false) {
+	if(threads == 0) {
+		threads = std::thread::hardware_concurrency();
+		if(threads == 0) {
+			threads = 1;			//hardware_concurrency() is allowed to just not know
+		}
+	}
+
+	for(unsigned int i = 0; i < threads; i++) {
+		queues.push_back(new queue);
+	}
+	for(unsigned int i = 0; i < threads; i++) {
+		workers.push_back(std::thread(&workPool::workerLoop, this, i));
+	}
+}
+
+workPool::~workPool() {
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for(size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	for(size_t i = 0; i < queues.size(); i++) {
+		delete queues[i];
+	}
+}
+
+void workPool::submit(const std::function<void()> &job) {
+	queue &q = *queues[nextQueue++ % queues.size()];
+	pending++;
+	{
+		std::lock_guard<std::mutex> guard(q.lock);
+		q.jobs.push_back(job);
+	}
+
+	//Taking sleepLock before notifying means a worker can't check for work, miss this job, and then go to sleep anyway.
+	std::lock_guard<std::mutex> guard(sleepLock);
+	wake.notify_one();
+}
+
+void workPool::wait() {
+	std::unique_lock<std::mutex> guard(sleepLock);
+	while(pending != 0) {
+		done.wait(guard);
+	}
+}
+
+bool workPool::takeJob(unsigned int self, std::function<void()> &job) {
+	//Our own queue first, newest job first...
+	{
+		queue &q = *queues[self];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if(!q.jobs.empty()) {
+			job = q.jobs.back();
+			q.jobs.pop_back();
+			return true;
+		}
+	}
+
+	//...then steal the oldest job from whoever has one, starting with our neighbour so the thieves don't all pick on queue 0.
+	for(size_t i = 1; i < queues.size(); i++) {
+		queue &q = *queues[(self + i) % queues.size()];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if(!q.jobs.empty()) {
+			job = q.jobs.front();
+			q.jobs.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void workPool::workerLoop(unsigned int self) {
+	std::function<void()> job;
+
+	while(true) {
+		if(takeJob(self, job)) {
+			job();
+			job = std::function<void()>();
+
+			if(--pending == 0) {
+				std::lock_guard<std::mutex> guard(sleepLock);
+				done.notify_all();
+			}
+			continue;
+		}
+
+		//Nothing anywhere. Sleep until submit() or the destructor wakes us, checking once more under the lock first.
+		std::unique_lock<std::mutex> guard(sleepLock);
+		if(stopping) {
+			return;
+		}
+		bool anyWork = false;
+		for(size_t i = 0; i < queues.size() && !anyWork; i++) {
+			std::lock_guard<std::mutex> queueGuard(queues[i]->lock);
+			anyWork = !queues[i]->jobs.empty();
+		}
+		if(!anyWork) {
+			wake.wait(guard);
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*A thread pool where every worker has its own queue of jobs. Workers take jobs off the back of their own queue, and when that runs dry
+ *they go and take jobs off the front of somebody else's. Jobs that take wildly different amounts of time (which is what you get when
+ *every emulator runs a different ROM) then spread themselves out over all the cores without any one queue becoming the bottleneck.*/
+
+class workPool {
+	public:
+		workPool(unsigned int threads);		//0 means one thread per core
+		~workPool();
+
+		void submit(const std::function<void()> &job);
+		void wait();						//Blocks until every submitted job has finished
+
+		unsigned int size() const { return (unsigned int)workers.size(); }
+
+	private:
+		struct queue {
+			std::mutex lock;
+			std::deque<std::function<void()> > jobs;
+		};
+
+		std::vector<std::thread> workers;
+		std::vector<queue *> queues;
+		std::atomic<unsigned int> nextQueue;	//Round-robin counter for submit()
+		std::atomic<unsigned long> pending;		//Jobs submitted but not finished yet
+		std::atomic<bool> stopping;
+
+		std::mutex sleepLock;					//Idle workers and wait() sleep on these
+		std::condition_variable wake;
+		std::condition_variable done;
+
+		void workerLoop(unsigned int self);
+		bool takeJob(unsigned int self, std::function<void()> &job);
+};